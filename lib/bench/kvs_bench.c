@@ -0,0 +1,532 @@
+/*
+ * Copyright (c) 2023 Laczen
+ *
+ * KVS benchmark: ops/s and latency percentiles of the kvs routines on the RAM
+ * or file backend, for a base configuration and sweeps over the partition
+ * size, block size, prog buffer size, key count and value size.
+ *
+ * usage: kvs_bench [-q] [-f file | -m file | -u file]
+ *		   [-s size|bsz|psz|keys|vsz]
+ *	-q: quick run of a small configuration (fails on any error)
+ *	-f: use the file backend on file instead of the RAM backend
+ *	-m: use the mmap backend on file instead of the RAM backend
+ *	-u: use the io_uring backend on file instead of the RAM backend
+ *	-s: only run the given sweep (default: all sweeps)
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "kvs/kvs.h"
+#include "kvs/kvs_backend_file.h"
+#include "kvs/kvs_backend_mmap.h"
+#include "kvs/kvs_backend_ram.h"
+#ifdef KVS_BACKEND_URING
+#include "kvs/kvs_backend_uring.h"
+#endif
+
+#define BENCH_BSPR 1U
+#define BENCH_KEYFMT "k%05u"
+#define BENCH_MISSFMT "m%05u"
+
+struct bench_cfg {
+	uint32_t size;		/* partition size */
+	uint32_t bsz;		/* block size */
+	uint32_t psz;		/* prog buffer size */
+	uint32_t keys;		/* number of keys */
+	uint32_t vsz;		/* value size */
+};
+
+enum bench_backends {
+	BENCH_RAM,
+	BENCH_FILE,
+	BENCH_MMAP,
+	BENCH_URING,
+};
+
+static const char *const bench_be_names[] = {"ram", "file", "mmap", "uring"};
+
+struct bench_run {
+	enum bench_backends be;	/* backend */
+	const char *file;	/* file for the file backends */
+	uint32_t rounds;	/* number of times each key is written */
+	uint32_t iter;		/* iterations of walk, compact and mount */
+	uint64_t *lat;		/* latency buffer */
+	uint8_t *value;		/* value buffer */
+};
+
+static const char bench_cookie[] = "kvs_bench";
+
+static uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+	const uint64_t la = *(const uint64_t *)a;
+	const uint64_t lb = *(const uint64_t *)b;
+
+	return (la > lb) - (la < lb);
+}
+
+static void bench_report(const struct bench_run *run,
+			 const struct bench_cfg *cfg, const char *op,
+			 uint64_t *lat, uint32_t cnt)
+{
+	uint64_t total = 0U;
+
+	for (uint32_t i = 0U; i < cnt; i++) {
+		total += lat[i];
+	}
+
+	qsort(lat, cnt, sizeof(uint64_t), bench_cmp);
+	printf("%-5s %7u %5u %4u %5u %5u %-12s %11.0f %9.2f %9.2f\n",
+	       bench_be_names[run->be], cfg->size, cfg->bsz,
+	       cfg->psz, cfg->keys, cfg->vsz, op,
+	       total != 0U ? (double)cnt * 1e9 / (double)total : 0.0,
+	       (double)lat[(cnt - 1U) / 2U] / 1e3,
+	       (double)lat[((cnt - 1U) * 99U) / 100U] / 1e3);
+}
+
+static void bench_value(uint8_t *value, uint32_t len, uint32_t seed)
+{
+	for (uint32_t i = 0U; i < len; i++) {
+		value[i] = (uint8_t)(seed + i);
+	}
+}
+
+static int bench_walk_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	uint32_t *cnt = (uint32_t *)cb_arg;
+
+	(void)ent;
+	(*cnt)++;
+	return 0;
+}
+
+/* run all operations on a mounted kvs, returns 0 or the first error */
+static int bench_ops(const struct bench_run *run, const struct bench_cfg *cfg,
+		     struct kvs *kvs)
+{
+	uint64_t *lat = run->lat;
+	uint8_t *value = run->value;
+	uint8_t *rdvalue = value + cfg->vsz;
+	char key[16];
+	uint32_t cnt;
+	uint64_t start;
+	int rc;
+
+	cnt = 0U;
+	for (uint32_t r = 0U; r < run->rounds; r++) {
+		for (uint32_t k = 0U; k < cfg->keys; k++) {
+			(void)snprintf(key, sizeof(key), BENCH_KEYFMT, k);
+			bench_value(value, cfg->vsz, r + k);
+			start = bench_now();
+			rc = kvs_write(kvs, key, value, cfg->vsz);
+			lat[cnt++] = bench_now() - start;
+			if (rc != 0) {
+				return rc;
+			}
+
+		}
+
+	}
+
+	bench_report(run, cfg, "write", lat, cnt);
+
+	cnt = 0U;
+	for (uint32_t r = 0U; r < run->rounds; r++) {
+		for (uint32_t k = 0U; k < cfg->keys; k++) {
+			(void)snprintf(key, sizeof(key), BENCH_KEYFMT, k);
+			start = bench_now();
+			rc = kvs_read(kvs, key, rdvalue, cfg->vsz);
+			lat[cnt++] = bench_now() - start;
+			if (rc != 0) {
+				return rc;
+			}
+
+			bench_value(value, cfg->vsz, run->rounds - 1U + k);
+			if (memcmp(value, rdvalue, cfg->vsz) != 0) {
+				return -KVS_EIO;
+			}
+
+		}
+
+	}
+
+	bench_report(run, cfg, "read_hit", lat, cnt);
+
+	cnt = 0U;
+	for (uint32_t k = 0U; k < cfg->keys; k++) {
+		(void)snprintf(key, sizeof(key), BENCH_MISSFMT, k);
+		start = bench_now();
+		rc = kvs_read(kvs, key, rdvalue, cfg->vsz);
+		lat[cnt++] = bench_now() - start;
+		if (rc != -KVS_ENOENT) {
+			return rc == 0 ? -KVS_EIO : rc;
+		}
+
+	}
+
+	bench_report(run, cfg, "read_miss", lat, cnt);
+
+	for (uint32_t i = 0U; i < run->iter; i++) {
+		uint32_t ecnt = 0U;
+
+		start = bench_now();
+		rc = kvs_walk(kvs, "k", bench_walk_cb, &ecnt);
+		lat[i] = bench_now() - start;
+		if (rc != 0) {
+			return rc;
+		}
+
+		if (ecnt < cfg->keys) {
+			return -KVS_EIO;
+		}
+
+	}
+
+	bench_report(run, cfg, "walk", lat, run->iter);
+
+	for (uint32_t i = 0U; i < run->iter; i++) {
+		uint32_t ecnt = 0U;
+
+		start = bench_now();
+		rc = kvs_walk_unique(kvs, "k", bench_walk_cb, &ecnt);
+		lat[i] = bench_now() - start;
+		if (rc != 0) {
+			return rc;
+		}
+
+		if (ecnt != cfg->keys) {
+			return -KVS_EIO;
+		}
+
+	}
+
+	bench_report(run, cfg, "walk_unique", lat, run->iter);
+
+	/* kvs_compact() needs the live data to fit in a block, the compaction
+	 * of a single block (kvs_gc() with KVS_GC_ALWAYS) is measured instead.
+	 */
+	for (uint32_t i = 0U; i < run->iter; i++) {
+		start = bench_now();
+		rc = kvs_gc(kvs);
+		lat[i] = bench_now() - start;
+		if (rc != 0) {
+			return rc;
+		}
+
+	}
+
+	bench_report(run, cfg, "compact", lat, run->iter);
+
+	for (uint32_t i = 0U; i < run->iter; i++) {
+		rc = kvs_unmount(kvs);
+		if (rc != 0) {
+			return rc;
+		}
+
+		start = bench_now();
+		rc = kvs_mount(kvs);
+		lat[i] = bench_now() - start;
+		if (rc != 0) {
+			return rc;
+		}
+
+	}
+
+	bench_report(run, cfg, "mount", lat, run->iter);
+
+	/* the same writes and reads with numeric keys on a erased kvs */
+	rc = kvs_unmount(kvs);
+	if (rc == 0) {
+		rc = kvs_erase(kvs);
+	}
+
+	if (rc == 0) {
+		rc = kvs_mount(kvs);
+	}
+
+	if (rc != 0) {
+		return rc;
+	}
+
+	cnt = 0U;
+	for (uint32_t r = 0U; r < run->rounds; r++) {
+		for (uint32_t k = 0U; k < cfg->keys; k++) {
+			bench_value(value, cfg->vsz, r + k);
+			start = bench_now();
+			rc = kvs_write_id(kvs, (uint16_t)k, value, cfg->vsz);
+			lat[cnt++] = bench_now() - start;
+			if (rc != 0) {
+				return rc;
+			}
+
+		}
+
+	}
+
+	bench_report(run, cfg, "write_id", lat, cnt);
+
+	cnt = 0U;
+	for (uint32_t k = 0U; k < cfg->keys; k++) {
+		start = bench_now();
+		rc = kvs_read_id(kvs, (uint16_t)k, rdvalue, cfg->vsz);
+		lat[cnt++] = bench_now() - start;
+		if (rc != 0) {
+			return rc;
+		}
+
+		bench_value(value, cfg->vsz, run->rounds - 1U + k);
+		if (memcmp(value, rdvalue, cfg->vsz) != 0) {
+			return -KVS_EIO;
+		}
+
+	}
+
+	bench_report(run, cfg, "read_id", lat, cnt);
+	return 0;
+}
+
+static int bench_config(struct bench_run *run, const struct bench_cfg *cfg)
+{
+	struct kvs_be_ram ram = {
+		.size = cfg->size,
+		.esize = cfg->bsz,
+	};
+	struct kvs_be_file file = {
+		.path = run->file,
+		.size = cfg->size,
+		.fd = -1,
+	};
+	struct kvs_be_mmap map = {
+		.path = run->file,
+		.size = cfg->size,
+		.fd = -1,
+	};
+#ifdef KVS_BACKEND_URING
+	struct kvs_be_uring uring = {
+		.path = run->file,
+		.size = cfg->size,
+	};
+#endif
+	const struct kvs_cfg be_cfg[] = {
+		[BENCH_RAM] = {
+			.ctx = (void *)&ram,
+			.read = kvs_be_ram_read,
+			.prog = kvs_be_ram_prog,
+			.comp = kvs_be_ram_comp,
+		},
+		[BENCH_FILE] = {
+			.ctx = (void *)&file,
+			.read = kvs_be_file_read,
+			.prog = kvs_be_file_prog,
+			.comp = kvs_be_file_comp,
+			.sync = kvs_be_file_sync,
+			.init = kvs_be_file_init,
+			.release = kvs_be_file_release,
+		},
+		[BENCH_MMAP] = {
+			.ctx = (void *)&map,
+			.read = kvs_be_mmap_read,
+			.prog = kvs_be_mmap_prog,
+			.comp = kvs_be_mmap_comp,
+			.sync = kvs_be_mmap_sync,
+			.init = kvs_be_mmap_init,
+			.release = kvs_be_mmap_release,
+		},
+#ifdef KVS_BACKEND_URING
+		[BENCH_URING] = {
+			.ctx = (void *)&uring,
+			.read = kvs_be_uring_read,
+			.prog = kvs_be_uring_prog,
+			.comp = kvs_be_uring_comp,
+			.sync = kvs_be_uring_sync,
+			.init = kvs_be_uring_init,
+			.release = kvs_be_uring_release,
+		},
+#endif
+	};
+	const struct kvs_cfg *be = &be_cfg[run->be];
+	uint8_t *pbuf = malloc(cfg->psz);
+	const struct kvs_cfg kvs_cfg = {
+		.ctx = be->ctx,
+		.bsz = cfg->bsz,
+		.bcnt = cfg->size / cfg->bsz,
+		.bspr = BENCH_BSPR,
+		.pbuf = pbuf,
+		.psz = cfg->psz,
+		.read = be->read,
+		.prog = be->prog,
+		.comp = be->comp,
+		.sync = be->sync,
+		.init = be->init,
+		.release = be->release,
+	};
+	struct kvs_data kvs_data = {
+		.cookie = (void *)bench_cookie,
+		.csz = sizeof(bench_cookie) - 1,
+		.gc = KVS_GC_ALWAYS,
+	};
+	struct kvs kvs = {
+		.cfg = &kvs_cfg,
+		.data = &kvs_data,
+	};
+	const uint32_t lcnt = cfg->keys * run->rounds > run->iter ?
+			      cfg->keys * run->rounds : run->iter;
+	int rc = -KVS_ENOSPC;
+
+	ram.mem = malloc(cfg->size);
+	run->lat = malloc(lcnt * sizeof(uint64_t));
+	run->value = malloc(2U * cfg->vsz + 1U);
+	if ((pbuf == NULL) || (ram.mem == NULL) || (run->lat == NULL) ||
+	    (run->value == NULL)) {
+		goto end;
+	}
+
+	rc = kvs_erase(&kvs);
+	if (rc != 0) {
+		goto end;
+	}
+
+	rc = kvs_mount(&kvs);
+	if (rc != 0) {
+		goto end;
+	}
+
+	rc = bench_ops(run, cfg, &kvs);
+	(void)kvs_unmount(&kvs);
+end:
+	if (rc != 0) {
+		printf("%-5s %7u %5u %4u %5u %5u failed [%d]\n",
+		       bench_be_names[run->be], cfg->size, cfg->bsz,
+		       cfg->psz, cfg->keys, cfg->vsz, rc);
+	}
+
+	free(run->value);
+	free(run->lat);
+	free(ram.mem);
+	free(pbuf);
+	return rc;
+}
+
+static const struct bench_cfg bench_base = {
+	.size = 65536U,
+	.bsz = 4096U,
+	.psz = 8U,
+	.keys = 128U,
+	.vsz = 32U,
+};
+
+static const struct bench_sweep {
+	const char *name;
+	size_t field;
+	uint32_t values[6];
+} bench_sweeps[] = {
+	{"size", offsetof(struct bench_cfg, size),
+	 {16384U, 32768U, 65536U, 131072U, 262144U}},
+	{"bsz", offsetof(struct bench_cfg, bsz),
+	 {512U, 1024U, 2048U, 4096U, 8192U}},
+	{"psz", offsetof(struct bench_cfg, psz), {1U, 4U, 8U, 16U, 32U, 64U}},
+	{"keys", offsetof(struct bench_cfg, keys),
+	 {16U, 64U, 128U, 256U, 512U}},
+	{"vsz", offsetof(struct bench_cfg, vsz), {4U, 16U, 64U, 128U, 256U}},
+};
+
+int main(int argc, char *argv[])
+{
+	struct bench_run run = {
+		.be = BENCH_RAM,
+		.rounds = 4U,
+		.iter = 16U,
+	};
+	const char *sweep = NULL;
+	bool quick = false;
+	int opt, rc = 0;
+
+	while ((opt = getopt(argc, argv, "qf:m:u:s:")) != -1) {
+		switch (opt) {
+		case 'q':
+			quick = true;
+			break;
+		case 'f':
+			run.be = BENCH_FILE;
+			run.file = optarg;
+			break;
+		case 'm':
+			run.be = BENCH_MMAP;
+			run.file = optarg;
+			break;
+#ifdef KVS_BACKEND_URING
+		case 'u':
+			run.be = BENCH_URING;
+			run.file = optarg;
+			break;
+#endif
+		case 's':
+			sweep = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-q] [-f file | -m file | "
+				"-u file] [-s size|bsz|psz|keys|vsz]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("%-5s %7s %5s %4s %5s %5s %-12s %11s %9s %9s\n", "be", "size",
+	       "bsz", "psz", "keys", "vsz", "op", "ops/s", "p50[us]",
+	       "p99[us]");
+	if (quick) {
+		const struct bench_cfg cfg = {
+			.size = 8192U,
+			.bsz = 1024U,
+			.psz = 8U,
+			.keys = 32U,
+			.vsz = 16U,
+		};
+
+		run.rounds = 2U;
+		run.iter = 4U;
+		rc = bench_config(&run, &cfg);
+		return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	for (size_t i = 0U; i < sizeof(bench_sweeps) / sizeof(bench_sweeps[0]);
+	     i++) {
+		const struct bench_sweep *sw = &bench_sweeps[i];
+
+		if ((sweep != NULL) && (strcmp(sweep, sw->name) != 0)) {
+			continue;
+		}
+
+		printf("# sweep %s\n", sw->name);
+		for (size_t j = 0U; j < sizeof(sw->values) / sizeof(uint32_t);
+		     j++) {
+			struct bench_cfg cfg = bench_base;
+
+			if (sw->values[j] == 0U) {
+				break;
+			}
+
+			*(uint32_t *)((uint8_t *)&cfg + sw->field) =
+				sw->values[j];
+			/* configurations that do not fit are reported */
+			if ((bench_config(&run, &cfg) != 0) && (rc == 0)) {
+				rc = -KVS_EINVAL;
+			}
+
+		}
+
+	}
+
+	return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2023 Laczen
+ *
+ * KVS defaults benchmark: compares keeping default settings in the kvs
+ * (written at first boot) with the generated defaults table (see
+ * kvs_generate_defaults() in lib/CMakeLists.txt). Reports the first boot
+ * write time and programmed bytes, read ops/s and p50/p99 read latency with
+ * and without overridden values and mount time. All values are verified.
+ *
+ * usage: kvs_defaults_bench [-q]
+ *	-q: quick run (fails on any error)
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "kvs/kvs.h"
+#include "kvs/kvs_backend_ram.h"
+
+#define DBENCH_KEYFMT "set/%u"
+#define DBENCH_OVERRIDE 8U	/* every 8th key gets a value in the kvs */
+#define DBENCH_SIZE 65536U
+#define DBENCH_BSZ 4096U
+
+/* generated from kvs_defaults_bench.txt (key set/<i>, value u32:<i>) */
+extern const struct kvs_defaults dbench_defaults;
+
+static const char dbench_cookie[] = "kvs_defaults_bench";
+
+DEFINE_KVS_RAM(dbench_kvs, DBENCH_SIZE, DBENCH_BSZ, DBENCH_BSZ, 1U, 8U,
+	       (void *)dbench_cookie, sizeof(dbench_cookie) - 1);
+
+static uint64_t dbench_now(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+static int dbench_cmp(const void *a, const void *b)
+{
+	const uint64_t la = *(const uint64_t *)a;
+	const uint64_t lb = *(const uint64_t *)b;
+
+	return (la > lb) - (la < lb);
+}
+
+/* value of key i: the override or the default */
+static uint32_t dbench_value(uint32_t i, bool override)
+{
+	return (override && ((i % DBENCH_OVERRIDE) == 0U)) ? ~i : i;
+}
+
+/* read all keys iter times, returns 0 or the first error */
+static int dbench_read(struct kvs *kvs, uint32_t iter, bool override,
+		       uint64_t *lat, double *ops)
+{
+	const uint32_t cnt = dbench_defaults.cnt;
+	uint64_t total = 0U;
+	char key[16];
+	uint32_t rd;
+	int rc;
+
+	for (uint32_t n = 0U; n < iter; n++) {
+		for (uint32_t i = 0U; i < cnt; i++) {
+			uint64_t start;
+
+			(void)snprintf(key, sizeof(key), DBENCH_KEYFMT, i);
+			start = dbench_now();
+			rc = kvs_read(kvs, key, &rd, sizeof(rd));
+			lat[n * cnt + i] = dbench_now() - start;
+			total += lat[n * cnt + i];
+			if (rc != 0) {
+				return rc;
+			}
+
+			if (rd != dbench_value(i, override)) {
+				return -KVS_EIO;
+			}
+		}
+	}
+
+	qsort(lat, iter * cnt, sizeof(uint64_t), dbench_cmp);
+	*ops = (total != 0U) ? (double)(iter * cnt) * 1e9 / (double)total : 0.0;
+	return 0;
+}
+
+/* write every DBENCH_OVERRIDE'th key (override) or all keys (defaults) */
+static int dbench_write(struct kvs *kvs, bool override)
+{
+	char key[16];
+	uint32_t val;
+	int rc;
+
+	for (uint32_t i = 0U; i < dbench_defaults.cnt; i++) {
+		if (override && ((i % DBENCH_OVERRIDE) != 0U)) {
+			continue;
+		}
+
+		(void)snprintf(key, sizeof(key), DBENCH_KEYFMT, i);
+		val = dbench_value(i, override);
+		rc = kvs_write(kvs, key, &val, sizeof(val));
+		if (rc != 0) {
+			return rc;
+		}
+	}
+
+	return 0;
+}
+
+static int dbench_run(bool table, bool override, uint32_t iter)
+{
+	struct kvs *kvs = GET_KVS(dbench_kvs);
+	const uint32_t n = iter * dbench_defaults.cnt;
+	uint64_t *lat = malloc(n * sizeof(uint64_t));
+	struct kvs_stats stats = {0};
+	uint64_t start, wtime = 0U, mtime = 0U;
+	double ops = 0.0;
+	int rc = -KVS_ENOSPC;
+
+	if (lat == NULL) {
+		goto end;
+	}
+
+	kvs->data->defaults = table ? &dbench_defaults : NULL;
+	rc = kvs_erase(kvs);
+	if (rc == 0) {
+		rc = kvs_mount(kvs);
+	}
+
+	if (rc != 0) {
+		goto end;
+	}
+
+	/* first boot: the defaults are written when there is no table */
+	kvs->data->stats = &stats;
+	start = dbench_now();
+	if (!table) {
+		rc = dbench_write(kvs, false);
+	}
+
+	wtime = dbench_now() - start;
+	kvs->data->stats = NULL;
+	if ((rc == 0) && override) {
+		rc = dbench_write(kvs, true);
+	}
+
+	if (rc == 0) {
+		rc = dbench_read(kvs, iter, override, lat, &ops);
+	}
+
+	(void)kvs_unmount(kvs);
+	if (rc == 0) {
+		start = dbench_now();
+		rc = kvs_mount(kvs);
+		mtime = dbench_now() - start;
+	}
+
+	/* deleting the overrides restores the defaults */
+	if ((rc == 0) && table && override) {
+		char key[16];
+
+		for (uint32_t i = 0U; (rc == 0) && (i < dbench_defaults.cnt);
+		     i += DBENCH_OVERRIDE) {
+			(void)snprintf(key, sizeof(key), DBENCH_KEYFMT, i);
+			rc = kvs_delete(kvs, key);
+		}
+
+		if (rc == 0) {
+			rc = dbench_read(kvs, 1U, false, lat, &ops);
+		}
+	}
+
+	(void)kvs_unmount(kvs);
+end:
+	if (rc != 0) {
+		printf("%-8s %-8s %5u failed [%d]\n", table ? "table" : "kvs",
+		       override ? "yes" : "no", dbench_defaults.cnt, rc);
+	} else {
+		printf("%-8s %-8s %5u %11.2f %11u %11.0f %9.2f %9.2f %9.2f\n",
+		       table ? "table" : "kvs", override ? "yes" : "no",
+		       dbench_defaults.cnt, (double)wtime / 1e3,
+		       stats.prog_bytes, ops, (double)lat[(n - 1U) / 2U] / 1e3,
+		       (double)lat[((n - 1U) * 99U) / 100U] / 1e3,
+		       (double)mtime / 1e3);
+	}
+
+	kvs->data->defaults = NULL;
+	free(lat);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t iter = 64U;
+	int opt, rc = 0;
+
+	while ((opt = getopt(argc, argv, "q")) != -1) {
+		switch (opt) {
+		case 'q':
+			iter = 2U;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-q]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("%-8s %-8s %5s %11s %11s %11s %9s %9s %9s\n", "defaults",
+	       "override", "keys", "boot[us]", "boot_prog", "read/s",
+	       "p50[us]", "p99[us]", "mount[us]");
+	for (uint32_t i = 0U; i < 4U; i++) {
+		if (dbench_run((i & 1U) != 0U, (i & 2U) != 0U, iter) != 0) {
+			rc = EXIT_FAILURE;
+		}
+	}
+
+	return rc;
+}
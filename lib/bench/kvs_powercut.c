@@ -0,0 +1,442 @@
+/*
+ * Copyright (c) 2023 Laczen
+ *
+ * KVS power cut simulator: a workload is run on a RAM backend that stops
+ * programming (power cut) after a given number of bytes. For every cut point
+ * the kvs is mounted again, the mount time and the reads done by the mount are
+ * recorded and the content of the kvs is verified. A worst case recovery
+ * report is printed per configuration. The in place configurations model
+ * EEPROM: no erase, psz 1 and a sync that writes the end marker.
+ *
+ * usage: kvs_powercut [-q] [-s step]
+ *	-q: quick run of a small configuration (and a small in place one)
+ *	-s: bytes between cut points (default: 1, every byte offset)
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "kvs/kvs.h"
+#include "kvs/kvs_backend_ram.h"
+
+#define PC_BSPR 1U
+#define PC_KEYFMT "k%03u"
+#define PC_NONE UINT32_MAX
+
+struct pc_cfg {
+	uint32_t bsz;		/* block size */
+	uint32_t bcnt;		/* block count */
+	uint32_t psz;		/* prog buffer size */
+	uint32_t keys;		/* number of keys */
+	uint32_t vsz;		/* maximum value size */
+	bool inplace;		/* in place updates (values keep their length) */
+};
+
+/* RAM backend that cuts the power after budget bytes */
+struct pc_be {
+	struct kvs_be_ram ram;
+	uint32_t budget;	/* bytes that can still be programmed */
+	bool cut;		/* power has been cut */
+};
+
+/* workload state that is known to the application */
+struct pc_state {
+	uint32_t *acked;	/* last completed round per key */
+	uint32_t key;		/* key being written (PC_NONE: none) */
+	uint32_t round;		/* round being written */
+};
+
+static int pc_read(const void *ctx, uint32_t off, void *data, size_t len)
+{
+	const struct pc_be *be = (const struct pc_be *)ctx;
+
+	return kvs_be_ram_read(&be->ram, off, data, len);
+}
+
+static int pc_prog(const void *ctx, uint32_t off, const void *data, size_t len)
+{
+	struct pc_be *be = (struct pc_be *)ctx;
+	int rc;
+
+	if (be->cut) {
+		return -KVS_EIO;
+	}
+
+	if (len <= be->budget) {
+		be->budget -= len;
+		return kvs_be_ram_prog(&be->ram, off, data, len);
+	}
+
+	/* partial prog, the remaining bytes keep their old content */
+	rc = kvs_be_ram_prog(&be->ram, off, data, be->budget);
+	be->budget = 0U;
+	be->cut = true;
+	return rc == 0 ? -KVS_EIO : rc;
+}
+
+static int pc_comp(const void *ctx, uint32_t off, const void *data, size_t len)
+{
+	const struct pc_be *be = (const struct pc_be *)ctx;
+
+	return kvs_be_ram_comp(&be->ram, off, data, len);
+}
+
+/* mark the end of the entries like the EEPROM backend (a empty header with a
+ * bad crc), the marker can be cut as well.
+ */
+static int pc_sync(const void *ctx, uint32_t off)
+{
+	const struct pc_be *be = (const struct pc_be *)ctx;
+	const char end[4] = "\0\0\0\xff";
+
+	if ((off + sizeof(end)) > be->ram.size) {
+		return 0;
+	}
+
+	return pc_prog(ctx, off, end, sizeof(end));
+}
+
+static uint32_t pc_vlen(const struct pc_cfg *cfg, uint32_t key, uint32_t round)
+{
+	/* every second rewrite keeps the length and is updated in place */
+	if (cfg->inplace) {
+		round /= 2U;
+	}
+
+	return 1U + ((key * 7U + round * 3U) % cfg->vsz);
+}
+
+static void pc_value(uint8_t *value, uint32_t len, uint32_t key,
+		     uint32_t round)
+{
+	for (uint32_t i = 0U; i < len; i++) {
+		value[i] = (uint8_t)(key * 31U + round * 17U + i);
+	}
+}
+
+/* write all keys for a number of rounds, stops at the first error. The first
+ * half of the keys is only written in the first round, these entries are
+ * copied by garbage collection.
+ */
+static int pc_workload(const struct pc_cfg *cfg, struct kvs *kvs,
+		       struct pc_state *st, uint8_t *value, uint32_t rounds)
+{
+	char key[16];
+	int rc;
+
+	for (uint32_t r = 0U; r < rounds; r++) {
+		for (uint32_t k = r == 0U ? 0U : cfg->keys / 2U; k < cfg->keys;
+		     k++) {
+			const uint32_t vlen = pc_vlen(cfg, k, r);
+
+			(void)snprintf(key, sizeof(key), PC_KEYFMT, k);
+			pc_value(value, vlen, k, r);
+			st->key = k;
+			st->round = r;
+			rc = kvs_write(kvs, key, value, vlen);
+			if (rc != 0) {
+				return rc;
+			}
+
+			st->acked[k] = r;
+			st->key = PC_NONE;
+		}
+
+	}
+
+	return 0;
+}
+
+static bool pc_match(const struct pc_cfg *cfg, const uint8_t *rdvalue,
+		     size_t rdlen, uint8_t *value, uint32_t key,
+		     uint32_t round)
+{
+	const uint32_t vlen = pc_vlen(cfg, key, round);
+
+	pc_value(value, vlen, key, round);
+	return (rdlen == vlen) && (memcmp(rdvalue, value, vlen) == 0);
+}
+
+/* every key has its last completed value or the value that was written */
+static int pc_verify(const struct pc_cfg *cfg, struct kvs *kvs,
+		     const struct pc_state *st, uint8_t *value)
+{
+	uint8_t *rdvalue = value + cfg->vsz;
+	struct kvs_ent ent;
+	char key[16];
+	int rc;
+
+	for (uint32_t k = 0U; k < cfg->keys; k++) {
+		bool ok = false;
+		size_t rdlen;
+
+		(void)snprintf(key, sizeof(key), PC_KEYFMT, k);
+		rc = kvs_entry_get(&ent, kvs, key);
+		if (rc == -KVS_ENOENT) {
+			if ((st->acked[k] == PC_NONE) &&
+			    ((st->key != k) || (st->round == 0U))) {
+				continue;
+			}
+
+			return -KVS_ENOENT;
+		}
+
+		if (rc != 0) {
+			return rc;
+		}
+
+		rdlen = entry_get_vlen((&ent));
+		if (rdlen > cfg->vsz) {
+			return -KVS_EIO;
+		}
+
+		rc = kvs_entry_read(&ent, entry_get_klen((&ent)), rdvalue,
+				    rdlen);
+		if (rc != 0) {
+			return rc;
+		}
+
+		if (st->acked[k] != PC_NONE) {
+			ok = pc_match(cfg, rdvalue, rdlen, value, k,
+				      st->acked[k]);
+		}
+
+		if ((!ok) && (st->key == k)) {
+			ok = pc_match(cfg, rdvalue, rdlen, value, k, st->round);
+		}
+
+		if (!ok) {
+			return -KVS_EIO;
+		}
+
+	}
+
+	return 0;
+}
+
+static uint64_t pc_now(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+static int pc_cmp(const void *a, const void *b)
+{
+	const uint64_t la = *(const uint64_t *)a;
+	const uint64_t lb = *(const uint64_t *)b;
+
+	return (la > lb) - (la < lb);
+}
+
+static int pc_config(const struct pc_cfg *cfg, uint32_t step)
+{
+	const uint32_t size = cfg->bsz * cfg->bcnt;
+	/* enough rounds to wrap around the memory a few times */
+	const uint32_t rounds = 1U + (4U * size) /
+				(cfg->keys * (cfg->vsz / 2U + 16U));
+	struct pc_be be = {
+		.ram = {
+			.size = size,
+			.esize = cfg->inplace ? 0U : cfg->bsz,
+		},
+		.budget = UINT32_MAX,
+	};
+	uint8_t *pbuf = malloc(cfg->psz);
+	const struct kvs_cfg kvs_cfg = {
+		.ctx = (void *)&be,
+		.bsz = cfg->bsz,
+		.bcnt = cfg->bcnt,
+		.bspr = PC_BSPR,
+		.pbuf = pbuf,
+		.psz = cfg->psz,
+		.read = pc_read,
+		.prog = pc_prog,
+		.comp = pc_comp,
+		.sync = cfg->inplace ? pc_sync : NULL,
+	};
+	struct kvs_stats stats;
+	struct kvs_data kvs_data = {
+		.stats = &stats,
+		.inplace = cfg->inplace,
+	};
+	struct kvs kvs = {
+		.cfg = &kvs_cfg,
+		.data = &kvs_data,
+	};
+	struct pc_state st = {
+		.acked = malloc(cfg->keys * sizeof(uint32_t)),
+	};
+	uint8_t *value = malloc(2U * cfg->vsz);
+	uint64_t *lat = NULL;
+	uint32_t total, cuts = 0U, recovered = 0U, failed = 0U;
+	uint32_t max_reads = 0U, max_rd_bytes = 0U, worst = 0U;
+	uint64_t start;
+	int rc = -KVS_ENOSPC;
+
+	be.ram.mem = malloc(size);
+	if ((pbuf == NULL) || (be.ram.mem == NULL) || (st.acked == NULL) ||
+	    (value == NULL)) {
+		goto end;
+	}
+
+	/* dry run to determine the bytes programmed by the workload */
+	rc = kvs_erase(&kvs);
+	if (rc == 0) {
+		rc = kvs_mount(&kvs);
+	}
+
+	if (rc == 0) {
+		memset(st.acked, 0xff, cfg->keys * sizeof(uint32_t));
+		be.budget = UINT32_MAX;
+		rc = pc_workload(cfg, &kvs, &st, value, rounds);
+		total = UINT32_MAX - be.budget;
+	}
+
+	(void)kvs_unmount(&kvs);
+	if (rc != 0) {
+		goto end;
+	}
+
+	lat = malloc((total / step + 1U) * sizeof(uint64_t));
+	if (lat == NULL) {
+		rc = -KVS_ENOSPC;
+		goto end;
+	}
+
+	for (uint32_t cut = 0U; cut < total; cut += step) {
+		be.budget = UINT32_MAX;
+		be.cut = false;
+		rc = kvs_erase(&kvs);
+		if (rc == 0) {
+			rc = kvs_mount(&kvs);
+		}
+
+		if (rc != 0) {
+			goto end;
+		}
+
+		memset(st.acked, 0xff, cfg->keys * sizeof(uint32_t));
+		st.key = PC_NONE;
+		be.budget = cut;
+		(void)pc_workload(cfg, &kvs, &st, value, rounds);
+
+		/* power up: the memory is left as it was at the cut */
+		(void)kvs_unmount(&kvs);
+		be.budget = UINT32_MAX;
+		be.cut = false;
+		memset(&stats, 0, sizeof(stats));
+		start = pc_now();
+		rc = kvs_mount(&kvs);
+		lat[cuts] = pc_now() - start;
+		if ((rc != 0) || (pc_verify(cfg, &kvs, &st, value) != 0)) {
+			failed++;
+			printf("cut at %u: mount [%d] or verify failed\n", cut,
+			       rc);
+		}
+
+		(void)kvs_unmount(&kvs);
+		if (stats.recoveries != 0U) {
+			recovered++;
+		}
+
+		if (lat[cuts] > lat[worst]) {
+			worst = cuts;
+		}
+
+		if (stats.reads > max_reads) {
+			max_reads = stats.reads;
+		}
+
+		if (stats.rd_bytes > max_rd_bytes) {
+			max_rd_bytes = stats.rd_bytes;
+		}
+
+		cuts++;
+	}
+
+	worst *= step;
+	qsort(lat, cuts, sizeof(uint64_t), pc_cmp);
+	printf("%5u %4u %4u %4u %4u %4u %7u %5u %5u %9.2f %9.2f %9.2f %8u "
+	       "%7u %10u\n", cfg->bsz, cfg->bcnt, cfg->psz, cfg->keys,
+	       cfg->vsz, cfg->inplace ? 1U : 0U, cuts, recovered, failed, (double)lat[(cuts - 1U) / 2U] / 1e3,
+	       (double)lat[((cuts - 1U) * 99U) / 100U] / 1e3,
+	       (double)lat[cuts - 1U] / 1e3, worst, max_reads, max_rd_bytes);
+	rc = failed == 0U ? 0 : -KVS_EIO;
+end:
+	if ((rc != 0) && (failed == 0U)) {
+		printf("%5u %4u %4u %4u %4u %4u failed [%d]\n", cfg->bsz,
+		       cfg->bcnt, cfg->psz, cfg->keys, cfg->vsz,
+		       cfg->inplace ? 1U : 0U, rc);
+	}
+
+	free(lat);
+	free(value);
+	free(st.acked);
+	free(be.ram.mem);
+	free(pbuf);
+	return rc;
+}
+
+static const struct pc_cfg pc_cfgs[] = {
+	{.bsz = 256U, .bcnt = 4U, .psz = 8U, .keys = 8U, .vsz = 16U},
+	{.bsz = 512U, .bcnt = 4U, .psz = 8U, .keys = 16U, .vsz = 32U},
+	{.bsz = 512U, .bcnt = 8U, .psz = 32U, .keys = 16U, .vsz = 32U},
+	{.bsz = 1024U, .bcnt = 4U, .psz = 8U, .keys = 32U, .vsz = 64U},
+	{.bsz = 4096U, .bcnt = 4U, .psz = 16U, .keys = 64U, .vsz = 64U},
+	{.bsz = 256U, .bcnt = 4U, .psz = 1U, .keys = 8U, .vsz = 16U,
+	 .inplace = true},
+	{.bsz = 512U, .bcnt = 8U, .psz = 1U, .keys = 16U, .vsz = 32U,
+	 .inplace = true},
+};
+
+int main(int argc, char *argv[])
+{
+	const size_t cnt = sizeof(pc_cfgs) / sizeof(pc_cfgs[0]);
+	uint32_t step = 1U;
+	bool quick = false;
+	int opt, rc = 0;
+
+	while ((opt = getopt(argc, argv, "qs:")) != -1) {
+		switch (opt) {
+		case 'q':
+			quick = true;
+			break;
+		case 's':
+			step = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		default:
+			step = 0U;
+			break;
+		}
+	}
+
+	if (step == 0U) {
+		fprintf(stderr, "usage: %s [-q] [-s step]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%5s %4s %4s %4s %4s %4s %7s %5s %5s %9s %9s %9s %8s %7s %10s\n",
+	       "bsz", "bcnt", "psz", "keys", "vsz", "inpl", "cuts", "recov",
+	       "fail", "p50[us]", "p99[us]", "max[us]", "worst@", "reads",
+	       "rd_bytes");
+	for (size_t i = 0U; i < cnt; i++) {
+		/* a quick run does the first config of each kind */
+		if (quick && (i != 0U) &&
+		    (pc_cfgs[i].inplace == pc_cfgs[i - 1U].inplace)) {
+			continue;
+		}
+
+		if ((pc_config(&pc_cfgs[i], step) != 0) && (rc == 0)) {
+			rc = -KVS_EIO;
+		}
+
+	}
+
+	return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
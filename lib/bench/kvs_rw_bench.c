@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2023 Laczen
+ *
+ * KVS reader/writer benchmark: one writer thread keeps rewriting all keys
+ * (causing garbage collection) while reader threads read random keys and
+ * walk the kvs. Every value read is verified and every walk_unique must
+ * report each key once. Compares wrapping all calls in a mutex with the
+ * kvs read protocol (lock free lookups, walks under a shared lock).
+ *
+ * usage: kvs_rw_bench [-q] [-d ms]
+ *	-q: quick run (fails on any error)
+ *	-d: duration of each run in ms (default 1000)
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "kvs/kvs.h"
+#include "kvs/kvs_backend_ram.h"
+
+#define RWBENCH_MAXREADERS 8U
+#define RWBENCH_KEYFMT "k%04u"
+#define RWBENCH_KEYS 64U
+#define RWBENCH_VSZ 24U
+#define RWBENCH_WALKEVERY 64U
+
+enum rwbench_modes {
+	RWBENCH_MUTEX,		/* every call wrapped in a mutex */
+	RWBENCH_SEQ,		/* kvs read protocol */
+};
+
+static const char *const rwbench_mode_names[] = {"mutex", "seq"};
+
+struct rwbench_be {
+	struct kvs_be_ram ram;	/* first member: passed to the RAM routines */
+	pthread_rwlock_t rwl;
+};
+
+struct rwbench {
+	enum rwbench_modes mode;
+	struct kvs *kvs;
+	pthread_mutex_t mtx;	/* RWBENCH_MUTEX */
+	volatile bool stop;
+	uint64_t writes;
+	int wrc;
+};
+
+struct rwbench_reader {
+	pthread_t tid;
+	struct rwbench *rwb;
+	uint32_t seed;
+	uint64_t reads;
+	uint64_t walks;
+	uint32_t bad;
+	int rc;
+};
+
+static const char rwbench_cookie[] = "kvs_rw_bench";
+
+static uint64_t rwbench_now(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+static int rwbench_wrlock(const void *ctx)
+{
+	struct rwbench_be *be = (struct rwbench_be *)ctx;
+
+	return pthread_rwlock_wrlock(&be->rwl) == 0 ? 0 : -KVS_EDEADLK;
+}
+
+static int rwbench_rdlock(const void *ctx)
+{
+	struct rwbench_be *be = (struct rwbench_be *)ctx;
+
+	return pthread_rwlock_rdlock(&be->rwl) == 0 ? 0 : -KVS_EDEADLK;
+}
+
+static int rwbench_unlock(const void *ctx)
+{
+	struct rwbench_be *be = (struct rwbench_be *)ctx;
+
+	return pthread_rwlock_unlock(&be->rwl) == 0 ? 0 : -KVS_EDEADLK;
+}
+
+/* value: round (le32) followed by bytes derived from key and round */
+static void rwbench_value(uint8_t *value, uint32_t key, uint32_t round)
+{
+	value[0] = (uint8_t)round;
+	value[1] = (uint8_t)(round >> 8);
+	value[2] = (uint8_t)(round >> 16);
+	value[3] = (uint8_t)(round >> 24);
+	for (uint32_t i = 4U; i < RWBENCH_VSZ; i++) {
+		value[i] = (uint8_t)(key * 31U + round + i);
+	}
+}
+
+static bool rwbench_value_ok(const uint8_t *value, uint32_t key)
+{
+	const uint32_t round = (uint32_t)value[0] |
+			       ((uint32_t)value[1] << 8) |
+			       ((uint32_t)value[2] << 16) |
+			       ((uint32_t)value[3] << 24);
+	uint8_t exp[RWBENCH_VSZ];
+
+	rwbench_value(exp, key, round);
+	return memcmp(exp, value, RWBENCH_VSZ) == 0;
+}
+
+static void rwbench_enter(struct rwbench *rwb)
+{
+	if (rwb->mode == RWBENCH_MUTEX) {
+		(void)pthread_mutex_lock(&rwb->mtx);
+	}
+}
+
+static void rwbench_exit(struct rwbench *rwb)
+{
+	if (rwb->mode == RWBENCH_MUTEX) {
+		(void)pthread_mutex_unlock(&rwb->mtx);
+	}
+}
+
+static void *rwbench_writer(void *arg)
+{
+	struct rwbench *rwb = (struct rwbench *)arg;
+	uint8_t value[RWBENCH_VSZ];
+	char key[8];
+
+	for (uint32_t round = 1U; !rwb->stop; round++) {
+		for (uint32_t k = 0U; (k < RWBENCH_KEYS) && !rwb->stop; k++) {
+			(void)snprintf(key, sizeof(key), RWBENCH_KEYFMT, k);
+			rwbench_value(value, k, round);
+			rwbench_enter(rwb);
+			rwb->wrc = kvs_write(rwb->kvs, key, value,
+					     sizeof(value));
+			rwbench_exit(rwb);
+			if (rwb->wrc != 0) {
+				return NULL;
+			}
+
+			rwb->writes++;
+		}
+	}
+
+	return NULL;
+}
+
+static int rwbench_walk_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	uint32_t *cnt = (uint32_t *)cb_arg;
+	uint8_t value[RWBENCH_VSZ];
+	char key[8] = {0};
+	int rc;
+
+	rc = kvs_entry_read(ent, 0U, key, 5U);
+	if (rc == 0) {
+		rc = kvs_entry_read(ent, 5U, value, sizeof(value));
+	}
+
+	if ((rc != 0) ||
+	    (!rwbench_value_ok(value, (uint32_t)atoi(&key[1])))) {
+		return -KVS_EIO;
+	}
+
+	(*cnt)++;
+	return 0;
+}
+
+static void *rwbench_reader(void *arg)
+{
+	struct rwbench_reader *rd = (struct rwbench_reader *)arg;
+	struct rwbench *rwb = rd->rwb;
+	uint8_t value[RWBENCH_VSZ];
+	char key[8];
+
+	while (!rwb->stop) {
+		const uint32_t k = (uint32_t)rand_r(&rd->seed) %
+				   RWBENCH_KEYS;
+
+		(void)snprintf(key, sizeof(key), RWBENCH_KEYFMT, k);
+		rwbench_enter(rwb);
+		rd->rc = kvs_read(rwb->kvs, key, value, sizeof(value));
+		rwbench_exit(rwb);
+		if (rd->rc != 0) {
+			return NULL;
+		}
+
+		if (!rwbench_value_ok(value, k)) {
+			rd->bad++;
+		}
+
+		rd->reads++;
+		if ((rd->reads % RWBENCH_WALKEVERY) == 0U) {
+			uint32_t cnt = 0U;
+
+			rwbench_enter(rwb);
+			rd->rc = kvs_walk_unique(rwb->kvs, "k",
+						 rwbench_walk_cb, &cnt);
+			rwbench_exit(rwb);
+			if (rd->rc != 0) {
+				return NULL;
+			}
+
+			if (cnt != RWBENCH_KEYS) {
+				rd->bad++;
+			}
+
+			rd->walks++;
+		}
+	}
+
+	return NULL;
+}
+
+static int rwbench_run(enum rwbench_modes mode, uint32_t readers,
+		       uint32_t duration)
+{
+	struct rwbench_be be = {
+		.ram = {
+			.size = 32768U,
+			.esize = 1024U,
+		},
+	};
+	const struct kvs_cfg cfg = {
+		.ctx = (void *)&be,
+		.bsz = 1024U,
+		.bcnt = 32U,
+		.bspr = 1U,
+		.pbuf = malloc(8U),
+		.psz = 8U,
+		.read = kvs_be_ram_read,
+		.prog = kvs_be_ram_prog,
+		.comp = kvs_be_ram_comp,
+		.lock = rwbench_wrlock,
+		.unlock = rwbench_unlock,
+		.rdlock = mode == RWBENCH_SEQ ? rwbench_rdlock : NULL,
+		.rdunlock = mode == RWBENCH_SEQ ? rwbench_unlock : NULL,
+	};
+	struct kvs_stats stats;
+	struct kvs_data data = {
+		.cookie = (void *)rwbench_cookie,
+		.csz = sizeof(rwbench_cookie) - 1,
+		.stats = &stats,
+	};
+	struct kvs kvs = {
+		.cfg = &cfg,
+		.data = &data,
+	};
+	struct rwbench rwb = {
+		.mode = mode,
+		.kvs = &kvs,
+	};
+	struct rwbench_reader rd[RWBENCH_MAXREADERS];
+	uint8_t value[RWBENCH_VSZ];
+	uint64_t reads = 0U, walks = 0U, start, elapsed = 1U;
+	uint32_t bad = 0U;
+	pthread_rwlockattr_t attr;
+	pthread_t wtid;
+	char key[8];
+	int rc = -KVS_ENOSPC;
+
+	memset(&stats, 0, sizeof(stats));
+	(void)pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+	/* walks are long, do not let them starve the writer */
+	(void)pthread_rwlockattr_setkind_np(&attr,
+		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+	(void)pthread_rwlock_init(&be.rwl, &attr);
+	(void)pthread_mutex_init(&rwb.mtx, NULL);
+	be.ram.mem = malloc(be.ram.size);
+	if ((be.ram.mem == NULL) || (cfg.pbuf == NULL)) {
+		goto end;
+	}
+
+	rc = kvs_erase(&kvs);
+	if (rc == 0) {
+		rc = kvs_mount(&kvs);
+	}
+
+	for (uint32_t k = 0U; (rc == 0) && (k < RWBENCH_KEYS); k++) {
+		(void)snprintf(key, sizeof(key), RWBENCH_KEYFMT, k);
+		rwbench_value(value, k, 0U);
+		rc = kvs_write(&kvs, key, value, sizeof(value));
+	}
+
+	if (rc != 0) {
+		goto end;
+	}
+
+	start = rwbench_now();
+	(void)pthread_create(&wtid, NULL, rwbench_writer, &rwb);
+	for (uint32_t i = 0U; i < readers; i++) {
+		memset(&rd[i], 0, sizeof(rd[i]));
+		rd[i].rwb = &rwb;
+		rd[i].seed = i + 1U;
+		(void)pthread_create(&rd[i].tid, NULL, rwbench_reader,
+				     &rd[i]);
+	}
+
+	(void)usleep(duration * 1000U);
+	rwb.stop = true;
+	(void)pthread_join(wtid, NULL);
+	rc = rwb.wrc;
+	for (uint32_t i = 0U; i < readers; i++) {
+		(void)pthread_join(rd[i].tid, NULL);
+		reads += rd[i].reads;
+		walks += rd[i].walks;
+		bad += rd[i].bad;
+		if (rc == 0) {
+			rc = rd[i].rc;
+		}
+	}
+
+	elapsed = rwbench_now() - start;
+	if ((rc == 0) && (bad != 0U)) {
+		rc = -KVS_EIO;
+	}
+
+	(void)kvs_unmount(&kvs);
+end:
+	printf("%-5s %7u %11.0f %11.0f %9.0f %7u %4u %s\n",
+	       rwbench_mode_names[mode], readers,
+	       (double)rwb.writes * 1e9 / (double)elapsed,
+	       (double)reads * 1e9 / (double)elapsed,
+	       (double)walks * 1e9 / (double)elapsed, stats.retries, bad,
+	       rc == 0 ? "ok" : "failed");
+	(void)pthread_mutex_destroy(&rwb.mtx);
+	(void)pthread_rwlock_destroy(&be.rwl);
+	(void)pthread_rwlockattr_destroy(&attr);
+	free(be.ram.mem);
+	free((void *)cfg.pbuf);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t duration = 1000U, maxreaders = RWBENCH_MAXREADERS;
+	int opt, rc = 0;
+
+	while ((opt = getopt(argc, argv, "qd:")) != -1) {
+		switch (opt) {
+		case 'q':
+			duration = 200U;
+			maxreaders = 2U;
+			break;
+		case 'd':
+			duration = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-q] [-d ms]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("%-5s %7s %11s %11s %9s %7s %4s\n", "mode", "readers",
+	       "write/s", "read/s", "walk/s", "retries", "bad");
+	for (uint32_t readers = 1U; readers <= maxreaders; readers *= 2U) {
+		for (int mode = RWBENCH_MUTEX; mode <= RWBENCH_SEQ; mode++) {
+			if (rwbench_run((enum rwbench_modes)mode, readers,
+					duration) != 0) {
+				rc = EXIT_FAILURE;
+			}
+		}
+	}
+
+	return rc;
+}
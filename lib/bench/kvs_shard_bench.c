@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2023 Laczen
+ *
+ * KVS shard benchmark: a partition is split in 1, 2, 4 or 8 shards (RAM
+ * backends, each with its own mutex) and written by several threads. Reports
+ * write ops/s and p50/p99 write latency (the p99 includes the garbage
+ * collection of a shard), walk_unique and mount time. All values are verified
+ * after the writes.
+ *
+ * usage: kvs_shard_bench [-q] [-t threads]
+ *	-q: quick run of a small configuration (fails on any error)
+ *	-t: number of writer threads (default 4)
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "kvs/kvs.h"
+#include "kvs/kvs_backend_ram.h"
+#include "kvs/kvs_shard.h"
+
+#define SBENCH_MAXSHARDS 8U
+#define SBENCH_MAXTHREADS 16U
+#define SBENCH_KEYFMT "t%02uk%05u"
+
+struct sbench_cfg {
+	uint32_t size;		/* partition size (split over the shards) */
+	uint32_t bsz;		/* block size */
+	uint32_t keys;		/* keys per thread */
+	uint32_t vsz;		/* value size */
+	uint32_t rounds;	/* number of times each key is written */
+};
+
+/* the RAM backend is the first member, the backend routines get a sbench_be */
+struct sbench_be {
+	struct kvs_be_ram ram;
+	pthread_mutex_t mtx;
+};
+
+struct sbench_thread {
+	pthread_t tid;
+	const struct sbench_cfg *cfg;
+	const struct kvs_shard *shard;
+	uint32_t nr;
+	uint64_t *lat;
+	int rc;
+};
+
+static const char sbench_cookie[] = "kvs_shard_bench";
+
+static uint64_t sbench_now(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+static int sbench_cmp(const void *a, const void *b)
+{
+	const uint64_t la = *(const uint64_t *)a;
+	const uint64_t lb = *(const uint64_t *)b;
+
+	return (la > lb) - (la < lb);
+}
+
+static int sbench_lock(const void *ctx)
+{
+	struct sbench_be *be = (struct sbench_be *)ctx;
+
+	return pthread_mutex_lock(&be->mtx) == 0 ? 0 : -KVS_EDEADLK;
+}
+
+static int sbench_unlock(const void *ctx)
+{
+	struct sbench_be *be = (struct sbench_be *)ctx;
+
+	return pthread_mutex_unlock(&be->mtx) == 0 ? 0 : -KVS_EDEADLK;
+}
+
+static void sbench_value(uint8_t *value, uint32_t len, uint32_t seed)
+{
+	for (uint32_t i = 0U; i < len; i++) {
+		value[i] = (uint8_t)(seed + i);
+	}
+}
+
+static void *sbench_writer(void *arg)
+{
+	struct sbench_thread *thr = (struct sbench_thread *)arg;
+	const struct sbench_cfg *cfg = thr->cfg;
+	uint8_t value[cfg->vsz];
+	char key[16];
+	uint32_t cnt = 0U;
+
+	for (uint32_t r = 0U; r < cfg->rounds; r++) {
+		for (uint32_t k = 0U; k < cfg->keys; k++) {
+			uint64_t start;
+
+			(void)snprintf(key, sizeof(key), SBENCH_KEYFMT,
+				       thr->nr, k);
+			sbench_value(value, cfg->vsz, r + k);
+			start = sbench_now();
+			thr->rc = kvs_shard_write(thr->shard, key, value,
+						  cfg->vsz);
+			thr->lat[cnt++] = sbench_now() - start;
+			if (thr->rc != 0) {
+				return NULL;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static int sbench_verify(const struct sbench_cfg *cfg,
+			 const struct kvs_shard *shard, uint32_t threads)
+{
+	uint8_t value[cfg->vsz], rdvalue[cfg->vsz];
+	char key[16];
+	int rc;
+
+	for (uint32_t t = 0U; t < threads; t++) {
+		for (uint32_t k = 0U; k < cfg->keys; k++) {
+			(void)snprintf(key, sizeof(key), SBENCH_KEYFMT, t, k);
+			sbench_value(value, cfg->vsz, cfg->rounds - 1U + k);
+			rc = kvs_shard_read(shard, key, rdvalue, cfg->vsz);
+			if (rc != 0) {
+				return rc;
+			}
+
+			if (memcmp(value, rdvalue, cfg->vsz) != 0) {
+				return -KVS_EIO;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int sbench_walk_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	uint32_t *cnt = (uint32_t *)cb_arg;
+
+	(void)ent;
+	(*cnt)++;
+	return 0;
+}
+
+static int sbench_run(const struct sbench_cfg *cfg, uint32_t shards,
+		      uint32_t threads)
+{
+	const uint32_t ssize = cfg->size / shards;
+	const uint32_t wcnt = cfg->keys * cfg->rounds;
+	struct sbench_be be[SBENCH_MAXSHARDS];
+	struct kvs_cfg *kvs_cfg = calloc(shards, sizeof(struct kvs_cfg));
+	struct kvs_data kvs_data[SBENCH_MAXSHARDS];
+	struct kvs kvs[SBENCH_MAXSHARDS];
+	struct kvs *kvs_ptr[SBENCH_MAXSHARDS];
+	uint8_t pbuf[SBENCH_MAXSHARDS][8];
+	struct sbench_thread thr[SBENCH_MAXTHREADS];
+	const struct kvs_shard shard = {
+		.kvs = kvs_ptr,
+		.cnt = shards,
+	};
+	uint64_t *lat = malloc(threads * wcnt * sizeof(uint64_t));
+	uint64_t start, wtime = 0U, utime = 0U, mtime = 0U;
+	uint32_t cnt = 0U;
+	int rc = -KVS_ENOSPC;
+
+	memset(be, 0, sizeof(be));
+	for (uint32_t i = 0U; i < shards; i++) {
+		(void)pthread_mutex_init(&be[i].mtx, NULL);
+	}
+
+	if ((kvs_cfg == NULL) || (lat == NULL)) {
+		goto end;
+	}
+
+	for (uint32_t i = 0U; i < shards; i++) {
+		const struct kvs_cfg scfg = {
+			.ctx = (void *)&be[i],
+			.bsz = cfg->bsz,
+			.bcnt = ssize / cfg->bsz,
+			.bspr = 1U,
+			.pbuf = pbuf[i],
+			.psz = sizeof(pbuf[i]),
+			.read = kvs_be_ram_read,
+			.prog = kvs_be_ram_prog,
+			.comp = kvs_be_ram_comp,
+			.lock = sbench_lock,
+			.unlock = sbench_unlock,
+		};
+
+		be[i].ram.size = ssize;
+		be[i].ram.esize = cfg->bsz;
+		be[i].ram.mem = malloc(ssize);
+		memcpy(&kvs_cfg[i], &scfg, sizeof(scfg));
+		memset(&kvs_data[i], 0, sizeof(kvs_data[i]));
+		kvs_data[i].cookie = (void *)sbench_cookie;
+		kvs_data[i].csz = sizeof(sbench_cookie) - 1;
+		kvs[i].cfg = &kvs_cfg[i];
+		kvs[i].data = &kvs_data[i];
+		kvs_ptr[i] = &kvs[i];
+		if (be[i].ram.mem == NULL) {
+			goto end;
+		}
+	}
+
+	rc = kvs_shard_erase(&shard);
+	if (rc != 0) {
+		goto end;
+	}
+
+	rc = kvs_shard_mount(&shard);
+	if (rc != 0) {
+		goto end;
+	}
+
+	start = sbench_now();
+	for (uint32_t t = 0U; t < threads; t++) {
+		thr[t].cfg = cfg;
+		thr[t].shard = &shard;
+		thr[t].nr = t;
+		thr[t].lat = &lat[t * wcnt];
+		thr[t].rc = 0;
+		(void)pthread_create(&thr[t].tid, NULL, sbench_writer,
+				     &thr[t]);
+	}
+
+	for (uint32_t t = 0U; t < threads; t++) {
+		(void)pthread_join(thr[t].tid, NULL);
+		if ((rc == 0) && (thr[t].rc != 0)) {
+			rc = thr[t].rc;
+		}
+	}
+
+	wtime = sbench_now() - start;
+	if (rc == 0) {
+		rc = sbench_verify(cfg, &shard, threads);
+	}
+
+	if (rc == 0) {
+		start = sbench_now();
+		rc = kvs_shard_walk_unique(&shard, "t", sbench_walk_cb, &cnt);
+		utime = sbench_now() - start;
+		if ((rc == 0) && (cnt != threads * cfg->keys)) {
+			rc = -KVS_EIO;
+		}
+	}
+
+	(void)kvs_shard_unmount(&shard);
+	if (rc == 0) {
+		start = sbench_now();
+		rc = kvs_shard_mount(&shard);
+		mtime = sbench_now() - start;
+		(void)kvs_shard_unmount(&shard);
+	}
+
+end:
+	if (rc != 0) {
+		printf("%6u %7u %5u %7u %5u %5u failed [%d]\n", shards,
+		       cfg->size, cfg->bsz, threads, cfg->keys, cfg->vsz, rc);
+	} else {
+		const uint32_t n = threads * wcnt;
+
+		qsort(lat, n, sizeof(uint64_t), sbench_cmp);
+		printf("%6u %7u %5u %7u %5u %5u %11.0f %9.2f %9.2f %11.2f "
+		       "%9.2f\n", shards, cfg->size, cfg->bsz, threads,
+		       cfg->keys, cfg->vsz, (double)n * 1e9 / (double)wtime,
+		       (double)lat[(n - 1U) / 2U] / 1e3,
+		       (double)lat[((n - 1U) * 99U) / 100U] / 1e3,
+		       (double)utime / 1e3, (double)mtime / 1e3);
+	}
+
+	for (uint32_t i = 0U; i < shards; i++) {
+		free(be[i].ram.mem);
+		(void)pthread_mutex_destroy(&be[i].mtx);
+	}
+
+	free(kvs_cfg);
+	free(lat);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	struct sbench_cfg cfg = {
+		.size = 262144U,
+		.bsz = 4096U,
+		.keys = 128U,
+		.vsz = 32U,
+		.rounds = 8U,
+	};
+	uint32_t threads = 4U, maxshards = SBENCH_MAXSHARDS;
+	int opt, rc = 0;
+
+	while ((opt = getopt(argc, argv, "qt:")) != -1) {
+		switch (opt) {
+		case 'q':
+			cfg.size = 32768U;
+			cfg.bsz = 1024U;
+			cfg.keys = 16U;
+			cfg.vsz = 16U;
+			cfg.rounds = 4U;
+			threads = 2U;
+			maxshards = 4U;
+			break;
+		case 't':
+			threads = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-q] [-t threads]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if ((threads == 0U) || (threads > SBENCH_MAXTHREADS)) {
+		fprintf(stderr, "threads: 1 ... %u\n", SBENCH_MAXTHREADS);
+		return EXIT_FAILURE;
+	}
+
+	printf("%6s %7s %5s %7s %5s %5s %11s %9s %9s %11s %9s\n", "shards",
+	       "size", "bsz", "threads", "keys", "vsz", "write/s", "p50[us]",
+	       "p99[us]", "walk_u[us]", "mount[us]");
+	for (uint32_t shards = 1U; shards <= maxshards; shards *= 2U) {
+		if (sbench_run(&cfg, shards, threads) != 0) {
+			rc = EXIT_FAILURE;
+		}
+	}
+
+	return rc;
+}
@@ -13,10 +13,11 @@
  *
  * KVS stores Key-value entries as:
  *
- * Entry header: the length of the header is 4 byte.
- *	byte 0: CRC8 over the header
- *	byte 1: key length (this allows keys of up to 256 chars)
- *	byte 2-3: value length bytes
+ * Entry header: the length of the header is 4 byte (little endian).
+ *	bit 0-7: key length (this allows keys of up to 255 chars)
+ *	bit 8-20: value length (up to KVS_HDRVALMASK bytes)
+ *	bit 21-23: entry type
+ *	bit 24-31: CRC8 over bit 0-23, it has to match exactly
  * Entry data:
  *	key bytes (key length)
  *	value bytes (value length)
@@ -24,21 +25,64 @@
  *fill bytes (for alignment)
  *
  * Entries are written sequentially to blocks that have a configurable size. At
- * the beginning of each block a special entry is written that has the key size
- * set to 0 and its data consists of a wrap counter (4 byte) and a cookie. The
- * wrap counter is increased each time the memory wraps around. The use of the
- * cookie is left up to the user, it could e.g. by used as means to identify the
- * key value store or its version.
+ * the beginning of each block a special entry (type KVS_TYPE_META) is written
+ * that has the key size set to 0 and its data consists of a wrap counter
+ * (4 byte) and a cookie. The wrap counter is increased each time the memory
+ * wraps around. The use of the cookie is left up to the user, it could e.g. by
+ * used as means to identify the key value store or its version.
+ *
+ * Memory written before the entry type had its own header bits (the type was
+ * xor-ed into the CRC8 and the value length had 16 bits) starts its blocks with
+ * a plain entry, kvs_mount() rejects it and the kvs has to be erased.
+ *
+ * Entries of type KVS_TYPE_PACKED store their value compressed: the value
+ * bytes start with the uncompressed length (2 byte) followed by a stream of
+ * tokens:
+ *	0b0nnnnnnn: literal, n + 1 bytes follow,
+ *	0b10nnnnnn: run, the next byte is repeated n + KVS_PACKRUNMIN times,
+ *	0b11nnnnnn: copy of n + KVS_PACKCPYMIN bytes, the next 2 bytes contain
+ *		    the (little endian) position of the bytes in the stream.
+ * A copy always refers to bytes that are stored literally, so a value can be
+ * decompressed from any offset without the need of a history buffer.
+ *
+ * Entries of type KVS_TYPE_PATCH are partial updates of the last entry with the
+ * same key: the value bytes start with the offset in the value (2 byte)
+ * followed by the new data. Patches are applied on read, when a entry is moved
+ * to a new block or when a entry has KVS_PATCHMAX - 1 patches the patches are
+ * folded into a new plain entry.
+ *
+ * Values that do not fit in a block are split in chunks. Each chunk is stored
+ * as a entry of type KVS_TYPE_CHUNK, its key is the key of the value followed
+ * by a 0 byte, a generation byte and the chunk index (2 byte). After all chunks
+ * are written a directory entry of type KVS_TYPE_CDIR is added with the key of
+ * the value, its value bytes are the value length (4 byte), the chunk size
+ * (2 byte) and the generation. Chunks that do not belong to the last directory
+ * entry are removed during garbage collection.
+ *
+ * With a key dictionary (see struct kvs_keydict) the key bytes can start with
+ * a 0 byte followed by the index of the dictionary key they replace. Numeric
+ * keys (see kvs_write_id()) are stored as a 0 byte, 0xFF and the (little
+ * endian) id.
+ *
+ * On memory that can be overwritten (see inplace in struct kvs_data) a value
+ * with the same length as the last plain entry of its key is updated in
+ * place: the new entry is written as a shadow at the write position, the
+ * value and CRC32 of the entry are overwritten and synced, and a sync at the
+ * unchanged write position removes the shadow. A interrupted update leaves
+ * the shadow (a newer entry with the new value) or the updated entry, the
+ * write position only moves when the length changes. In this mode the end of
+ * a entry is marked (synced) before the entry is written and the header is
+ * written last, so old entries after the write position never reappear.
  *
  * When a new block is strated the key value store verifies whether it needs to
  * move old entries to keep a copy and does so if required.
  *
  * The configurable block size needs to be a power of 2. The block size limits
- * the maximum size of an entry as it needs to fit within one block. The block
- * size is not limited to an erase block size of the memory device, this allows
- * using memory devices with non constant erase block sizes. However in this
- * last case carefull parameter selection is required to guarantee that there
- * will be no loss of data.
+ * the maximum size of an entry as it needs to fit within one block (larger
+ * values are stored in chunks). The block size is not limited to an erase
+ * block size of the memory device, this allows using memory devices with non
+ * constant erase block sizes. However in this last case carefull parameter
+ * selection is required to guarantee that there will be no loss of data.
  */
 
 #ifndef KVS_H_
@@ -72,14 +116,45 @@ enum kvs_constants
 	KVS_HDRSIZE = 4,
 	KVS_HDRKEYMASK = 0xFF,
 	KVS_HDRKEYSHIFT = 0,
-	KVS_HDRVALMASK = 0xFFFF,
+	KVS_HDRVALMASK = 0x1FFF,
 	KVS_HDRVALSHIFT = 8,
+	KVS_HDRTYPEMASK = 0x7,
+	KVS_HDRTYPESHIFT = 21,
 	KVS_HDRCRCMASK = 0xFF,
 	KVS_HDRCRCSHIFT = 24,
 	KVS_KVCRCSIZE = 4,
 	KVS_KVCRCINIT = 0x0,
 	KVS_BUFSIZE = 16,
 	KVS_WRAPCNTSIZE = 4,
+	KVS_PACKLENSIZE = 2,
+	KVS_PACKMINLEN = 16,
+	KVS_PACKLITMAX = 128,
+	KVS_PACKRUNMIN = 3,
+	KVS_PACKRUNMAX = 66,
+	KVS_PACKCPYMIN = 4,
+	KVS_PACKCPYMAX = 67,
+	KVS_PACKHIST = 8,
+	KVS_PATCHOFFSIZE = 2,
+	KVS_PATCHMAX = 8,
+	KVS_CHUNKSFXSIZE = 4,
+	KVS_CDIRSIZE = 7,
+	KVS_SEQRETRIES = 3,
+	KVS_SEGHDRSIZE = 16,
+};
+
+/**
+ * @brief KVS entry types
+ *
+ */
+enum kvs_entry_types
+{
+	KVS_TYPE_PLAIN = 0,	/**< Plain key value entry */
+	KVS_TYPE_PACKED = 1,	/**< Key value entry with compressed value */
+	KVS_TYPE_PATCH = 2,	/**< Partial update of a key value entry */
+	KVS_TYPE_CHUNK = 3,	/**< Part of a large value */
+	KVS_TYPE_CDIR = 4,	/**< Directory of a large value */
+	KVS_TYPE_META = 5,	/**< Wrap counter and cookie at a block start */
+	KVS_TYPE_CNT,
 };
 
 /**
@@ -106,6 +181,21 @@ enum kvs_stop_codes
 	KVS_DONE = 1,	/**< Finished processing */
 };
 
+/**
+ * @brief KVS garbage collection policies used by kvs_gc()
+ *
+ * Blocks are reclaimed in ring order, the policy decides if reclaiming the
+ * next block ahead of time is worth it. The cost of reclaiming a block is the
+ * live data that is copied plus the free space that is left in the current
+ * block, the benefit is the space that is reclaimed.
+ */
+enum kvs_gc_policies
+{
+	KVS_GC_ALWAYS = 0,	/**< Always reclaim the next block */
+	KVS_GC_GREEDY = 1,	/**< Reclaim when at least half of it is garbage */
+	KVS_GC_COST_BENEFIT = 2,/**< Reclaim when the benefit exceeds the cost */
+};
+
 /**
  * @brief KVS entry structure
  *
@@ -115,10 +205,129 @@ struct kvs_ent {
 	uint32_t start;		/**< start position of the entry */
 	uint32_t next;		/**< position of the next entry */
 	uint32_t he_hdr;	/**< hamming encoded header */
+	uint32_t vlen;		/**< value length (uncompressed) */
+	uint8_t type;		/**< entry type */
+	uint32_t pcnt;		/**< number of patches to apply */
+	uint32_t seq;		/**< kvs->data->seq at which the block of the
+				 *   entry is reused (see kvs_entry_read())
+				 */
+	uint32_t zpos;		/**< packed token of the last read (used by
+				 *   the read, 0 when not set)
+				 */
+	uint32_t upos;		/**< value offset of zpos (used by the read) */
 };
 
-#define entry_get_klen(ent) ((ent->he_hdr >> KVS_HDRKEYSHIFT) & KVS_HDRKEYMASK)
-#define entry_get_vlen(ent) ((ent->he_hdr >> KVS_HDRVALSHIFT) & KVS_HDRVALMASK)
+/**
+ * @brief KVS read request (see kvs_read_many())
+ *
+ */
+struct kvs_read_req {
+	const char *key;	/**< key to read */
+	void *value;		/**< buffer for the value */
+	size_t len;		/**< value length (bytes) */
+	int rc;			/**< result: 0 on success, -KVS_ENOENT when
+				 *   the key is not found, negative errorcode
+				 *   on error
+				 */
+	struct kvs_ent ent;	/**< entry of the key (used by the read) */
+	uint32_t klen;		/**< key length (used by the read) */
+	uint32_t pcnt;		/**< patch count (used by the read) */
+	uint32_t kdlen;		/**< length of the dictionary key the key
+				 *   starts with (used by the read)
+				 */
+	uint8_t kid;		/**< index of the dictionary key (used by the
+				 *   read)
+				 */
+};
+
+/**
+ * @brief KVS memory usage
+ *
+ */
+struct kvs_fsstat {
+	uint32_t live;		/**< bytes used by live entries */
+	uint32_t dead;		/**< bytes used by outdated entries and meta
+				 *   data (reclaimed by garbage collection)
+				 */
+	uint32_t free;		/**< bytes that can be written before garbage
+				 *   collection is needed
+				 */
+};
+
+/**
+ * @brief KVS operation statistics
+ *
+ * The counters are only updated when kvs->data->stats is provided, they wrap
+ * around and can be reset by clearing the structure.
+ */
+struct kvs_stats {
+	uint32_t reads;		/**< number of memory reads */
+	uint32_t rd_bytes;	/**< bytes read from memory */
+	uint32_t progs;		/**< number of memory programs */
+	uint32_t prog_bytes;	/**< bytes programmed to memory */
+	uint32_t syncs;		/**< number of memory syncs */
+	uint32_t lookups;	/**< number of key lookups */
+	uint32_t writes;	/**< number of writes (including deletes) */
+	uint32_t wr_bytes;	/**< value bytes written (for write
+				 *   amplification: prog_bytes / wr_bytes)
+				 */
+	uint32_t compactions;	/**< number of garbage collection runs */
+	uint32_t copies;	/**< entries copied by garbage collection */
+	uint32_t moves;		/**< entries moved to the cold kvs */
+	uint32_t crc_errors;	/**< entries skipped because of a bad CRC */
+	uint32_t recoveries;	/**< interrupted garbage collections recovered */
+	uint32_t retries;	/**< lookups redone because a block was reused
+				 *   while they were running
+				 */
+	uint32_t coalesced;	/**< writes replaced in the write buffer before
+				 *   they were written to memory
+				 */
+	uint32_t inplace;	/**< values updated in place */
+};
+
+/**
+ * @brief KVS trace operations
+ *
+ * Operation id passed to the trace hooks, the first group are the public
+ * routines, the second group internal operations and the last group the
+ * memory device calls.
+ */
+enum kvs_trace_ops {
+	KVS_TRACE_MOUNT,	/**< kvs_mount() (size: 0) */
+	KVS_TRACE_UNMOUNT,	/**< kvs_unmount() (size: 0) */
+	KVS_TRACE_ERASE,	/**< kvs_erase() (size: memory size) */
+	KVS_TRACE_ENTRY_GET,	/**< kvs_entry_get() (size: key length) */
+	KVS_TRACE_ENTRY_READ,	/**< kvs_entry_read() (size: read length) */
+	KVS_TRACE_READ,		/**< kvs_read(), kvs_read_id() (size: read
+				 *   length)
+				 */
+	KVS_TRACE_READ_MANY,	/**< kvs_read_many() (size: key count) */
+	KVS_TRACE_WRITE,	/**< kvs_write(), kvs_delete(), kvs_write_id(),
+				 *   kvs_delete_id() (size: value length)
+				 */
+	KVS_TRACE_WRITE_AT,	/**< kvs_write_at() (size: write length) */
+	KVS_TRACE_WALK,		/**< kvs_walk() (size: key length) */
+	KVS_TRACE_WALK_UNIQUE,	/**< kvs_walk_unique() (size: key length) */
+	KVS_TRACE_COMPACT,	/**< kvs_compact() (size: 0) */
+	KVS_TRACE_GC,		/**< kvs_gc() (size: 0) */
+	KVS_TRACE_FSSTAT,	/**< kvs_fsstat() (size: 0) */
+	KVS_TRACE_FLUSH,	/**< kvs_flush() (size: buffered bytes) */
+	KVS_TRACE_LOOKUP,	/**< key lookup (size: key length) */
+	KVS_TRACE_APPEND,	/**< entry append (size: key + value length) */
+	KVS_TRACE_RECLAIM,	/**< garbage collection (size: area walked) */
+	KVS_TRACE_DEV_READ,	/**< memory read (size: read length) */
+	KVS_TRACE_DEV_PROG,	/**< memory prog (size: prog length) */
+	KVS_TRACE_DEV_COMP,	/**< memory compare (size: compare length) */
+	KVS_TRACE_DEV_SYNC,	/**< memory sync (size: 0) */
+	KVS_TRACE_DEV_LOCK,	/**< memory lock (size: 0) */
+	KVS_TRACE_DEV_ERASE,	/**< memory erase by a backend (size: erase
+				 *   length)
+				 */
+	KVS_TRACE_CNT,
+};
+
+#define entry_get_klen(ent) (((ent)->he_hdr >> KVS_HDRKEYSHIFT) & KVS_HDRKEYMASK)
+#define entry_get_vlen(ent) ((ent)->vlen)
 
 /**
  * @brief KVS memory configuration definition
@@ -223,6 +432,133 @@ struct kvs_cfg {
 	 * @return 0 on success, error is ignored
 	 */
 	int (*unlock)(const void *ctx);
+
+	/**
+	 * @brief os provided shared (read) lock function (optional)
+	 *
+	 * Taken by kvs_walk() and kvs_walk_unique() for the whole walk. It
+	 * should allow several readers but exclude lock() (e.g. the read side
+	 * of a rwlock whose write side is lock()). The walk callback can not
+	 * write to the kvs while it is held.
+	 *
+	 * @param[in] ctx pointer to memory context
+	 *
+	 * @return 0 on success, error is propagated to user
+	 */
+	int (*rdlock)(const void *ctx);
+
+	/**
+	 * @brief os provided shared (read) unlock function (optional)
+	 *
+	 * @param[in] ctx pointer to memory context
+	 *
+	 * @return 0 on success, error is ignored
+	 */
+	int (*rdunlock)(const void *ctx);
+};
+
+struct kvs_snapshot;
+
+/**
+ * @brief KVS sorted segment structure
+ *
+ * A sorted segment is a immutable table of entries sorted by key that is
+ * stored on a separate kvs (typically a separate partition). The memory of the
+ * segment kvs is split in two halves: a new segment is written to the unused
+ * half while the other one is in use and replaces it once it is complete. The
+ * segment kvs is not mounted as a kvs, its cfg and data are used to access
+ * the memory.
+ */
+struct kvs_seg {
+	const struct kvs *kvs;	/**< kvs used to store the segment (bcnt needs
+				 *   to be even)
+				 */
+	uint32_t *idx;		/**< buffer to sort the entries when building
+				 *   the segment (idxcnt elements)
+				 */
+	uint32_t idxcnt;	/**< maximum number of entries in the segment */
+	uint32_t cnt;		/**< number of entries (set on mount) */
+	uint32_t ioff;		/**< position of the index (set on mount) */
+	uint32_t gen;		/**< generation of the last segment build (set
+				 *   on mount)
+				 */
+	uint32_t half;		/**< half that is in use (set on mount) */
+};
+
+/**
+ * @brief KVS default value (see struct kvs_defaults)
+ *
+ */
+struct kvs_default {
+	const char *key;	/**< key */
+	const void *value;	/**< default value */
+	uint32_t len;		/**< value length (bytes, nonzero) */
+};
+
+/**
+ * @brief KVS defaults table
+ *
+ * A constant table of default values, generated at build time by kvs_defgen
+ * (see kvs_generate_defaults() in lib/CMakeLists.txt). The table uses a
+ * minimal perfect hash: the key hash with seed 0 selects a displacement
+ * (seed), the key hash with that seed selects the only entry that can hold
+ * the key.
+ */
+struct kvs_defaults {
+	const struct kvs_default *ent;	/**< entries (cnt elements) */
+	const uint16_t *disp;		/**< displacements (dcnt elements) */
+	uint32_t cnt;			/**< number of entries */
+	uint32_t dcnt;			/**< number of displacements */
+};
+
+/**
+ * @brief KVS key dictionary
+ *
+ * A constant list of (long) keys or key prefixes, e.g. the settings subtree
+ * names of a application. A key that starts with a dictionary key is stored
+ * with a 2 byte reference (a 0 byte and the index) instead of the
+ * dictionary key, the longest dictionary key that matches is used. Keys are
+ * encoded and decoded by the kvs, the stored data depends on the dictionary:
+ * keys can only be appended to it and a cold kvs or segment uses the same
+ * dictionary (it is copied on mount when they have none).
+ */
+struct kvs_keydict {
+	const char *const *key;	/**< keys (cnt elements, not empty) */
+	uint32_t cnt;		/**< number of keys (at most 255) */
+};
+
+/**
+ * @brief KVS write buffer
+ *
+ * A write buffer holds the last value written for each key until it is
+ * flushed: a rewrite of a buffered key replaces the value in the buffer, only
+ * the final value is written to memory. The buffer is flushed when it is
+ * full, when interval has passed since the oldest buffered write (checked by
+ * kvs_write() and kvs_gc()), by kvs_flush() and before routines that return
+ * entries (kvs_entry_get(), walks, snapshots, kvs_write_at()), compaction
+ * and unmount. Buffered values are lost on a power failure.
+ *
+ * A flush compares all buffered values with the values in memory in one walk
+ * and syncs once after the changed values are written, a buffer can also be
+ * attached for a batch of writes (e.g. a settings save, see
+ * kvs_wbuf_attach()) and flushed at the end of the batch.
+ */
+struct kvs_wbuf {
+	uint8_t *buf;		/**< buffer for the pending writes */
+	uint32_t size;		/**< buffer size (byte) */
+	uint32_t interval;	/**< flush interval (in now() units, 0 to
+				 *   flush only when needed)
+				 */
+	uint32_t (*now)(void);	/**< time function (optional, e.g. uptime in
+				 *   ms)
+				 */
+	uint32_t used;		/**< bytes in use (maintained by the kvs) */
+	uint32_t start;		/**< time of the oldest buffered write
+				 *   (maintained by the kvs)
+				 */
+	bool flushing;		/**< flush in progress (maintained by the
+				 *   kvs)
+				 */
 };
 
 /**
@@ -236,17 +572,107 @@ struct kvs_data {
 	uint32_t wrapcnt;	/**< current wrap/erase counter */
 	void *cookie;		/**< pointer to cookie */
 	size_t csz;		/**< cookie size */
+	bool compress;		/**< compress values (when beneficial) */
+	bool inplace;		/**< update values of the same length in place
+				 *   (memory that can be overwritten, psz 1
+				 *   and a sync that marks the end of the
+				 *   entries, e.g. EEPROM)
+				 */
+	uint8_t gc;		/**< kvs_gc() policy (enum kvs_gc_policies) */
+	uint32_t *blive;	/**< live bytes per block (optional, bcnt
+				 *   elements, maintained while mounted)
+				 */
+	struct kvs_stats *stats;/**< operation statistics (optional) */
+	struct kvs *cold;	/**< kvs for entries that survive garbage
+				 *   collection (optional, mounted, unmounted
+				 *   and erased together with this kvs)
+				 */
+	uint32_t seq;		/**< block sequence, incremented each time the
+				 *   write position moves to the next block
+				 *   or a value is updated in place
+				 */
+	struct kvs_snapshot *snaps; /**< active snapshots */
+	struct kvs_seg *seg;	/**< sorted segment for entries that survive
+				 *   compaction (optional, can not be combined
+				 *   with a cold kvs)
+				 */
+	const struct kvs_defaults *defaults; /**< default values for keys
+					      *   without value (optional)
+					      */
+	struct kvs_wbuf *wbuf;	/**< write buffer (optional) */
+	const struct kvs_keydict *keydict; /**< key dictionary (optional) */
 };
 
 /**
  * @brief KVS structure
  *
+ * A kvs can have a second (cold) kvs, typically on a separate partition:
+ * entries that survive garbage collection are moved to the cold kvs instead of
+ * being copied to the write position. Entries that are rarely changed settle
+ * in the cold kvs and garbage collection of the kvs mostly reclaims blocks
+ * that contain outdated entries. Lookups use the cold kvs for keys that have
+ * no entry in the kvs. Chunked values are not moved and the cold kvs can not
+ * have a cold kvs itself.
+ *
+ * Instead of a cold kvs a kvs can have a sorted segment (see struct kvs_seg).
+ * kvs_compact() writes all values to a new segment and reclaims every block
+ * of the kvs, garbage collection does not copy entries that have the same value in the
+ * segment. Lookups use a binary search in the segment for keys that have no
+ * entry in the kvs, so values that are written once (e.g. at provisioning)
+ * are neither found by a scan nor copied by garbage collection.
+ *
+ * A kvs can have a table of default values (see struct kvs_defaults) that is
+ * used by kvs_read() and kvs_read_many() for keys without a value in the kvs.
+ * Only values that differ from their default need to be written and deleting
+ * a key restores its default.
  */
 struct kvs {
 	const struct kvs_cfg *cfg;
 	struct kvs_data *data;
 };
 
+/**
+ * @brief KVS snapshot structure
+ *
+ * A snapshot is a read only view of the kvs at the time it was taken: it
+ * keeps a copy of the write position and wrap counter and pins the blocks
+ * that hold the entries it can see. Writers are not blocked by a snapshot,
+ * but the kvs can only move bspr blocks ahead while it is held: garbage
+ * collection that would reuse a pinned block fails with -KVS_EAGAIN (and so
+ * does a write that needs it). Snapshots should be released before the kvs
+ * is unmounted and are not supported for a kvs with a cold kvs.
+ */
+struct kvs_snapshot {
+	struct kvs *src;		/**< kvs the snapshot is taken from */
+	struct kvs view;		/**< read only view (uses data) */
+	struct kvs_data data;		/**< kvs data at the snapshot */
+	uint32_t pin;			/**< src data->seq at which a pinned
+					 *   block would be reused
+					 */
+	struct kvs_snapshot *next;	/**< next active snapshot */
+};
+
+/**
+ * @brief KVS trace hooks
+ *
+ * When KVS_TRACE is defined at build time every public routine, the internal
+ * lookup, append and garbage collection and every memory device call are
+ * wrapped in a call to kvs_trace_enter() and kvs_trace_exit(), these routines
+ * are provided by the user or by the platform (e.g. to timestamp the calls
+ * with a tracing subsystem). The kvs pointer can be NULL when a routine is
+ * called with invalid arguments or when a backend traces a device operation.
+ * Without KVS_TRACE the hooks compile to nothing.
+ */
+#ifdef KVS_TRACE
+void kvs_trace_enter(const struct kvs *kvs, enum kvs_trace_ops op, size_t size);
+void kvs_trace_exit(const struct kvs *kvs, enum kvs_trace_ops op, int rc);
+#define KVS_TRACE_ENTER(kvs, op, size) kvs_trace_enter(kvs, op, size)
+#define KVS_TRACE_EXIT(kvs, op, rc) kvs_trace_exit(kvs, op, rc)
+#else
+#define KVS_TRACE_ENTER(kvs, op, size) do {} while (0)
+#define KVS_TRACE_EXIT(kvs, op, rc) do {} while (0)
+#endif
+
 /**
  * @brief Helper macro to define a kvs
  *
@@ -254,6 +680,18 @@ struct kvs {
 #define DEFINE_KVS(_name, _ctx, _bsz, _bcnt, _bspr, _pbuf, _psz, _read, _prog, \
 		   _comp, _sync, _init, _release, _lock, _unlock, _cookie,     \
 		   _csz)						       \
+	DEFINE_KVS_INPLACE(_name, _ctx, _bsz, _bcnt, _bspr, _pbuf, _psz,       \
+			   _read, _prog, _comp, _sync, _init, _release, _lock, \
+			   _unlock, _cookie, _csz, false)
+
+/**
+ * @brief Helper macro to define a kvs with in place updates enabled or not
+ *        (see kvs_data inplace)
+ *
+ */
+#define DEFINE_KVS_INPLACE(_name, _ctx, _bsz, _bcnt, _bspr, _pbuf, _psz,      \
+			   _read, _prog, _comp, _sync, _init, _release, _lock, \
+			   _unlock, _cookie, _csz, _inplace)		       \
 	struct kvs_cfg _name##_cfg = {                                         \
 		.ctx = _ctx,                                                   \
 		.bsz = _bsz,		                                       \
@@ -274,6 +712,7 @@ struct kvs {
 		.wrapcnt = 0U,						       \
 		.cookie = _cookie,					       \
 		.csz = _csz,						       \
+		.inplace = _inplace,					       \
 	};								       \
 	struct kvs _name = {                                                   \
 		.cfg = &_name##_cfg,                                           \
@@ -291,7 +730,8 @@ struct kvs {
  *
  * @param[in] kvs pointer to key value store
  *
- * @return 0 on success, negative errorcode on error
+ * @return 0 on success, -KVS_EINVAL when the memory holds a kvs of a older
+ *         format (see the entry header), negative errorcode on error
  */
 int kvs_mount(struct kvs *kvs);
 
@@ -317,16 +757,82 @@ int kvs_erase(struct kvs *kvs);
 
 /**
  * @brief compact the key value store (refreshes key value store and minimizes
- *        occupied flash).
+ *        occupied flash). When the kvs has a sorted segment a new segment is
+ *        written first and all blocks of the kvs are reclaimed.
  *
  * @param[in] kvs pointer to key value store
  *
- * @return 0 on success, negative errorcode on error
+ * @return 0 on success, -KVS_ENOSPC when the entries do not fit in the
+ *         segment, -KVS_EAGAIN when a snapshot is held, negative errorcode on
+ *         error
  */
 int kvs_compact(const struct kvs *kvs);
 
 /**
- * @brief get a entry from the key value store
+ * @brief reclaim the next block of the key value store ahead of time when
+ *        the garbage collection policy (kvs->data->gc) considers it worth
+ *        it. Calling this when the system is idle reduces the time kvs_write()
+ *        spends on garbage collection.
+ *
+ * @param[in] kvs pointer to key value store
+ *
+ * @return 0 when a block was reclaimed, -KVS_EAGAIN when reclaiming the
+ *         block is not worth it, negative errorcode on error
+ */
+int kvs_gc(const struct kvs *kvs);
+
+/**
+ * @brief write the values in the write buffer (see struct kvs_wbuf) to
+ *        memory.
+ *
+ * @param[in] kvs pointer to key value store
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_flush(const struct kvs *kvs);
+
+/**
+ * @brief flush the attached write buffer and attach a other write buffer
+ *        (e.g. for a batch of writes), the swap is done under the kvs lock.
+ *
+ * @param[in] kvs pointer to key value store
+ * @param[in] wbuf write buffer to attach (NULL to write unbuffered)
+ * @param[out] prev write buffer that was attached before
+ *
+ * @return 0 on success, negative errorcode on error (the attached write
+ *         buffer is kept when its flush fails)
+ */
+int kvs_wbuf_attach(const struct kvs *kvs, struct kvs_wbuf *wbuf,
+		    struct kvs_wbuf **prev);
+
+/**
+ * @brief get the memory usage of the key value store. When kvs->data->blive
+ *        is provided the live data is taken from the per block counters,
+ *        otherwise it is determined by walking the key value store.
+ *
+ * @param[in] kvs pointer to key value store
+ * @param[out] stat memory usage
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_fsstat(const struct kvs *kvs, struct kvs_fsstat *stat);
+
+/**
+ * @brief get the memory usage of a block of the key value store.
+ *
+ * @param[in] kvs pointer to key value store
+ * @param[in] block block number (0 ... bcnt - 1)
+ * @param[out] stat memory usage
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_fsstat_block(const struct kvs *kvs, uint32_t block,
+		     struct kvs_fsstat *stat);
+
+/**
+ * @brief get a entry from the key value store. The lookup does not take the
+ *        lock, it is redone when a block is reused while it is running (and
+ *        done under the lock when that keeps happening).
  *
  * @param[out] ent pointer to the entry
  * @param[in] kvs pointer to key value store
@@ -337,20 +843,50 @@ int kvs_compact(const struct kvs *kvs);
 int kvs_entry_get(struct kvs_ent *ent, const struct kvs *kvs, const char *key);
 
 /**
- * @brief read data from a entry in the kvs at offset
+ * @brief read data from a entry in the kvs at offset, compressed values are
+ *        decompressed transparently.
  *
  * @param[in] ent pointer to the entry
  * @param[in] off offset from entry key start
  * @param[out] data
  * @param[in] len bytes to read
  *
- * @return 0 on success, negative errorcode on error
+ * @return 0 on success, -KVS_EAGAIN when the block of the entry has been
+ *         reused by writes since it was retrieved (get the entry again),
+ *         negative errorcode on error
  */
 int kvs_entry_read(const struct kvs_ent *ent, uint32_t off, void *data,
 		   size_t len);
 
 /**
- * @brief read value for a key in the kvs
+ * @brief read the key of a entry in the kvs, a dictionary reference is
+ *        replaced by the dictionary key (see struct kvs_keydict). The key is
+ *        not terminated.
+ *
+ * @param[in] ent pointer to the entry
+ * @param[out] key
+ * @param[in] len key buffer length (bytes), at most len bytes are copied
+ *
+ * @return key length on success (can exceed len), negative errorcode on error
+ */
+int kvs_entry_key(const struct kvs_ent *ent, char *key, size_t len);
+
+/**
+ * @brief get the numeric key of a entry in the kvs (see kvs_write_id()).
+ *
+ * @param[in] ent pointer to the entry
+ * @param[out] id
+ *
+ * @return 0 on success, -KVS_ENOENT when the entry has a string key,
+ *         negative errorcode on error
+ */
+int kvs_entry_id(const struct kvs_ent *ent, uint16_t *id);
+
+/**
+ * @brief read value for a key in the kvs, like kvs_entry_get() without
+ *        waiting for writers. Keys without a value are read from the
+ *        defaults table (when available), at most the default value length
+ *        is copied.
  *
  * @param[in] kvs pointer to the kvs
  * @param[in] key
@@ -362,7 +898,59 @@ int kvs_entry_read(const struct kvs_ent *ent, uint32_t off, void *data,
 int kvs_read(const struct kvs *kvs, const char *key, void *value, size_t len);
 
 /**
- * @brief write value for a key in the kvs
+ * @brief read value for a numeric key in the kvs (see kvs_write_id()), the
+ *        defaults table is not used.
+ *
+ * @param[in] kvs pointer to the kvs
+ * @param[in] id
+ * @param[out] value
+ * @param[in] len value length (bytes)
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_read_id(const struct kvs *kvs, uint16_t id, void *value, size_t len);
+
+/**
+ * @brief read the values for several keys in the kvs, the keys are found in
+ *        one pass from the newest to the oldest entry that stops when all
+ *        keys are found. Keys without a value are read from the defaults
+ *        table (see kvs_read()). The result for each key is stored in
+ *        req->rc.
+ *
+ * @param[in] kvs pointer to the kvs
+ * @param[in,out] req array of read requests
+ * @param[in] cnt number of read requests
+ *
+ * @return 0 on success (see req->rc for each key), negative errorcode on error
+ */
+int kvs_read_many(const struct kvs *kvs, struct kvs_read_req *req, size_t cnt);
+
+/**
+ * @brief hash of a key used by the defaults table (see struct kvs_defaults)
+ *
+ * @param[in] key
+ * @param[in] klen key length (bytes)
+ * @param[in] seed
+ *
+ * @return hash value
+ */
+uint32_t kvs_defaults_hash(const char *key, size_t klen, uint32_t seed);
+
+/**
+ * @brief get the default value for a key
+ *
+ * @param[in] defaults pointer to the defaults table
+ * @param[in] key
+ *
+ * @return pointer to the default, NULL if the key has no default
+ */
+const struct kvs_default *kvs_defaults_get(const struct kvs_defaults *defaults,
+					   const char *key);
+
+/**
+ * @brief write value for a key in the kvs, when kvs->data->compress is set
+ *        the value is stored compressed if this reduces the entry size. Values
+ *        that do not fit in a block are stored in chunks.
  *
  * @param[in] kvs pointer to the kvs
  * @param[in] key
@@ -374,6 +962,23 @@ int kvs_read(const struct kvs *kvs, const char *key, void *value, size_t len);
 int kvs_write(const struct kvs *kvs, const char *key, const void *value,
 	      size_t len);
 
+/**
+ * @brief write part of the value for a existing key in the kvs. Only the
+ *        modified bytes are written (as a patch entry), the value length is
+ *        unchanged.
+ *
+ * @param[in] kvs pointer to the kvs
+ * @param[in] key
+ * @param[in] off offset in the value (bytes)
+ * @param[in] value
+ * @param[in] len length of the modified part (bytes)
+ *
+ * @return 0 on success, -KVS_ENOENT if the key does not exist, -KVS_EINVAL if
+ *         off + len exceeds the value length, negative errorcode on error
+ */
+int kvs_write_at(const struct kvs *kvs, const char *key, uint32_t off,
+		 const void *value, size_t len);
+
 /**
  * @brief delete a key in the kvs
  *
@@ -384,10 +989,40 @@ int kvs_write(const struct kvs *kvs, const char *key, const void *value,
  */
 int kvs_delete(const struct kvs *kvs, const char *key);
 
+/**
+ * @brief write value for a numeric key in the kvs. A numeric key is stored as
+ *        a 4 byte key that can not collide with a string key, so numeric
+ *        and string keys can be used in the same kvs. A lookup needs no
+ *        strlen() and compares 4 key bytes, shorter keys are skipped.
+ *        Numeric keys are reported by walks with a empty key, use
+ *        kvs_entry_id() to retrieve the id.
+ *
+ * @param[in] kvs pointer to the kvs
+ * @param[in] id
+ * @param[in] value
+ * @param[in] len value length (bytes)
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_write_id(const struct kvs *kvs, uint16_t id, const void *value,
+		 size_t len);
+
+/**
+ * @brief delete a numeric key in the kvs
+ *
+ * @param[in] kvs pointer to the kvs
+ * @param[in] id
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_delete_id(const struct kvs *kvs, uint16_t id);
+
 /**
  * @brief walk over entries in kvs and issue a cb for each entry that starts
  *        with the specified key. Walking can be stopped by returning KVS_DONE
- *	  from the callback.
+ *	  from the callback. Patch and chunk entries are not reported, patches
+ *	  are not applied to the reported entries. The walk holds the shared
+ *	  lock (cfg->rdlock) when it is provided.
  *
  * @param[in] kvs pointer to the kvs
  * @param[in] key
@@ -403,6 +1038,8 @@ int kvs_walk(const struct kvs *kvs, const char *key,
  * @brief walk over entries in kvs and issue a cb for each entry that starts
  *        with the specified key, the cb is only called for the last added
  *	  entry. Walking can be stopped by returning KVS_DONE from the callback.
+ *	  Patch and chunk entries are not reported. The walk holds the shared
+ *	  lock (cfg->rdlock) when it is provided.
  *
  * @param[in] kvs pointer to the kvs
  * @param[in] key
@@ -414,6 +1051,81 @@ int kvs_walk(const struct kvs *kvs, const char *key,
 int kvs_walk_unique(const struct kvs *kvs, const char *key,
 		    int (*cb)(struct kvs_ent *ent, void *arg), void *arg);
 
+/**
+ * @brief take a snapshot of the kvs
+ *
+ * @param[out] snap pointer to the snapshot
+ * @param[in] kvs pointer to the kvs
+ *
+ * @return 0 on success, -KVS_EINVAL when the kvs is not mounted or has a
+ *         cold kvs, negative errorcode on error
+ */
+int kvs_snapshot_take(struct kvs_snapshot *snap, const struct kvs *kvs);
+
+/**
+ * @brief release a snapshot, the pinned blocks can be reused afterwards
+ *
+ * @param[in] snap pointer to the snapshot
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_snapshot_release(struct kvs_snapshot *snap);
+
+/**
+ * @brief get a entry as it was when the snapshot was taken, the entry can be
+ *        read with kvs_entry_read() while the snapshot is held.
+ *
+ * @param[out] ent pointer to the entry
+ * @param[in] snap pointer to the snapshot
+ * @param[in] key key of the entry
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_snapshot_entry_get(struct kvs_ent *ent,
+			   const struct kvs_snapshot *snap, const char *key);
+
+/**
+ * @brief read value for a key as it was when the snapshot was taken
+ *
+ * @param[in] snap pointer to the snapshot
+ * @param[in] key
+ * @param[out] value
+ * @param[in] len value length (bytes)
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_snapshot_read(const struct kvs_snapshot *snap, const char *key,
+		      void *value, size_t len);
+
+/**
+ * @brief walk over the entries of a snapshot (see kvs_walk()), the walk does
+ *        not take any lock.
+ *
+ * @param[in] snap pointer to the snapshot
+ * @param[in] key
+ * @param[in] cb callback function
+ * @param[in] arg callback function argument
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_snapshot_walk(const struct kvs_snapshot *snap, const char *key,
+		      int (*cb)(struct kvs_ent *ent, void *arg), void *arg);
+
+/**
+ * @brief walk over the last entry of each key in a snapshot (see
+ *        kvs_walk_unique()), the walk does not take any lock.
+ *
+ * @param[in] snap pointer to the snapshot
+ * @param[in] key
+ * @param[in] cb callback function
+ * @param[in] arg callback function argument
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_snapshot_walk_unique(const struct kvs_snapshot *snap, const char *key,
+			     int (*cb)(struct kvs_ent *ent, void *arg),
+			     void *arg);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
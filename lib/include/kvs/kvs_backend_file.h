@@ -0,0 +1,66 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: Copyright (c) 2023 Laczen
+ */
+
+/**
+ * @defgroup    kvs_backend_file
+ * @{
+ * @brief       KVS file backend
+ *
+ * Memory backend that keeps the kvs in a file (POSIX), used to run the kvs on
+ * a host. The file is opened (and created or extended to size) by the init
+ * routine and closed by the release routine, sync flushes the file data to
+ * the storage device.
+ */
+
+#ifndef KVS_BACKEND_FILE_H_
+#define KVS_BACKEND_FILE_H_
+
+#include "kvs/kvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief KVS file backend context
+ *
+ */
+struct kvs_be_file {
+	const char *path;	/**< file path */
+	size_t size;		/**< file size (byte) */
+	int fd;			/**< file descriptor (-1 when not opened) */
+};
+
+int kvs_be_file_read(const void *ctx, uint32_t off, void *data, size_t len);
+int kvs_be_file_prog(const void *ctx, uint32_t off, const void *data,
+		     size_t len);
+int kvs_be_file_comp(const void *ctx, uint32_t off, const void *data,
+		     size_t len);
+int kvs_be_file_sync(const void *ctx, uint32_t off);
+int kvs_be_file_init(const void *ctx);
+int kvs_be_file_release(const void *ctx);
+
+/**
+ * @brief Helper macro to define a kvs in a file
+ *
+ */
+#define DEFINE_KVS_FILE(_name, _path, _size, _bsz, _bspr, _psz, _cookie,      \
+			_csz)						       \
+	static uint8_t _name##_pbuf[_psz];				       \
+	struct kvs_be_file _name##_be = {				       \
+		.path = _path,						       \
+		.size = _size,						       \
+		.fd = -1,						       \
+	};								       \
+	DEFINE_KVS(_name, &_name##_be, _bsz, (_size) / (_bsz), _bspr,	       \
+		   _name##_pbuf, _psz, kvs_be_file_read, kvs_be_file_prog,     \
+		   kvs_be_file_comp, kvs_be_file_sync, kvs_be_file_init,       \
+		   kvs_be_file_release, NULL, NULL, _cookie, _csz)
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* KVS_BACKEND_FILE_H_ */
@@ -0,0 +1,71 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: Copyright (c) 2023 Laczen
+ */
+
+/**
+ * @defgroup    kvs_backend_mmap
+ * @{
+ * @brief       KVS mmap backend
+ *
+ * Memory backend that keeps the kvs in a file that is mapped in memory
+ * (Linux/POSIX). Reads, progs and compares are done on the mapping without
+ * system calls, sync writes the range that was programmed since the last sync
+ * back to the file (msync). The file is opened, created or extended to size
+ * and mapped by the init routine and unmapped and closed by the release
+ * routine.
+ */
+
+#ifndef KVS_BACKEND_MMAP_H_
+#define KVS_BACKEND_MMAP_H_
+
+#include "kvs/kvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief KVS mmap backend context
+ *
+ */
+struct kvs_be_mmap {
+	const char *path;	/**< file path */
+	size_t size;		/**< file size (byte) */
+	int fd;			/**< file descriptor (-1 when not opened) */
+	uint8_t *mem;		/**< mapping (NULL when not mapped) */
+	uint32_t dstart;	/**< start of range programmed since sync */
+	uint32_t dend;		/**< end of range programmed since sync */
+};
+
+int kvs_be_mmap_read(const void *ctx, uint32_t off, void *data, size_t len);
+int kvs_be_mmap_prog(const void *ctx, uint32_t off, const void *data,
+		     size_t len);
+int kvs_be_mmap_comp(const void *ctx, uint32_t off, const void *data,
+		     size_t len);
+int kvs_be_mmap_sync(const void *ctx, uint32_t off);
+int kvs_be_mmap_init(const void *ctx);
+int kvs_be_mmap_release(const void *ctx);
+
+/**
+ * @brief Helper macro to define a kvs in a mapped file
+ *
+ */
+#define DEFINE_KVS_MMAP(_name, _path, _size, _bsz, _bspr, _psz, _cookie,      \
+			_csz)						       \
+	static uint8_t _name##_pbuf[_psz];				       \
+	struct kvs_be_mmap _name##_be = {				       \
+		.path = _path,						       \
+		.size = _size,						       \
+		.fd = -1,						       \
+	};								       \
+	DEFINE_KVS(_name, &_name##_be, _bsz, (_size) / (_bsz), _bspr,	       \
+		   _name##_pbuf, _psz, kvs_be_mmap_read, kvs_be_mmap_prog,     \
+		   kvs_be_mmap_comp, kvs_be_mmap_sync, kvs_be_mmap_init,       \
+		   kvs_be_mmap_release, NULL, NULL, _cookie, _csz)
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* KVS_BACKEND_MMAP_H_ */
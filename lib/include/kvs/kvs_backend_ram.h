@@ -0,0 +1,63 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: Copyright (c) 2023 Laczen
+ */
+
+/**
+ * @defgroup    kvs_backend_ram
+ * @{
+ * @brief       KVS RAM backend
+ *
+ * Memory backend that keeps the kvs in a RAM buffer, used to run the kvs on a
+ * host. When esize is not 0 the backend behaves like flash: the first prog to a
+ * erase block (of esize bytes) fills the erase block with KVS_FILLCHAR.
+ */
+
+#ifndef KVS_BACKEND_RAM_H_
+#define KVS_BACKEND_RAM_H_
+
+#include "kvs/kvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief KVS RAM backend context
+ *
+ */
+struct kvs_be_ram {
+	uint8_t *mem;		/**< memory buffer */
+	size_t size;		/**< memory buffer size (byte) */
+	size_t esize;		/**< erase block size (byte), 0 for no erase */
+};
+
+int kvs_be_ram_read(const void *ctx, uint32_t off, void *data, size_t len);
+int kvs_be_ram_prog(const void *ctx, uint32_t off, const void *data,
+		    size_t len);
+int kvs_be_ram_comp(const void *ctx, uint32_t off, const void *data,
+		    size_t len);
+
+/**
+ * @brief Helper macro to define a kvs in RAM
+ *
+ */
+#define DEFINE_KVS_RAM(_name, _size, _esize, _bsz, _bspr, _psz, _cookie,      \
+		       _csz)						       \
+	static uint8_t _name##_mem[_size];				       \
+	static uint8_t _name##_pbuf[_psz];				       \
+	struct kvs_be_ram _name##_be = {				       \
+		.mem = _name##_mem,					       \
+		.size = _size,						       \
+		.esize = _esize,					       \
+	};								       \
+	DEFINE_KVS(_name, &_name##_be, _bsz, (_size) / (_bsz), _bspr,	       \
+		   _name##_pbuf, _psz, kvs_be_ram_read, kvs_be_ram_prog,       \
+		   kvs_be_ram_comp, NULL, NULL, NULL, NULL, NULL, _cookie,     \
+		   _csz)
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* KVS_BACKEND_RAM_H_ */
@@ -0,0 +1,73 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: Copyright (c) 2023 Laczen
+ */
+
+/**
+ * @defgroup    kvs_backend_uring
+ * @{
+ * @brief       KVS io_uring backend
+ *
+ * Memory backend that keeps the kvs in a file and accesses it through a
+ * io_uring (Linux). The small reads done by the kvs (e.g. during a walk) are
+ * served from a read ahead window that is filled with a single read of
+ * KVS_BE_URING_WINDOW bytes. Progs are copied to a staging buffer and are
+ * submitted without waiting for their completion, sync queues a fdatasync
+ * that is executed after all queued progs and waits for it. Errors of
+ * asynchronous progs are reported by the next sync or comp, comp waits for
+ * the queued progs and reads back from the file (not from the window).
+ */
+
+#ifndef KVS_BACKEND_URING_H_
+#define KVS_BACKEND_URING_H_
+
+#include "kvs/kvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KVS_BE_URING_WINDOW 4096	/**< read ahead window size (byte) */
+#define KVS_BE_URING_STAGE 65536	/**< prog staging buffer size (byte) */
+#define KVS_BE_URING_ENTRIES 64		/**< submission queue entries */
+
+/**
+ * @brief KVS io_uring backend context
+ *
+ */
+struct kvs_be_uring {
+	const char *path;	/**< file path */
+	size_t size;		/**< file size (byte) */
+	void *ring;		/**< ring state (NULL when not opened) */
+};
+
+int kvs_be_uring_read(const void *ctx, uint32_t off, void *data, size_t len);
+int kvs_be_uring_prog(const void *ctx, uint32_t off, const void *data,
+		      size_t len);
+int kvs_be_uring_comp(const void *ctx, uint32_t off, const void *data,
+		      size_t len);
+int kvs_be_uring_sync(const void *ctx, uint32_t off);
+int kvs_be_uring_init(const void *ctx);
+int kvs_be_uring_release(const void *ctx);
+
+/**
+ * @brief Helper macro to define a kvs in a file accessed with io_uring
+ *
+ */
+#define DEFINE_KVS_URING(_name, _path, _size, _bsz, _bspr, _psz, _cookie,     \
+			 _csz)						       \
+	static uint8_t _name##_pbuf[_psz];				       \
+	struct kvs_be_uring _name##_be = {				       \
+		.path = _path,						       \
+		.size = _size,						       \
+	};								       \
+	DEFINE_KVS(_name, &_name##_be, _bsz, (_size) / (_bsz), _bspr,	       \
+		   _name##_pbuf, _psz, kvs_be_uring_read, kvs_be_uring_prog,   \
+		   kvs_be_uring_comp, kvs_be_uring_sync, kvs_be_uring_init,    \
+		   kvs_be_uring_release, NULL, NULL, _cookie, _csz)
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* KVS_BACKEND_URING_H_ */
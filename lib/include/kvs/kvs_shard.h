@@ -0,0 +1,204 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: Copyright (c) 2023 Laczen
+ */
+
+/**
+ * @defgroup    kvs_shard
+ * @{
+ * @brief       KVS sharding
+ *
+ * A sharded kvs spreads the keys over several independent kvs (e.g. on
+ * separate partitions or files) using a hash of the key. Every kvs has its
+ * own lock, so writers to different shards do not wait for each other, and
+ * garbage collection of a shard only concerns the keys stored in it.
+ *
+ * A key is always stored in the same shard, so the number of shards (and
+ * their order) can not be changed without erasing them. Walks visit all
+ * shards one after the other, entries are reported per shard.
+ */
+
+#ifndef KVS_SHARD_H_
+#define KVS_SHARD_H_
+
+#include "kvs/kvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief KVS shard structure
+ *
+ */
+struct kvs_shard {
+	struct kvs *const *kvs;	/**< array of kvs (the shards) */
+	uint32_t cnt;		/**< number of shards */
+};
+
+/**
+ * @brief Helper macro to define a sharded kvs over previously defined kvs
+ *
+ * e.g. DEFINE_KVS_SHARD(shard, GET_KVS(kvs0), GET_KVS(kvs1));
+ */
+#define DEFINE_KVS_SHARD(_name, ...)					       \
+	static struct kvs *const _name##_kvs[] = {__VA_ARGS__};		       \
+	const struct kvs_shard _name = {				       \
+		.kvs = _name##_kvs,					       \
+		.cnt = sizeof(_name##_kvs) / sizeof(_name##_kvs[0]),	       \
+	}
+
+/**
+ * @brief get the kvs (shard) that stores a key
+ *
+ * @param[in] shard pointer to the sharded kvs
+ * @param[in] key
+ *
+ * @return pointer to the kvs, NULL if shard or key is invalid
+ */
+struct kvs *kvs_shard_get(const struct kvs_shard *shard, const char *key);
+
+/**
+ * @brief mount all shards, on error the mounted shards are unmounted
+ *
+ * @param[in] shard pointer to the sharded kvs
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_shard_mount(const struct kvs_shard *shard);
+
+/**
+ * @brief unmount all shards
+ *
+ * @param[in] shard pointer to the sharded kvs
+ *
+ * @return 0 on success, first negative errorcode on error
+ */
+int kvs_shard_unmount(const struct kvs_shard *shard);
+
+/**
+ * @brief erase all shards
+ *
+ * @param[in] shard pointer to the sharded kvs
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_shard_erase(const struct kvs_shard *shard);
+
+/**
+ * @brief compact all shards (see kvs_compact())
+ *
+ * @param[in] shard pointer to the sharded kvs
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_shard_compact(const struct kvs_shard *shard);
+
+/**
+ * @brief garbage collect all shards (see kvs_gc())
+ *
+ * @param[in] shard pointer to the sharded kvs
+ *
+ * @return 0 when a block was reclaimed in any shard, -KVS_EAGAIN when no
+ *         shard reclaimed a block, negative errorcode on error
+ */
+int kvs_shard_gc(const struct kvs_shard *shard);
+
+/**
+ * @brief get a entry from the sharded kvs (see kvs_entry_get())
+ *
+ * @param[out] ent pointer to the entry
+ * @param[in] shard pointer to the sharded kvs
+ * @param[in] key
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_shard_entry_get(struct kvs_ent *ent, const struct kvs_shard *shard,
+			const char *key);
+
+/**
+ * @brief read a value from the sharded kvs (see kvs_read())
+ *
+ * @param[in] shard pointer to the sharded kvs
+ * @param[in] key
+ * @param[out] value buffer to store the value
+ * @param[in] len buffer length
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_shard_read(const struct kvs_shard *shard, const char *key, void *value,
+		   size_t len);
+
+/**
+ * @brief write a value to the sharded kvs (see kvs_write())
+ *
+ * @param[in] shard pointer to the sharded kvs
+ * @param[in] key
+ * @param[in] value
+ * @param[in] len value length
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_shard_write(const struct kvs_shard *shard, const char *key,
+		    const void *value, size_t len);
+
+/**
+ * @brief write part of a value in the sharded kvs (see kvs_write_at())
+ *
+ * @param[in] shard pointer to the sharded kvs
+ * @param[in] key
+ * @param[in] off offset in the value
+ * @param[in] data
+ * @param[in] len data length
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_shard_write_at(const struct kvs_shard *shard, const char *key,
+		       uint32_t off, const void *data, size_t len);
+
+/**
+ * @brief delete a key from the sharded kvs
+ *
+ * @param[in] shard pointer to the sharded kvs
+ * @param[in] key
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_shard_delete(const struct kvs_shard *shard, const char *key);
+
+/**
+ * @brief walk over the entries of all shards that start with key (see
+ *        kvs_walk()). Walking can be stopped by returning KVS_DONE from the
+ *        callback.
+ *
+ * @param[in] shard pointer to the sharded kvs
+ * @param[in] key
+ * @param[in] cb callback function
+ * @param[in] cb_arg callback function argument
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_shard_walk(const struct kvs_shard *shard, const char *key,
+		   int (*cb)(struct kvs_ent *ent, void *cb_arg), void *cb_arg);
+
+/**
+ * @brief walk over the last entry of each key in all shards that starts
+ *        with key (see kvs_walk_unique()). Walking can be stopped by
+ *        returning KVS_DONE from the callback.
+ *
+ * @param[in] shard pointer to the sharded kvs
+ * @param[in] key
+ * @param[in] cb callback function
+ * @param[in] cb_arg callback function argument
+ *
+ * @return 0 on success, negative errorcode on error
+ */
+int kvs_shard_walk_unique(const struct kvs_shard *shard, const char *key,
+			  int (*cb)(struct kvs_ent *ent, void *cb_arg),
+			  void *cb_arg);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* KVS_SHARD_H_ */
@@ -14,6 +14,35 @@
 #define entry_set_len(ent, klen, vlen) (ent->he_hdr =			       \
 	((vlen & KVS_HDRVALMASK) << KVS_HDRVALSHIFT) |			       \
 	((klen & KVS_HDRKEYMASK) << KVS_HDRKEYSHIFT))
+/* stored value length (differs from entry_get_vlen() for packed entries) */
+#define entry_get_slen(ent) ((ent->he_hdr >> KVS_HDRVALSHIFT) & KVS_HDRVALMASK)
+/* marks a entry of the segment in use in the index of a segment build */
+#define KVS_SEGOLD 0x80000000U
+/* header of a write buffer record: key length (1 byte), value length (le16)
+ * and state (1 byte)
+ */
+#define KVS_WBUFHDRSIZE 4U
+/* reference to a dictionary key at the start of a stored key: KVS_KEYREF
+ * followed by the index of the dictionary key (a key never starts with 0)
+ */
+#define KVS_KEYREF 0x00U
+#define KVS_KEYREFSIZE 2U
+/* numeric key: KVS_KEYREF, KVS_KEYID (not a dictionary index) and the id
+ * (2 byte)
+ */
+#define KVS_KEYID 0xFFU
+#define KVS_KEYIDSIZE 4U
+/* key hash of the defaults table (FNV-1a) */
+#define KVS_FNV_OFFSET 0x811c9dc5U
+#define KVS_FNV_PRIME 0x01000193U
+
+/* update a statistics counter (when statistics are collected) */
+#define kvs_stat_add(kvs, cnt, n)					       \
+	do {								       \
+		if ((kvs)->data->stats != NULL) {			       \
+			(kvs)->data->stats->cnt += (n);			       \
+		}							       \
+	} while (0)
 
 static int kvs_dev_init(const struct kvs *kvs)
 {
@@ -40,12 +69,16 @@ static int kvs_dev_release(const struct kvs *kvs)
 static int kvs_dev_lock(const struct kvs *kvs)
 {
 	const struct kvs_cfg *cfg = kvs->cfg;
+	int rc;
 
 	if (cfg->lock == NULL) {
 		return 0;
 	}
 
-	return cfg->lock(cfg->ctx);
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_DEV_LOCK, 0U);
+	rc = cfg->lock(cfg->ctx);
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_DEV_LOCK, rc);
+	return rc;
 }
 
 static int kvs_dev_unlock(const struct kvs *kvs)
@@ -59,43 +92,95 @@ static int kvs_dev_unlock(const struct kvs *kvs)
 	return cfg->unlock(cfg->ctx);
 }
 
-static int kvs_dev_sync(const struct kvs *kvs)
+static int kvs_dev_rdlock(const struct kvs *kvs)
+{
+	const struct kvs_cfg *cfg = kvs->cfg;
+	int rc;
+
+	if (cfg->rdlock == NULL) {
+		return 0;
+	}
+
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_DEV_LOCK, 0U);
+	rc = cfg->rdlock(cfg->ctx);
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_DEV_LOCK, rc);
+	return rc;
+}
+
+static int kvs_dev_rdunlock(const struct kvs *kvs)
 {
 	const struct kvs_cfg *cfg = kvs->cfg;
 
+	if (cfg->rdunlock == NULL) {
+		return 0;
+	}
+
+	return cfg->rdunlock(cfg->ctx);
+}
+
+static int kvs_dev_sync_at(const struct kvs *kvs, uint32_t off)
+{
+	const struct kvs_cfg *cfg = kvs->cfg;
+	int rc;
+
 	if (cfg->sync == NULL) {
 		return 0;
 	}
 
-	return cfg->sync(cfg->ctx, kvs->data->pos);
+	kvs_stat_add(kvs, syncs, 1U);
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_DEV_SYNC, 0U);
+	rc = cfg->sync(cfg->ctx, off);
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_DEV_SYNC, rc);
+	return rc;
+}
+
+static int kvs_dev_sync(const struct kvs *kvs)
+{
+	return kvs_dev_sync_at(kvs, kvs->data->pos);
 }
 
 static int kvs_dev_read(const struct kvs *kvs, uint32_t off, void *data,
 			size_t len)
 {
 	const struct kvs_cfg *cfg = kvs->cfg;
+	int rc;
 
-	return cfg->read(cfg->ctx, off, data, len);
+	kvs_stat_add(kvs, reads, 1U);
+	kvs_stat_add(kvs, rd_bytes, len);
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_DEV_READ, len);
+	rc = cfg->read(cfg->ctx, off, data, len);
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_DEV_READ, rc);
+	return rc;
 }
 
 static int kvs_dev_prog(const struct kvs *kvs, uint32_t off, const void *data,
 			size_t len)
 {
 	const struct kvs_cfg *cfg = kvs->cfg;
+	int rc;
 
-	return cfg->prog(cfg->ctx, off, data, len);
+	kvs_stat_add(kvs, progs, 1U);
+	kvs_stat_add(kvs, prog_bytes, len);
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_DEV_PROG, len);
+	rc = cfg->prog(cfg->ctx, off, data, len);
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_DEV_PROG, rc);
+	return rc;
 }
 
 static int kvs_dev_comp(const struct kvs *kvs, uint32_t off, const void *data,
 			size_t len)
 {
 	const struct kvs_cfg *cfg = kvs->cfg;
+	int rc;
 
 	if (cfg->comp == NULL) {
 		return 0;
 	}
 
-	return cfg->comp(cfg->ctx, off, data, len);
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_DEV_COMP, len);
+	rc = cfg->comp(cfg->ctx, off, data, len);
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_DEV_COMP, rc);
+	return rc;
 }
 
 static uint32_t get_le32(const uint8_t *buf)
@@ -112,6 +197,17 @@ static void put_le32(uint8_t *buf, uint32_t value)
 	buf[3] = (uint8_t)((value & 0xff000000) >> 24);
 }
 
+static uint32_t get_le16(const uint8_t *buf)
+{
+	return (uint32_t)buf[0] + ((uint32_t)buf[1] << 8);
+}
+
+static void put_le16(uint8_t *buf, uint32_t value)
+{
+	buf[0] = (uint8_t)(value & 0x00ff);
+	buf[1] = (uint8_t)((value & 0xff00) >> 8);
+}
+
 static uint8_t crc8(uint8_t crc, const void *buf, size_t len)
 {
 	static const uint8_t kvs_crc8_ccitt_table[16] = {
@@ -280,12 +376,26 @@ end:
 }
 
 
-static uint32_t entry_hdr_add_crc(uint32_t d)
+/* add the type and the crc8 over the lengths and type to a header */
+static uint32_t entry_hdr_add_crc(uint32_t d, uint8_t type)
 {
-	uint32_t e = (d & 0xffffff);
+	uint32_t e = (d & 0xffffff) |
+		     ((uint32_t)(type & KVS_HDRTYPEMASK) << KVS_HDRTYPESHIFT);
 	uint8_t crc = crc8(0, &e, 4);
 
-	return d | (crc << 24);
+	return e | ((uint32_t)crc << KVS_HDRCRCSHIFT);
+}
+
+/* get the entry type (KVS_TYPE_CNT when the header crc does not match) */
+static uint8_t entry_hdr_get_type(uint32_t he_hdr)
+{
+	const uint8_t type = (he_hdr >> KVS_HDRTYPESHIFT) & KVS_HDRTYPEMASK;
+
+	if (entry_hdr_add_crc(hdr_get_data(he_hdr), type) != he_hdr) {
+		return KVS_TYPE_CNT;
+	}
+
+	return type;
 }
 
 /* get lengths from entry header */
@@ -294,17 +404,23 @@ static int entry_get_param(struct kvs_ent *ent, const uint8_t *hdr)
 	const uint32_t psz = ent->kvs->cfg->psz;
 	uint32_t he_hdr;
 	uint32_t next;
+	uint8_t type;
 	int rc = 0;
 
 	he_hdr = get_le32(hdr);
-	if (he_hdr != entry_hdr_add_crc(hdr_get_data(he_hdr))) {
+	type = entry_hdr_get_type(he_hdr);
+	if (type >= KVS_TYPE_CNT) {
 		rc = -KVS_EINVAL;
 		goto end;
 	}
 	
 	ent->he_hdr = he_hdr;
+	ent->type = type;
+	ent->vlen = entry_get_slen(ent);
+	ent->pcnt = 0U;
+	ent->zpos = 0U;
 	next = ent->start + KVS_HDRSIZE + KVS_KVCRCSIZE - 1U;
-	next += entry_get_klen(ent) + entry_get_vlen(ent);
+	next += entry_get_klen(ent) + entry_get_slen(ent);
 	next = KVS_ALIGNDOWN(next, psz) + psz;
 
 	if ((next > ent->next) || (next < ent->start)) {
@@ -338,7 +454,7 @@ static bool entry_kvcrc_ok(const struct kvs_ent *ent)
 {
 	uint32_t kvcrc32 = KVS_KVCRCINIT;
 	uint32_t off = 0;
-	size_t len =  entry_get_klen(ent) + entry_get_vlen(ent);
+	size_t len =  entry_get_klen(ent) + entry_get_slen(ent);
 
 	while (len != 0) {
 		uint8_t buf[KVS_BUFSIZE];
@@ -367,6 +483,350 @@ end:
 	return false;
 }
 
+/* get the uncompressed value length of a packed entry */
+static int entry_get_packed_vlen(struct kvs_ent *ent)
+{
+	uint8_t buf[KVS_PACKLENSIZE];
+	int rc;
+
+	if (entry_get_slen(ent) < KVS_PACKLENSIZE) {
+		return -KVS_EINVAL;
+	}
+
+	rc = entry_data_read(ent, entry_get_klen(ent), buf, sizeof(buf));
+	if (rc != 0) {
+		return rc;
+	}
+
+	ent->vlen = get_le16(buf);
+	return 0;
+}
+
+/* get the value length, chunk size and generation of a chunk directory */
+static int entry_get_cdir(const struct kvs_ent *ent, uint32_t *vlen,
+			  uint32_t *csz, uint8_t *gen)
+{
+	uint8_t buf[KVS_CDIRSIZE];
+	int rc;
+
+	if (entry_get_slen(ent) != KVS_CDIRSIZE) {
+		return -KVS_EINVAL;
+	}
+
+	rc = entry_data_read(ent, entry_get_klen(ent), buf, sizeof(buf));
+	if (rc != 0) {
+		return rc;
+	}
+
+	*vlen = get_le32(buf);
+	*csz = get_le16(&buf[4]);
+	*gen = buf[6];
+	return (*csz == 0U) ? -KVS_EINVAL : 0;
+}
+
+/* get the stream size and uncompressed size (ulen) of a packed token */
+static uint32_t pack_token_size(const uint8_t *tok, uint32_t *ulen)
+{
+	if ((tok[0] & 0x80) == 0U) {
+		*ulen = (uint32_t)tok[0] + 1U;
+		return 1U + *ulen;
+	}
+
+	if ((tok[0] & 0x40) == 0U) {
+		*ulen = (uint32_t)(tok[0] & 0x3f) + KVS_PACKRUNMIN;
+		return 2U;
+	}
+
+	*ulen = (uint32_t)(tok[0] & 0x3f) + KVS_PACKCPYMIN;
+	return 3U;
+}
+
+/* read from a packed value at offset off (from value start). The token of
+ * the last read is kept in the entry, a read that does not start before it
+ * continues the decode there instead of at the start of the value.
+ */
+static int entry_unpack(const struct kvs_ent *ent, uint32_t off, uint8_t *data,
+			size_t len)
+{
+	struct kvs_ent *cur = (struct kvs_ent *)ent;
+	const uint32_t zstart = entry_get_klen(ent) + KVS_PACKLENSIZE;
+	const uint32_t zend = entry_get_klen(ent) + entry_get_slen(ent);
+	uint32_t zpos = zstart;
+	uint32_t upos = 0U;
+	int rc = 0;
+
+	if ((off + len) > entry_get_vlen(ent)) {
+		return -KVS_EINVAL;
+	}
+
+	if ((ent->zpos > zstart) && (ent->zpos < zend) && (ent->upos <= off)) {
+		zpos = ent->zpos;
+		upos = ent->upos;
+	}
+
+	while (len != 0U) {
+		uint8_t tok[3];
+		uint32_t tsize, ulen;
+
+		rc = entry_data_read(ent, zpos, tok, sizeof(tok));
+		if (rc != 0) {
+			goto end;
+		}
+
+		tsize = pack_token_size(tok, &ulen);
+		if ((zpos + tsize) > zend) {
+			rc = -KVS_EINVAL;
+			goto end;
+		}
+
+		if ((upos + ulen) > off) {
+			const uint32_t skip = off - upos;
+			const uint32_t cplen = KVS_MIN(ulen - skip, len);
+			const uint32_t src = zstart + get_le16(&tok[1]);
+
+			if ((tok[0] & 0x80) == 0U) {
+				rc = entry_data_read(ent, zpos + 1U + skip, data,
+						     cplen);
+			} else if ((tok[0] & 0x40) == 0U) {
+				memset(data, tok[1], cplen);
+			} else if ((src + ulen) > zend) {
+				rc = -KVS_EINVAL;
+			} else {
+				rc = entry_data_read(ent, src + skip, data,
+						     cplen);
+			}
+
+			if (rc != 0) {
+				goto end;
+			}
+
+			cur->zpos = zpos;
+			cur->upos = upos;
+			data += cplen;
+			off += cplen;
+			len -= cplen;
+		}
+
+		upos += ulen;
+		zpos += tsize;
+	}
+
+end:
+	return rc;
+}
+
+/* read entry data (key and value) of a packed entry */
+static int entry_data_unpack(const struct kvs_ent *ent, uint32_t off,
+			     void *data, size_t len)
+{
+	const uint32_t klen = entry_get_klen(ent);
+	uint8_t *data8 = (uint8_t *)data;
+	int rc;
+
+	if (off < klen) {
+		const size_t rdlen = KVS_MIN(len, klen - off);
+
+		rc = entry_data_read(ent, off, data8, rdlen);
+		if (rc != 0) {
+			return rc;
+		}
+
+		data8 += rdlen;
+		off += rdlen;
+		len -= rdlen;
+	}
+
+	if (len == 0U) {
+		return 0;
+	}
+
+	return entry_unpack(ent, off - klen, data8, len);
+}
+
+/* a entry that is read in parts (see read_cb_value()): the patches are found
+ * by the first read, the following reads apply them from the list.
+ */
+struct value_rd {
+	const struct kvs_ent *ent;
+	uint32_t pcnt;			/* patches in ppos (0 when not found) */
+	uint32_t ppos[KVS_PATCHMAX];	/* patch positions (oldest first) */
+};
+
+static int entry_patch(const struct kvs_ent *ent, struct value_rd *vr,
+		       uint32_t off, void *data, size_t len);
+static int entry_data_chunks(const struct kvs_ent *ent, uint32_t off,
+			     void *data, size_t len);
+
+/* read entry data (key and value) for the reader vr (NULL for a single read),
+ * packed values are decompressed, patches are applied and chunked values are
+ * gathered.
+ */
+static int entry_value_get(const struct kvs_ent *ent, struct value_rd *vr,
+			   uint32_t off, void *data, size_t len)
+{
+	int rc;
+
+	if (ent->type == KVS_TYPE_CDIR) {
+		return entry_data_chunks(ent, off, data, len);
+	}
+
+	if (ent->type == KVS_TYPE_PACKED) {
+		rc = entry_data_unpack(ent, off, data, len);
+	} else {
+		rc = entry_data_read(ent, off, data, len);
+	}
+
+	if ((rc == 0) && (ent->pcnt != 0U)) {
+		rc = entry_patch(ent, vr, off, data, len);
+	}
+
+	return rc;
+}
+
+static int entry_data_get(const struct kvs_ent *ent, uint32_t off, void *data,
+			  size_t len)
+{
+	return entry_value_get(ent, NULL, off, data, len);
+}
+
+struct pack_literal {
+	uint32_t spos;		/* position in the uncompressed data */
+	uint32_t zpos;		/* position in the stream */
+	uint32_t len;
+};
+
+struct pack_state {
+	const uint8_t *src;	/* uncompressed data */
+	uint32_t len;		/* uncompressed length */
+	uint32_t size;		/* packed size (set by pack_size()) */
+	uint32_t spos;		/* uncompressed position of the next token */
+	uint32_t zpos;		/* stream position of the next token */
+	uint32_t rdpos;		/* packed bytes returned by read_cb_pack() */
+	uint8_t tok[3];		/* current token header */
+	uint32_t tsize;		/* current token header size */
+	uint32_t lstart;	/* current token literal start */
+	uint32_t llen;		/* current token literal length */
+	uint32_t tpos;		/* bytes returned of the current token */
+	struct pack_literal lit[KVS_PACKHIST];
+	uint32_t litcnt;
+};
+
+static void pack_init(struct pack_state *pack, const void *src, uint32_t len)
+{
+	memset(pack, 0, sizeof(struct pack_state));
+	pack->src = (const uint8_t *)src;
+	pack->len = len;
+}
+
+static uint32_t pack_run(const struct pack_state *pack, uint32_t pos)
+{
+	const uint32_t end = KVS_MIN(pack->len, pos + KVS_PACKRUNMAX);
+	uint32_t i = pos + 1U;
+
+	while ((i < end) && (pack->src[i] == pack->src[pos])) {
+		i++;
+	}
+
+	return i - pos;
+}
+
+/* find the longest match for pos in the literals already in the stream */
+static uint32_t pack_match(const struct pack_state *pack, uint32_t pos,
+			   uint32_t *zsrc)
+{
+	const uint32_t max = KVS_MIN(pack->len - pos, KVS_PACKCPYMAX);
+	const uint32_t cnt = KVS_MIN(pack->litcnt, KVS_PACKHIST);
+	uint32_t best = 0U;
+
+	for (uint32_t i = 0; i < cnt; i++) {
+		const struct pack_literal *lit = &pack->lit[i];
+
+		for (uint32_t j = 0; (j + best) < lit->len; j++) {
+			const uint8_t *cmp = pack->src + lit->spos + j;
+			const uint32_t cmpmax = KVS_MIN(max, lit->len - j);
+			uint32_t mlen = 0U;
+
+			while ((mlen < cmpmax) &&
+			       (cmp[mlen] == pack->src[pos + mlen])) {
+				mlen++;
+			}
+
+			if (mlen > best) {
+				best = mlen;
+				*zsrc = lit->zpos + j;
+			}
+		}
+	}
+
+	return best;
+}
+
+/* prepare the next token, returns the token size in the stream (0 if done) */
+static uint32_t pack_next(struct pack_state *pack)
+{
+	const uint32_t pos = pack->spos;
+	uint32_t ulen, zsrc;
+
+	pack->tsize = 0U;
+	pack->llen = 0U;
+	pack->tpos = 0U;
+	if (pos >= pack->len) {
+		return 0U;
+	}
+
+	ulen = pack_run(pack, pos);
+	if (ulen >= KVS_PACKRUNMIN) {
+		pack->tok[0] = (uint8_t)(0x80 | (ulen - KVS_PACKRUNMIN));
+		pack->tok[1] = pack->src[pos];
+		pack->tsize = 2U;
+		goto end;
+	}
+
+	ulen = pack_match(pack, pos, &zsrc);
+	if (ulen >= KVS_PACKCPYMIN) {
+		pack->tok[0] = (uint8_t)(0xc0 | (ulen - KVS_PACKCPYMIN));
+		put_le16(&pack->tok[1], zsrc);
+		pack->tsize = 3U;
+		goto end;
+	}
+
+	ulen = 1U;
+	while (((pos + ulen) < pack->len) && (ulen < KVS_PACKLITMAX) &&
+	       (pack_run(pack, pos + ulen) < KVS_PACKRUNMIN) &&
+	       (pack_match(pack, pos + ulen, &zsrc) < KVS_PACKCPYMIN)) {
+		ulen++;
+	}
+
+	pack->tok[0] = (uint8_t)(ulen - 1U);
+	pack->tsize = 1U;
+	pack->lstart = pos;
+	pack->llen = ulen;
+
+	/* the literal can be used as copy source for the following tokens */
+	struct pack_literal *lit = &pack->lit[pack->litcnt % KVS_PACKHIST];
+
+	lit->spos = pos;
+	lit->zpos = pack->zpos + 1U;
+	lit->len = ulen;
+	pack->litcnt++;
+end:
+	pack->spos += ulen;
+	pack->zpos += pack->tsize + pack->llen;
+	return pack->tsize + pack->llen;
+}
+
+static uint32_t pack_size(struct pack_state *pack)
+{
+	uint32_t tsize;
+
+	pack->size = KVS_PACKLENSIZE;
+	do {
+		tsize = pack_next(pack);
+		pack->size += tsize;
+	} while (tsize != 0U);
+
+	return pack->size;
+}
 
 static int entry_get_info(struct kvs_ent *ent)
 {
@@ -382,28 +842,54 @@ static int entry_get_info(struct kvs_ent *ent)
 		goto end;
 	};
 
+	if ((ent->type == KVS_TYPE_PACKED) && (entry_get_packed_vlen(ent) != 0)) {
+		goto end;
+	}
+
+	if (ent->type == KVS_TYPE_CDIR) {
+		uint32_t csz;
+		uint8_t gen;
+
+		if (entry_get_cdir(ent, &ent->vlen, &csz, &gen) != 0) {
+			goto end;
+		}
+
+	}
+
 	return 0;
 end:
 	return -KVS_ENOENT;
 }
 
-static int entry_set_info(struct kvs_ent *ent, uint8_t *hdr, uint8_t key_len,
-			  uint16_t val_len)
+/* get the space a entry occupies in memory */
+static uint32_t entry_space(const struct kvs *kvs, uint32_t key_len,
+			    uint32_t val_len)
+{
+	const size_t wbs = kvs->cfg->psz;
+	uint32_t space;
+
+	space = KVS_HDRSIZE + key_len + val_len + KVS_KVCRCSIZE - 1;
+	return KVS_ALIGNDOWN(space, wbs) + wbs;
+}
+
+static int entry_set_info(struct kvs_ent *ent, uint8_t *hdr, uint8_t type,
+			  uint8_t key_len, uint16_t val_len)
 {
-	const size_t wbs = ent->kvs->cfg->psz;
 	struct kvs_data *data = ent->kvs->data;
 	uint32_t req_space;
 	
-	req_space = KVS_HDRSIZE + key_len + val_len + KVS_KVCRCSIZE - 1;
-	req_space = KVS_ALIGNDOWN(req_space, wbs) + wbs;
+	req_space = entry_space(ent->kvs, key_len, val_len);
 	if (req_space > (data->bend - data->pos)) {
 		return -KVS_ENOSPC;
 	}
 
 	ent->start = data->pos;
 	ent->next = ent->start + req_space;
+	ent->type = type;
+	ent->vlen = val_len;
+	ent->zpos = 0U;
 	entry_set_len(ent, key_len, val_len);
-	ent->he_hdr = entry_hdr_add_crc(ent->he_hdr);
+	ent->he_hdr = entry_hdr_add_crc(ent->he_hdr, type);
 	put_le32(hdr, ent->he_hdr);
 	data->pos = ent->next;
 	return 0;
@@ -431,19 +917,57 @@ static void wblock_advance(const struct kvs *kvs)
 	const size_t bsz = kvs->cfg->bsz;
 	struct kvs_data *data = kvs->data;
 
+	/* seq is odd while bend and pos are updated, readers that run without
+	 * lock redo their work when it changes (see kvs_seq_begin()).
+	 */
+	(void)__atomic_add_fetch(&data->seq, 1U, __ATOMIC_SEQ_CST);
 	data->bend = block_advance_n(kvs, data->bend, 1);
 	data->pos = data->bend - bsz;
 	if (data->pos == 0U) {
 		data->wrapcnt++;
 	}
 
+	(void)__atomic_add_fetch(&data->seq, 1U, __ATOMIC_SEQ_CST);
+
+	if (data->blive != NULL) {
+		data->blive[data->pos / bsz] = 0U;
+	}
+
+}
+
+/* set the seq at which the block of a entry is reused by writes */
+static void entry_set_seq(struct kvs_ent *ent)
+{
+	const struct kvs *kvs = ent->kvs;
+	const uint32_t bsz = kvs->cfg->bsz;
+	const uint32_t bcnt = kvs->cfg->bcnt;
+	const uint32_t cur = (kvs->data->bend - bsz) / bsz;
+	uint32_t adv = ((ent->start / bsz) + bcnt - cur) % bcnt;
+
+	if (adv == 0U) {
+		adv = bcnt;
+	}
+
+	/* each block advance adds 2 to seq */
+	ent->seq = __atomic_load_n(&kvs->data->seq, __ATOMIC_ACQUIRE) +
+		   2U * adv;
+}
+
+/* check (after reading it) that the block of a entry has not been reused */
+static bool entry_seq_ok(const struct kvs_ent *ent)
+{
+	uint32_t seq;
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	seq = __atomic_load_n(&ent->kvs->data->seq, __ATOMIC_RELAXED);
+	return (int32_t)(ent->seq - seq) > 0;
 }
 
 struct read_cb {
 	const void *ctx;
 	uint32_t off;
 	size_t len;
-	int (*read)(const void *ctx, uint32_t off, void *data, uint32_t len);
+	int (*read)(const void *ctx, uint32_t off, void *data, size_t len);
 };
 
 static int read_cb_entry(const void *ctx, uint32_t off, void *data,
@@ -462,52 +986,276 @@ static int read_cb_ptr(const void *ctx, uint32_t off, void *data, size_t len)
 	return 0;
 }
 
-static int entry_write_data(struct kvs_ent *ent, uint32_t dstart,
-			    const struct read_cb *drd_cb, uint32_t *crc)
-{
-	uint32_t len, off;
-	uint8_t buf[KVS_BUFSIZE];
-	int rc = 0;
-
-	len = drd_cb->len;
-	off = 0U;
-	while (len != 0) {
-		uint32_t rwlen = KVS_MIN(len, sizeof(buf));
-		rc = drd_cb->read(drd_cb->ctx, drd_cb->off + off, buf, rwlen);
-		if (rc != 0) {
-			goto end;
-		}
+/* a key as it is stored: the longest dictionary key that starts the key is
+ * replaced by a reference
+ */
+struct key_enc {
+	const char *key;		/* key */
+	uint32_t dlen;			/* length of the dictionary key (0 when
+					 * the key has no reference)
+					 */
+	uint8_t ref[KVS_KEYREFSIZE];	/* reference to the dictionary key */
+};
 
-		*crc = crc32(*crc, buf, rwlen);
-		rc = entry_write(ent, dstart + off, buf, rwlen);
-		if (rc != 0) {
-			goto end;
-		}
+static int read_cb_key(const void *ctx, uint32_t off, void *data, size_t len)
+{
+	const struct key_enc *enc = (const struct key_enc *)ctx;
+	uint8_t *data8 = (uint8_t *)data;
 
-		off += rwlen;
-		len -= rwlen;
+	while ((len != 0U) && (off < KVS_KEYREFSIZE)) {
+		*data8++ = enc->ref[off++];
+		len--;
 	}
 
-end:
-	return rc;
+	memcpy(data8, enc->key + enc->dlen + off - KVS_KEYREFSIZE, len);
+	return 0;
 }
 
-static int entry_write_hdr(struct kvs_ent *ent, uint32_t key_len,
-			   uint32_t val_len)
+/* find the longest dictionary key that starts the key */
+static void key_find(const struct kvs *kvs, const char *key, size_t klen,
+		     struct key_enc *enc)
 {
-	uint8_t hdr[KVS_HDRSIZE];
-	int rc;
+	const struct kvs_keydict *dict = kvs->data->keydict;
+
+	enc->key = key;
+	enc->dlen = 0U;
+	enc->ref[0] = KVS_KEYREF;
+	enc->ref[1] = 0U;
+	if (dict == NULL) {
+		return;
+	}
 
-	rc = entry_set_info(ent, hdr, key_len, val_len);
+	for (uint32_t i = 0U; i < dict->cnt; i++) {
+		const size_t dlen = strlen(dict->key[i]);
+
+		if ((dlen > enc->dlen) && (dlen <= klen) &&
+		    (memcmp(dict->key[i], key, dlen) == 0)) {
+			enc->dlen = dlen;
+			enc->ref[1] = (uint8_t)i;
+		}
+
+	}
+
+}
+
+/* get the read callback of the stored key */
+static void key_rdcb(const struct key_enc *enc, size_t klen,
+		     struct read_cb *rdkey)
+{
+	rdkey->off = 0U;
+	if (enc->dlen == 0U) {
+		rdkey->ctx = (void *)enc->key;
+		rdkey->len = klen;
+		rdkey->read = read_cb_ptr;
+		return;
+	}
+
+	rdkey->ctx = (void *)enc;
+	rdkey->len = klen - enc->dlen + KVS_KEYREFSIZE;
+	rdkey->read = read_cb_key;
+}
+
+static void key_encode(const struct kvs *kvs, const char *key, size_t klen,
+		       struct key_enc *enc, struct read_cb *rdkey)
+{
+	key_find(kvs, key, klen, enc);
+	key_rdcb(enc, klen, rdkey);
+}
+
+/* encode a prefix of keys, returns false when the stored keys that start
+ * with the prefix can not be found by comparing with the encoded prefix (a
+ * longer dictionary key starts with the prefix).
+ */
+static bool key_encode_prefix(const struct kvs *kvs, const char *key,
+			      size_t klen, struct key_enc *enc,
+			      struct read_cb *rdkey)
+{
+	const struct kvs_keydict *dict = kvs->data->keydict;
+
+	key_encode(kvs, key, klen, enc, rdkey);
+	if (dict == NULL) {
+		return true;
+	}
+
+	for (uint32_t i = 0U; i < dict->cnt; i++) {
+		if ((strlen(dict->key[i]) > klen) &&
+		    (memcmp(dict->key[i], key, klen) == 0)) {
+			return false;
+		}
+
+	}
+
+	return true;
+}
+
+/* get the stored key and its read callback for a numeric key */
+static void key_id(uint16_t id, uint8_t *buf, struct read_cb *rdkey)
+{
+	buf[0] = KVS_KEYREF;
+	buf[1] = KVS_KEYID;
+	put_le16(&buf[2], id);
+	rdkey->ctx = (void *)buf;
+	rdkey->off = 0U;
+	rdkey->len = KVS_KEYIDSIZE;
+	rdkey->read = read_cb_ptr;
+}
+
+static int read_cb_value(const void *ctx, uint32_t off, void *data,
+			 size_t len)
+{
+	struct value_rd *vr = (struct value_rd *)(ctx);
+
+	return entry_value_get(vr->ent, vr, off, data, len);
+}
+
+struct chunk_key {
+	struct read_cb key;		/* key of the chunked value */
+	uint8_t sfx[KVS_CHUNKSFXSIZE];	/* 0, generation, index (2 byte) */
+	uint32_t wrapcnt;		/* wrap counter at write start */
+	uint32_t pos;			/* position at write start */
+};
+
+static int read_cb_chunk_key(const void *ctx, uint32_t off, void *data,
+			     size_t len)
+{
+	const struct chunk_key *ck = (const struct chunk_key *)ctx;
+	uint8_t *data8 = (uint8_t *)data;
+	int rc;
+
+	if (off < ck->key.len) {
+		const size_t rdlen = KVS_MIN(len, ck->key.len - off);
+
+		rc = ck->key.read(ck->key.ctx, ck->key.off + off, data8, rdlen);
+		if (rc != 0) {
+			return rc;
+		}
+
+		data8 += rdlen;
+		off += rdlen;
+		len -= rdlen;
+	}
+
+	memcpy(data8, &ck->sfx[off - ck->key.len], len);
+	return 0;
+}
+
+static void chunk_key_init(struct chunk_key *ck, struct read_cb *rdkey,
+			   uint8_t gen, uint32_t idx)
+{
+	ck->sfx[0] = 0U;
+	ck->sfx[1] = gen;
+	put_le16(&ck->sfx[2], idx);
+	rdkey->ctx = (void *)ck;
+	rdkey->off = 0U;
+	rdkey->len = ck->key.len + KVS_CHUNKSFXSIZE;
+	rdkey->read = read_cb_chunk_key;
+}
+
+/* sequential read of the packed stream (uncompressed length + tokens) */
+static int read_cb_pack(const void *ctx, uint32_t off, void *data, size_t len)
+{
+	struct pack_state *pack = (struct pack_state *)ctx;
+	uint8_t *data8 = (uint8_t *)data;
+
+	if (off != pack->rdpos) {
+		return -KVS_EINVAL;
+	}
+
+	while (len != 0U) {
+		if (pack->rdpos < KVS_PACKLENSIZE) {
+			*data8 = (uint8_t)(pack->len >> (8 * pack->rdpos));
+		} else {
+			if ((pack->tpos == (pack->tsize + pack->llen)) &&
+			    (pack_next(pack) == 0U)) {
+				return -KVS_EINVAL;
+			}
+
+			if (pack->tpos < pack->tsize) {
+				*data8 = pack->tok[pack->tpos];
+			} else {
+				*data8 = pack->src[pack->lstart + pack->tpos -
+						   pack->tsize];
+			}
+
+			pack->tpos++;
+		}
+
+		pack->rdpos++;
+		data8++;
+		len--;
+	}
+
+	return 0;
+}
+
+static int entry_write_data(struct kvs_ent *ent, uint32_t dstart,
+			    const struct read_cb *drd_cb, uint32_t *crc)
+{
+	uint32_t len, off;
+	uint8_t buf[KVS_BUFSIZE];
+	int rc = 0;
+
+	len = drd_cb->len;
+	off = 0U;
+	while (len != 0) {
+		uint32_t rwlen = KVS_MIN(len, sizeof(buf));
+		rc = drd_cb->read(drd_cb->ctx, drd_cb->off + off, buf, rwlen);
+		if (rc != 0) {
+			goto end;
+		}
+
+		*crc = crc32(*crc, buf, rwlen);
+		rc = entry_write(ent, dstart + off, buf, rwlen);
+		if (rc != 0) {
+			goto end;
+		}
+
+		off += rwlen;
+		len -= rwlen;
+	}
+
+end:
+	return rc;
+}
+
+static int entry_write_hdr(struct kvs_ent *ent, uint8_t type,
+			   uint32_t key_len, uint32_t val_len)
+{
+	uint8_t hdr[KVS_HDRSIZE];
+	int rc;
+
+	rc = entry_set_info(ent, hdr, type, key_len, val_len);
 	if (rc != 0) {
 		goto end;
 	}
 
+	/* memory that is overwritten keeps old entries after the write
+	 * position: the end is marked after the entry and the header is
+	 * written last (entry_write_commit()), so a interrupted write can not
+	 * make a old entry reappear.
+	 */
+	if (ent->kvs->data->inplace) {
+		rc = kvs_dev_sync_at(ent->kvs, ent->next);
+		goto end;
+	}
+
 	rc = entry_write(ent, 0, hdr, KVS_HDRSIZE);
 end:
 	return rc;
 }
 
+static int entry_write_commit(struct kvs_ent *ent)
+{
+	uint8_t hdr[KVS_HDRSIZE];
+
+	if (!ent->kvs->data->inplace) {
+		return 0;
+	}
+
+	put_le32(hdr, ent->he_hdr);
+	return entry_write(ent, 0, hdr, KVS_HDRSIZE);
+}
+
 static int entry_write_crc(struct kvs_ent *ent, uint32_t off, uint32_t crc)
 {
 	uint8_t buf[KVS_KVCRCSIZE];
@@ -525,6 +1273,12 @@ end:
 	return rc;
 }
 
+/* check if appends are synced once at the end of a write buffer flush */
+static bool sync_deferred(const struct kvs *kvs)
+{
+	return (kvs->data->wbuf != NULL) && (kvs->data->wbuf->flushing);
+}
+
 static int kvs_meta_write(const struct kvs *kvs)
 {
 	if ((kvs->data->pos & (kvs->cfg->bsz - 1)) != 0) {
@@ -538,8 +1292,20 @@ static int kvs_meta_write(const struct kvs *kvs)
 	uint32_t off = 0U;
 	uint32_t metacrc = KVS_KVCRCINIT;
 	int rc;
-	
-	rc = entry_write_hdr(&meta, 0U, KVS_WRAPCNTSIZE + kvs->data->csz);
+
+	/* starting a block can erase it, the entries that are not synced
+	 * (e.g. copies of entries in the erased block) are synced first.
+	 */
+	if (sync_deferred(kvs)) {
+		rc = kvs_dev_sync(kvs);
+		if (rc != 0) {
+			goto end;
+		}
+
+	}
+
+	rc = entry_write_hdr(&meta, KVS_TYPE_META, 0U,
+			     KVS_WRAPCNTSIZE + kvs->data->csz);
 	if (rc != 0) {
 		goto end;
 	}
@@ -563,23 +1329,33 @@ static int kvs_meta_write(const struct kvs *kvs)
 	}
 
 	rc = entry_write_crc(&meta, off, metacrc);
+	if (rc != 0) {
+		goto end;
+	}
+
+	rc = entry_write_commit(&meta);
 end:
 	return rc;
 }
 
-static int entry_append(struct kvs_ent *ent, const struct read_cb *krd_cb,
-			const struct read_cb *vrd_cb)
+static const struct kvs_ent *blive_find(struct kvs_ent *old,
+					const struct read_cb *rdkey);
+static bool blive_replaced(const struct kvs_ent *ent,
+			   const struct kvs_ent *old);
+static void blive_add(const struct kvs_ent *ent);
+static void blive_release(const struct kvs_ent *old,
+			  const struct read_cb *rdkey);
+
+/* write a entry (header, key, value and crc) at the write position */
+static int entry_write_kv(struct kvs_ent *ent, uint8_t type,
+			  const struct read_cb *krd_cb,
+			  const struct read_cb *vrd_cb)
 {
 	uint32_t off = KVS_HDRSIZE;
 	uint32_t crc = KVS_KVCRCINIT;
 	int rc;
 
-	rc = kvs_meta_write(ent->kvs);
-	if (rc != 0) {
-		goto end;
-	}
-
-	rc = entry_write_hdr(ent, krd_cb->len, vrd_cb->len);
+	rc = entry_write_hdr(ent, type, krd_cb->len, vrd_cb->len);
 	if (rc != 0) {
 		goto end;
 	}
@@ -595,34 +1371,93 @@ static int entry_append(struct kvs_ent *ent, const struct read_cb *krd_cb,
 		goto end;
 	}
 
-	off += entry_get_vlen(ent);
+	off += entry_get_slen(ent);
 	rc = entry_write_crc(ent, off, crc);
 	if (rc != 0) {
 		goto end;
 	}
 
-	rc = kvs_dev_sync(ent->kvs);
+	rc = entry_write_commit(ent);
 end:
 	return rc;
 }
 
-static int entry_add(struct kvs_ent *ent, const char *key, const void *value,
-		     uint32_t val_len)
+/* append a entry, old is the last entry for the key that the caller found
+ * under the lock (NULL when there is none or it is not released).
+ */
+static int entry_append(struct kvs_ent *ent, uint8_t type,
+			const struct read_cb *krd_cb,
+			const struct read_cb *vrd_cb,
+			const struct kvs_ent *old)
 {
-	const struct read_cb krd_cb = {
-		.ctx = (void *)key,
-		.off = 0U,
-		.len = strlen(key),
-		.read = read_cb_ptr,
-	};
-	const struct read_cb vrd_cb = {
+	bool replace;
+	int rc;
+
+	KVS_TRACE_ENTER(ent->kvs, KVS_TRACE_APPEND, krd_cb->len + vrd_cb->len);
+	/* the entry that is replaced (patches do not replace a entry) */
+	replace = (type != KVS_TYPE_PATCH) && blive_replaced(ent, old);
+
+	rc = kvs_meta_write(ent->kvs);
+	if (rc != 0) {
+		goto end;
+	}
+
+	rc = entry_write_kv(ent, type, krd_cb, vrd_cb);
+	if (rc != 0) {
+		goto end;
+	}
+
+	if (!sync_deferred(ent->kvs)) {
+		rc = kvs_dev_sync(ent->kvs);
+		if (rc != 0) {
+			goto end;
+		}
+
+	}
+
+	if (vrd_cb->len != 0U) {
+		blive_add(ent);
+	}
+
+	if (replace) {
+		blive_release(old, krd_cb);
+	}
+
+end:
+	KVS_TRACE_EXIT(ent->kvs, KVS_TRACE_APPEND, rc);
+	return rc;
+}
+
+static int entry_add(struct kvs_ent *ent, const struct read_cb *krd_cb,
+		     const void *value, uint32_t val_len,
+		     const struct kvs_ent *old)
+{
+	struct read_cb vrd_cb = {
 		.ctx = (void *)value,
 		.off = 0U,
 		.len = val_len,
 		.read = read_cb_ptr,
 	};
+	struct pack_state pack;
+	uint8_t type = KVS_TYPE_PLAIN;
+	int rc;
 
-	return entry_append(ent, &krd_cb, &vrd_cb);
+	if ((ent->kvs->data->compress) && (val_len >= KVS_PACKMINLEN) &&
+	    (val_len <= KVS_HDRVALMASK)) {
+		pack_init(&pack, value, val_len);
+		if (pack_size(&pack) < val_len) {
+			vrd_cb.ctx = (void *)&pack;
+			vrd_cb.len = pack.size;
+			vrd_cb.read = read_cb_pack;
+			pack_init(&pack, value, val_len);
+			type = KVS_TYPE_PACKED;
+		}
+
+	}
+
+	rc = entry_append(ent, type, krd_cb, &vrd_cb, old);
+	ent->vlen = val_len;
+	return rc;
 }
 
 static bool differ(const struct read_cb *rda, const struct read_cb *rdb)
@@ -659,25 +1494,34 @@ end:
 	return true;
 }
 
-static int entry_copy(const struct kvs_ent *ent)
+/* copy a entry to the kvs of cp_ent, old as for entry_append() */
+static int entry_copy(struct kvs_ent *cp_ent, const struct kvs_ent *ent,
+		      const struct kvs_ent *old)
 {
+	struct value_rd vr = {
+		.ent = ent,
+	};
 	const struct read_cb krd_cb = {
 		.ctx = (void *)ent,
 		.off = 0U,
 		.len = entry_get_klen(ent),
 		.read = read_cb_entry,
 	};
-	const struct read_cb vrd_cb = {
+	struct read_cb vrd_cb = {
 		.ctx = (void *)ent,
 		.off = entry_get_klen(ent),
-		.len = entry_get_vlen(ent),
+		.len = entry_get_slen(ent),
 		.read = read_cb_entry,
 	};
-	struct kvs_ent cp_ent = {
-		.kvs = ent->kvs,
-	};
 
-	return entry_append(&cp_ent, &krd_cb, &vrd_cb);
+	/* patches are folded into a new entry */
+	if (ent->pcnt != 0U) {
+		vrd_cb.ctx = (void *)&vr;
+		vrd_cb.len = entry_get_vlen(ent);
+		vrd_cb.read = read_cb_value;
+	}
+
+	return entry_append(cp_ent, ent->type, &krd_cb, &vrd_cb, old);
 }
 
 struct entry_cb {
@@ -693,6 +1537,11 @@ static int walk(struct kvs_ent *ent, const struct read_cb *rdkey,
 	uint32_t wrapcnt;
 	int rc = 0;
 
+	/* a stop at the memory end (e.g. a full last block) is the start */
+	if (stop >= end) {
+		stop -= end;
+	}
+
 	do {
 		ent->start = (ent->next < end) ? ent->next : 0U;
 		if (ent->start == stop) {
@@ -719,14 +1568,18 @@ static int walk(struct kvs_ent *ent, const struct read_cb *rdkey,
 		 	.read = read_cb_entry,
 		};
 
-		if (differ(&readkey, rdkey)) {
+		/* a shorter key would compare the prefix with its value */
+		if ((entry_get_klen(ent) < rdkey->len) ||
+		    (differ(&readkey, rdkey))) {
 		 	continue;
 		}
 
 		if (!entry_kvcrc_ok(ent)) {
+			kvs_stat_add(ent->kvs, crc_errors, 1U);
 		 	continue;
 		}
 
+		entry_set_seq(ent);
 		rc = cb->cb(ent, cb->cb_arg);
 		if (rc != 0) {
 			break;
@@ -737,329 +1590,3905 @@ static int walk(struct kvs_ent *ent, const struct read_cb *rdkey,
 	return rc;
 }
 
-struct entry_get_cb_arg {
-	struct kvs_ent *ent;
+struct entry_patch_cb_arg {
+	uint32_t off;
+	uint8_t *data;
+	size_t len;
+	uint32_t pcnt;
+	uint32_t cnt;
 	uint32_t klen;
-	bool found;
+	uint32_t *ppos;
 };
 
-static int entry_get_cb(struct kvs_ent *ent, void *cb_arg)
+/* apply a patch to data read from offset off (from key start) */
+static int patch_apply(const struct kvs_ent *patch, uint32_t off,
+		       uint8_t *data, size_t len)
 {
-	struct entry_get_cb_arg *rv = (struct entry_get_cb_arg *)cb_arg;
+	const uint32_t klen = entry_get_klen(patch);
+	uint8_t buf[KVS_PATCHOFFSIZE];
+	uint32_t pstart, pend, start, end;
+	int rc;
 
-	if (entry_get_klen(ent) == rv->klen) {
-		memcpy(rv->ent, ent, sizeof(struct kvs_ent));
-		rv->found = true;
+	rc = entry_data_read(patch, klen, buf, sizeof(buf));
+	if (rc != 0) {
+		return rc;
 	}
 
-	return 0;
+	pstart = klen + get_le16(buf);
+	pend = pstart + entry_get_slen(patch) - KVS_PATCHOFFSIZE;
+	start = KVS_MAX(pstart, off);
+	end = KVS_MIN(pend, off + len);
+	if (start < end) {
+		rc = entry_data_read(patch, start - pstart + klen +
+				     KVS_PATCHOFFSIZE, data + start - off,
+				     end - start);
+	}
+
+	return rc;
 }
 
-static int entry_get(struct kvs_ent *ent, const struct read_cb *rdkey)
+static int entry_patch_cb(struct kvs_ent *ent, void *cb_arg)
 {
-	const struct kvs_cfg *cfg = ent->kvs->cfg;
-	const size_t bsz = cfg->bsz;
-	const uint32_t bcnt = cfg->bcnt - cfg->bspr;
-	struct entry_get_cb_arg cb_arg = {
-		.ent = ent,
-		.klen = rdkey->len,
-		.found = false,
+	struct entry_patch_cb_arg *pa = (struct entry_patch_cb_arg *)cb_arg;
+	int rc;
+
+	if ((entry_get_klen(ent) != pa->klen) ||
+	    (ent->type != KVS_TYPE_PATCH) ||
+	    (entry_get_slen(ent) < KVS_PATCHOFFSIZE)) {
+		return 0;
+	}
+
+	rc = patch_apply(ent, pa->off, pa->data, pa->len);
+	if (rc != 0) {
+		return rc;
+	}
+
+	if (pa->ppos != NULL) {
+		pa->ppos[pa->cnt] = ent->start;
+	}
+
+	pa->cnt++;
+	return (pa->cnt == pa->pcnt) ? KVS_DONE : 0;
+}
+
+/* apply the patches of a entry to data read from offset off (from key start).
+ * The patches are found with a walk from the entry, a reader vr keeps their
+ * positions so only its first read walks.
+ */
+static int entry_patch(const struct kvs_ent *ent, struct value_rd *vr,
+		       uint32_t off, void *data, size_t len)
+{
+	const struct read_cb rdkey = {
+		.ctx = (void *)ent,
+		.off = 0U,
+		.len = entry_get_klen(ent),
+		.read = read_cb_entry,
 	};
-	struct entry_cb cb = {
-		.cb = entry_get_cb,
+	struct entry_patch_cb_arg cb_arg = {
+		.off = off,
+		.data = (uint8_t *)data,
+		.len = len,
+		.pcnt = ent->pcnt,
+		.cnt = 0U,
+		.klen = entry_get_klen(ent),
+		.ppos = NULL,
+	};
+	const struct entry_cb cb = {
+		.cb = entry_patch_cb,
 		.cb_arg = (void *)&cb_arg,
 	};
 	struct kvs_ent wlk = {
 		.kvs = ent->kvs,
+		.next = ent->next,
 	};
-	uint32_t stop = ent->kvs->data->pos;
-	uint32_t start = ent->kvs->data->bend - bsz; 
+	int rc = 0;
 
-	for (uint32_t i = 0; i < bcnt; i++) {
-		wlk.next = start;
-		(void)walk(&wlk, rdkey, &cb, stop);
-		if (cb_arg.found) {
-			break;
+	if ((vr != NULL) && (vr->pcnt == ent->pcnt)) {
+		for (uint32_t i = 0U; (rc == 0) && (i < vr->pcnt); i++) {
+			wlk.start = vr->ppos[i];
+			rc = (entry_get_info(&wlk) == 0) ?
+			     patch_apply(&wlk, off, (uint8_t *)data, len) :
+			     -KVS_EIO;
 		}
-		stop = (start == 0U) ? (cfg->bcnt * cfg->bsz) : start;
-		start = stop - bsz;
+
+		return rc;
 	}
 
-	if ((!cb_arg.found) || (entry_get_vlen(cb_arg.ent) == 0)) {
-		return -KVS_ENOENT;
+	if ((vr != NULL) && (ent->pcnt <= KVS_PATCHMAX)) {
+		cb_arg.ppos = vr->ppos;
+	}
+
+	rc = walk(&wlk, &rdkey, &cb, ent->kvs->data->pos);
+	if (rc != KVS_DONE) {
+		return rc;
+	}
+
+	if (cb_arg.ppos != NULL) {
+		vr->pcnt = cb_arg.cnt;
 	}
 
 	return 0;
 }
 
-struct entry_dup_cb_arg {
+struct entry_get_cb_arg {
 	struct kvs_ent *ent;
-	bool duplicate;
+	uint32_t klen;
+	uint32_t pcnt;
+	bool found;
 };
 
-static int entry_dup_cb(struct kvs_ent *ent, void *cb_arg)
+static int entry_get_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	struct entry_get_cb_arg *rv = (struct entry_get_cb_arg *)cb_arg;
+
+	if (entry_get_klen(ent) != rv->klen) {
+		return 0;
+	}
+
+	if (ent->type == KVS_TYPE_PATCH) {
+		rv->pcnt++;
+		return 0;
+	}
+
+	memcpy(rv->ent, ent, sizeof(struct kvs_ent));
+	rv->pcnt = 0U;
+	rv->found = true;
+	return 0;
+}
+
+/* find the last entry for a key (including delete entries) */
+static int entry_find(struct kvs_ent *ent, const struct read_cb *rdkey)
+{
+	const struct kvs_cfg *cfg = ent->kvs->cfg;
+	const size_t bsz = cfg->bsz;
+	const uint32_t bcnt = cfg->bcnt - cfg->bspr;
+	struct entry_get_cb_arg cb_arg = {
+		.ent = ent,
+		.klen = rdkey->len,
+		.pcnt = 0U,
+		.found = false,
+	};
+	struct entry_cb cb = {
+		.cb = entry_get_cb,
+		.cb_arg = (void *)&cb_arg,
+	};
+	struct kvs_ent wlk = {
+		.kvs = ent->kvs,
+	};
+	uint32_t stop = ent->kvs->data->pos;
+	uint32_t start = ent->kvs->data->bend - bsz; 
+	uint32_t pcnt = 0U;
+
+	for (uint32_t i = 0; i < bcnt; i++) {
+		wlk.next = start;
+		(void)walk(&wlk, rdkey, &cb, stop);
+		if (cb_arg.found) {
+			ent->pcnt = pcnt + cb_arg.pcnt;
+			break;
+		}
+		pcnt += cb_arg.pcnt;
+		cb_arg.pcnt = 0U;
+		stop = (start == 0U) ? (cfg->bcnt * cfg->bsz) : start;
+		start = stop - bsz;
+	}
+
+	return cb_arg.found ? 0 : -KVS_ENOENT;
+}
+
+static int entry_get(struct kvs_ent *ent, const struct read_cb *rdkey)
+{
+	int rc;
+
+	rc = entry_find(ent, rdkey);
+	if ((rc == 0) && (entry_get_vlen(ent) == 0U)) {
+		rc = -KVS_ENOENT;
+	}
+
+	return rc;
+}
+
+/* get the sorted segment (when it is available) */
+static struct kvs_seg *kvs_seg(const struct kvs *kvs)
+{
+	struct kvs_seg *seg = kvs->data->seg;
+
+	if ((seg == NULL) || (!seg->kvs->data->ready)) {
+		return NULL;
+	}
+
+	return seg;
+}
+
+/* compare the key of a entry with rdkey, result like memcmp() in cmp */
+static int key_cmp(const struct kvs_ent *ent, const struct read_cb *rdkey,
+		   int *cmp)
+{
+	const uint32_t klen = entry_get_klen(ent);
+	const uint32_t len = KVS_MIN(klen, rdkey->len);
+	uint32_t off = 0U;
+	int rc;
+
+	while (off < len) {
+		uint8_t bufa[KVS_BUFSIZE], bufb[KVS_BUFSIZE];
+		uint32_t rdlen = KVS_MIN(len - off, KVS_BUFSIZE);
+
+		rc = entry_data_read(ent, off, bufa, rdlen);
+		if (rc != 0) {
+			return rc;
+		}
+
+		rc = rdkey->read(rdkey->ctx, rdkey->off + off, bufb, rdlen);
+		if (rc != 0) {
+			return rc;
+		}
+
+		*cmp = memcmp(bufa, bufb, rdlen);
+		if (*cmp != 0) {
+			return 0;
+		}
+
+		off += rdlen;
+	}
+
+	*cmp = (klen > rdkey->len) - (klen < rdkey->len);
+	return 0;
+}
+
+/* get entry nr of the segment (in key order) */
+static int seg_get(const struct kvs_seg *seg, uint32_t nr, struct kvs_ent *ent)
+{
+	uint8_t buf[sizeof(uint32_t)];
+	int rc;
+
+	rc = kvs_dev_read(seg->kvs, seg->ioff + nr * sizeof(uint32_t), buf,
+			  sizeof(buf));
+	if (rc != 0) {
+		return rc;
+	}
+
+	ent->kvs = (struct kvs *)seg->kvs;
+	ent->start = get_le32(buf);
+	if (entry_get_info(ent) != 0) {
+		return -KVS_EIO;
+	}
+
+	return 0;
+}
+
+/* binary search the first entry of the segment with a key >= rdkey */
+static int seg_lower(const struct kvs_seg *seg, const struct read_cb *rdkey,
+		     uint32_t *nr)
+{
+	struct kvs_ent ent;
+	uint32_t lo = 0U, hi = seg->cnt;
+	int cmp, rc;
+
+	while (lo < hi) {
+		const uint32_t mid = lo + (hi - lo) / 2U;
+
+		rc = seg_get(seg, mid, &ent);
+		if (rc == 0) {
+			rc = key_cmp(&ent, rdkey, &cmp);
+		}
+
+		if (rc != 0) {
+			return rc;
+		}
+
+		if (cmp < 0) {
+			lo = mid + 1U;
+		} else {
+			hi = mid;
+		}
+
+	}
+
+	*nr = lo;
+	return 0;
+}
+
+/* find the entry for a key in the segment of a kvs */
+static int seg_find(struct kvs_ent *ent, const struct kvs *kvs,
+		    const struct read_cb *rdkey)
+{
+	const struct kvs_seg *seg = kvs_seg(kvs);
+	struct kvs_ent seg_ent;
+	uint32_t nr;
+	int cmp, rc;
+
+	if (seg == NULL) {
+		return -KVS_ENOENT;
+	}
+
+	rc = seg_lower(seg, rdkey, &nr);
+	if ((rc != 0) || (nr == seg->cnt)) {
+		return -KVS_ENOENT;
+	}
+
+	rc = seg_get(seg, nr, &seg_ent);
+	if (rc == 0) {
+		rc = key_cmp(&seg_ent, rdkey, &cmp);
+	}
+
+	if ((rc != 0) || (cmp != 0)) {
+		return -KVS_ENOENT;
+	}
+
+	entry_set_seq(&seg_ent);
+	memcpy(ent, &seg_ent, sizeof(struct kvs_ent));
+	return 0;
+}
+
+/* walk over the entries of the segment that start with rdkey (in key order) */
+static int seg_walk(const struct kvs *kvs, const struct read_cb *rdkey,
+		    const struct entry_cb *cb)
+{
+	const struct kvs_seg *seg = kvs_seg(kvs);
+	struct kvs_ent ent;
+	const struct read_cb readkey = {
+		.ctx = (void *)&ent,
+		.off = 0U,
+		.len = rdkey->len,
+		.read = read_cb_entry,
+	};
+	uint32_t nr;
+	int rc;
+
+	if (seg == NULL) {
+		return 0;
+	}
+
+	rc = seg_lower(seg, rdkey, &nr);
+	while ((rc == 0) && (nr < seg->cnt)) {
+		rc = seg_get(seg, nr++, &ent);
+		if (rc != 0) {
+			break;
+		}
+
+		if ((entry_get_klen((&ent)) < rdkey->len) ||
+		    (differ(&readkey, rdkey))) {
+			break;
+		}
+
+		entry_set_seq(&ent);
+		rc = cb->cb(&ent, cb->cb_arg);
+	}
+
+	return rc;
+}
+
+/* get the cold kvs (when it is available) */
+static struct kvs *kvs_cold(const struct kvs *kvs)
+{
+	struct kvs *cold = kvs->data->cold;
+
+	if ((cold == NULL) || (cold == kvs) || (!cold->data->ready)) {
+		return NULL;
+	}
+
+	return cold;
+}
+
+static uint32_t kvs_seq_load(const struct kvs *kvs)
+{
+	uint32_t seq;
+
+	do {
+		seq = __atomic_load_n(&kvs->data->seq, __ATOMIC_ACQUIRE);
+	} while ((seq & 1U) != 0U);
+
+	return seq;
+}
+
+/* start a read without lock: returns the block sequence of the kvs and its
+ * cold kvs, a block advance that is in progress is waited for.
+ */
+static uint32_t kvs_seq_begin(const struct kvs *kvs)
+{
+	const struct kvs *cold = kvs_cold(kvs);
+	const struct kvs_seg *seg = kvs_seg(kvs);
+	uint32_t seq = kvs_seq_load(kvs);
+
+	if (cold != NULL) {
+		seq += kvs_seq_load(cold);
+	}
+
+	if (seg != NULL) {
+		seq += kvs_seq_load(seg->kvs);
+	}
+
+	return seq;
+}
+
+/* end a read without lock: returns true when no block advance happened */
+static bool kvs_seq_end(const struct kvs *kvs, uint32_t seq)
+{
+	const struct kvs *cold = kvs_cold(kvs);
+	const struct kvs_seg *seg = kvs_seg(kvs);
+	uint32_t nseq;
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	nseq = __atomic_load_n(&kvs->data->seq, __ATOMIC_RELAXED);
+	if (cold != NULL) {
+		nseq += __atomic_load_n(&cold->data->seq, __ATOMIC_RELAXED);
+	}
+
+	if (seg != NULL) {
+		nseq += __atomic_load_n(&seg->kvs->data->seq,
+					__ATOMIC_RELAXED);
+	}
+
+	return nseq == seq;
+}
+
+/* get a entry, keys without entry are retrieved from the segment or the cold
+ * kvs.
+ */
+static int entry_lookup(struct kvs_ent *ent, const struct read_cb *rdkey)
+{
+	const struct kvs *kvs = ent->kvs;
+	struct kvs *cold = kvs_cold(kvs);
+	int rc;
+
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_LOOKUP, rdkey->len);
+	rc = entry_find(ent, rdkey);
+	if (rc == -KVS_ENOENT) {
+		rc = seg_find(ent, kvs, rdkey);
+	}
+
+	if ((rc == -KVS_ENOENT) && (cold != NULL)) {
+		ent->kvs = cold;
+		rc = entry_find(ent, rdkey);
+	}
+
+	if ((rc == 0) && (entry_get_vlen(ent) == 0U)) {
+		rc = -KVS_ENOENT;
+	}
+
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_LOOKUP, rc);
+	return rc;
+}
+
+/* read entry data (key and value) of a chunk directory */
+static int entry_data_chunks(const struct kvs_ent *ent, uint32_t off,
+			     void *data, size_t len)
+{
+	const uint32_t klen = entry_get_klen(ent);
+	uint8_t *data8 = (uint8_t *)data;
+	struct chunk_key ck = {
+		.key = {
+			.ctx = (void *)ent,
+			.off = 0U,
+			.len = klen,
+			.read = read_cb_entry,
+		},
+	};
+	struct read_cb rdkey;
+	uint32_t vlen, csz;
+	uint8_t gen;
+	int rc;
+
+	if (off < klen) {
+		const size_t rdlen = KVS_MIN(len, klen - off);
+
+		rc = entry_data_read(ent, off, data8, rdlen);
+		if (rc != 0) {
+			return rc;
+		}
+
+		data8 += rdlen;
+		off += rdlen;
+		len -= rdlen;
+	}
+
+	rc = entry_get_cdir(ent, &vlen, &csz, &gen);
+	if (rc != 0) {
+		return rc;
+	}
+
+	off -= klen;
+	if ((off > vlen) || (len > (vlen - off))) {
+		return -KVS_EINVAL;
+	}
+
+	while (len != 0U) {
+		const uint32_t choff = off % csz;
+		const uint32_t rdlen = KVS_MIN(len, csz - choff);
+		struct kvs_ent chunk = {
+			.kvs = ent->kvs,
+		};
+
+		chunk_key_init(&ck, &rdkey, gen, off / csz);
+		rc = entry_get(&chunk, &rdkey);
+		if (rc != 0) {
+			return rc;
+		}
+
+		if ((choff + rdlen) > entry_get_vlen((&chunk))) {
+			return -KVS_EINVAL;
+		}
+
+		rc = entry_data_get(&chunk, rdkey.len + choff, data8, rdlen);
+		if (rc != 0) {
+			return rc;
+		}
+
+		data8 += rdlen;
+		off += rdlen;
+		len -= rdlen;
+	}
+
+	return 0;
+}
+
+/* check if a entry was written after position pos at wrap counter wrapcnt */
+static bool entry_after(const struct kvs_ent *ent, uint32_t wrapcnt,
+			uint32_t pos)
+{
+	struct kvs_ent meta = {
+		.kvs = ent->kvs,
+		.start = KVS_ALIGNDOWN(ent->start, ent->kvs->cfg->bsz),
+	};
+	uint32_t ewrapcnt = 0U;
+
+	if (entry_get_info(&meta) != 0) {
+		return false;
+	}
+
+	entry_get_wrapcnt(&meta, &ewrapcnt);
+	return (ewrapcnt > wrapcnt) ||
+	       ((ewrapcnt == wrapcnt) && (ent->start >= pos));
+}
+
+/* check if a chunk (key suffix sfx) belongs to the directory entry dir */
+static bool chunk_in_dir(const struct kvs_ent *dir, const uint8_t *sfx)
+{
+	uint32_t vlen, csz;
+	uint8_t gen;
+
+	return (dir->type == KVS_TYPE_CDIR) &&
+	       (entry_get_cdir(dir, &vlen, &csz, &gen) == 0) &&
+	       (gen == sfx[1]) &&
+	       (get_le16(&sfx[2]) < ((vlen + csz - 1U) / csz));
+}
+
+/* check if a chunk is part of the last written value (the last entry with
+ * the value key is a matching chunk directory) or of the value that is being
+ * written (wr).
+ */
+static bool chunk_live(const struct kvs_ent *ent, const struct chunk_key *wr)
+{
+	const uint32_t klen = entry_get_klen(ent);
+	const struct read_cb rdkey = {
+		.ctx = (void *)ent,
+		.off = 0U,
+		.len = klen - KVS_CHUNKSFXSIZE,
+		.read = read_cb_entry,
+	};
+	struct kvs_ent base;
+	struct entry_get_cb_arg cb_arg = {
+		.ent = &base,
+		.klen = rdkey.len,
+		.pcnt = 0U,
+		.found = false,
+	};
+	const struct entry_cb cb = {
+		.cb = entry_get_cb,
+		.cb_arg = (void *)&cb_arg,
+	};
+	struct kvs_ent wlk = {
+		.kvs = ent->kvs,
+		.next = KVS_ALIGNDOWN(ent->start, ent->kvs->cfg->bsz),
+	};
+	uint8_t sfx[KVS_CHUNKSFXSIZE];
+
+	if ((klen <= KVS_CHUNKSFXSIZE) ||
+	    (entry_data_read(ent, rdkey.len, sfx, sizeof(sfx)) != 0)) {
+		return false;
+	}
+
+	if ((wr != NULL) && (wr->sfx[1] == sfx[1]) &&
+	    (!differ(&rdkey, &wr->key)) &&
+	    (entry_after(ent, wr->wrapcnt, wr->pos))) {
+		return true;
+	}
+
+	/* the chunk is in the oldest block: all older entries have been moved
+	 * and the last entry with the value key is found from its block start.
+	 */
+	(void)walk(&wlk, &rdkey, &cb, ent->kvs->data->pos);
+	if (!cb_arg.found) {
+		return false;
+	}
+
+	return chunk_in_dir(&base, sfx);
+}
+
+struct entry_dup_cb_arg {
+	struct kvs_ent *ent;
+	uint32_t pcnt;
+	bool duplicate;
+};
+
+static int entry_dup_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	struct entry_dup_cb_arg *dup = (struct entry_dup_cb_arg *)cb_arg;
+
+	if (entry_get_klen(ent) != entry_get_klen(dup->ent)) {
+		return 0;
+	}
+
+	if (ent->type == KVS_TYPE_PATCH) {
+		dup->pcnt++;
+		return 0;
+	}
+
+	dup->duplicate = true;
+	return KVS_DONE;
+
+}
+
+/* check if a entry has been replaced, the patches of the entry are counted */
+static bool entry_dup(struct kvs_ent *ent)
+{
+	const struct kvs *kvs = ent->kvs;
+	const struct read_cb readkey = {
+		.ctx = (void *)ent,
+		.off = 0,
+		.len = entry_get_klen(ent),
+		.read = read_cb_entry,
+	};
+	struct entry_dup_cb_arg dup_cb_arg = {
+		.ent = ent,
+		.pcnt = 0U,
+		.duplicate = false,
+	};
+	const struct entry_cb dup_entry_cb = {
+		.cb = entry_dup_cb,
+		.cb_arg = (void *)&dup_cb_arg,
+	};
+	struct kvs_ent wlk = {
+		.kvs = (struct kvs *)kvs,
+		.next = ent->next,
+	};
+
+	(void)walk(&wlk, &readkey, &dup_entry_cb, kvs->data->pos);
+	ent->pcnt = dup_cb_arg.pcnt;
+	return dup_cb_arg.duplicate;
+}
+
+static int unique_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	if ((entry_get_klen(ent) == 0U) || (ent->type == KVS_TYPE_PATCH)) {
+		return 0;
+	}
+
+	const struct entry_cb *cb = (const struct entry_cb *)cb_arg;
+
+	if (!entry_dup(ent)) {
+		return cb->cb(ent, cb->cb_arg);
+	}
+
+	return 0;
+}
+
+static int walk_unique(struct kvs_ent *ent, const struct read_cb *rdkey,
+		       const struct entry_cb *cb, uint32_t stop)
+{
+	const struct entry_cb walk_cb = {
+		.cb = unique_cb,
+		.cb_arg = (void *)cb,
+	};
+
+	return walk(ent, rdkey, &walk_cb, stop);
+}
+
+/* get the live data counter of the block at pos (when it is maintained) */
+static uint32_t *blive_get(const struct kvs *kvs, uint32_t pos)
+{
+	struct kvs_data *data = kvs->data;
+
+	if ((data->blive == NULL) || (!data->ready)) {
+		return NULL;
+	}
+
+	return &data->blive[pos / kvs->cfg->bsz];
+}
+
+static void blive_add(const struct kvs_ent *ent)
+{
+	uint32_t *live = blive_get(ent->kvs, ent->start);
+
+	if (live != NULL) {
+		*live += ent->next - ent->start;
+	}
+
+}
+
+static void blive_sub(const struct kvs_ent *ent)
+{
+	uint32_t *live = blive_get(ent->kvs, ent->start);
+
+	if (live != NULL) {
+		*live -= KVS_MIN(*live, ent->next - ent->start);
+	}
+
+}
+
+static bool chunk_dead(const struct kvs_ent *ent);
+
+/* find the entry that is replaced when a entry is added (only needed when
+ * the live bytes are maintained).
+ */
+static const struct kvs_ent *blive_find(struct kvs_ent *old,
+					const struct read_cb *rdkey)
+{
+	if ((blive_get(old->kvs, 0U) == NULL) || (entry_find(old, rdkey) != 0)) {
+		return NULL;
+	}
+
+	return old;
+}
+
+/* check if adding ent releases old (a entry with data in the same kvs),
+ * chunks of a replaced value have been released with their directory.
+ */
+static bool blive_replaced(const struct kvs_ent *ent,
+			   const struct kvs_ent *old)
+{
+	return (old != NULL) && (old->kvs == ent->kvs) &&
+	       (blive_get(old->kvs, 0U) != NULL) &&
+	       (entry_get_vlen(old) != 0U) &&
+	       ((old->type != KVS_TYPE_CHUNK) || (!chunk_dead(old)));
+}
+
+struct blive_patch_cb_arg {
+	uint32_t klen;
+	uint32_t pcnt;
+};
+
+static int blive_patch_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	struct blive_patch_cb_arg *pa = (struct blive_patch_cb_arg *)cb_arg;
+
+	if ((entry_get_klen(ent) != pa->klen) ||
+	    (ent->type != KVS_TYPE_PATCH)) {
+		return 0;
+	}
+
+	blive_sub(ent);
+	pa->pcnt--;
+	return (pa->pcnt == 0U) ? KVS_DONE : 0;
+}
+
+/* release the patches of a entry */
+static void blive_release_patches(const struct kvs_ent *ent)
+{
+	const struct read_cb rdkey = {
+		.ctx = (void *)ent,
+		.off = 0U,
+		.len = entry_get_klen(ent),
+		.read = read_cb_entry,
+	};
+	struct blive_patch_cb_arg cb_arg = {
+		.klen = entry_get_klen(ent),
+		.pcnt = ent->pcnt,
+	};
+	const struct entry_cb cb = {
+		.cb = blive_patch_cb,
+		.cb_arg = (void *)&cb_arg,
+	};
+	struct kvs_ent wlk = {
+		.kvs = ent->kvs,
+		.next = ent->next,
+	};
+
+	if (ent->pcnt != 0U) {
+		(void)walk(&wlk, &rdkey, &cb, ent->kvs->data->pos);
+	}
+
+}
+
+/* release the first cnt chunks (generation gen) of the value with key rdkey */
+static void blive_release_chunks(const struct kvs *kvs,
+				 const struct read_cb *rdkey, uint8_t gen,
+				 uint32_t cnt)
+{
+	struct chunk_key ck = {
+		.key = *rdkey,
+	};
+	struct kvs_ent chunk = {
+		.kvs = (struct kvs *)kvs,
+	};
+	struct read_cb ckey;
+
+	if (blive_get(kvs, 0U) == NULL) {
+		return;
+	}
+
+	for (uint32_t idx = 0U; idx < cnt; idx++) {
+		chunk_key_init(&ck, &ckey, gen, idx);
+		if (entry_find(&chunk, &ckey) == 0) {
+			blive_sub(&chunk);
+			blive_release_patches(&chunk);
+		}
+
+	}
+
+}
+
+/* release a replaced entry, its patches and (for a directory) its chunks */
+static void blive_release(const struct kvs_ent *old,
+			  const struct read_cb *rdkey)
+{
+	uint32_t vlen, csz;
+	uint8_t gen;
+
+	blive_sub(old);
+	blive_release_patches(old);
+	if ((old->type == KVS_TYPE_CDIR) &&
+	    (entry_get_cdir(old, &vlen, &csz, &gen) == 0)) {
+		blive_release_chunks(old->kvs, rdkey, gen,
+				     (vlen + csz - 1U) / csz);
+	}
+
+}
+
+/* clear the live data counters of the blocks from start up to stop */
+static void blive_clear(const struct kvs *kvs, uint32_t start, uint32_t stop)
+{
+	const uint32_t end = kvs->cfg->bcnt * kvs->cfg->bsz;
+	uint32_t *live;
+
+	start = (start < end) ? start : 0U;
+	stop = (stop < end) ? stop : 0U;
+	do {
+		live = blive_get(kvs, start);
+		if (live != NULL) {
+			*live = 0U;
+		}
+
+		start = block_advance_n(kvs, start, 1U);
+		start = (start < end) ? start : 0U;
+	} while (start != stop);
+}
+
+/* check if a entry is a chunk (or a patch of a chunk) of a replaced value,
+ * keys of values do not contain a 0 as chunk keys do.
+ */
+static bool chunk_dead(const struct kvs_ent *ent)
+{
+	const uint32_t klen = entry_get_klen(ent);
+	const struct read_cb rdkey = {
+		.ctx = (void *)ent,
+		.off = 0U,
+		.len = klen - KVS_CHUNKSFXSIZE,
+		.read = read_cb_entry,
+	};
+	struct kvs_ent base = {
+		.kvs = ent->kvs,
+	};
+	uint8_t sfx[KVS_CHUNKSFXSIZE];
+
+	if ((klen <= KVS_CHUNKSFXSIZE) ||
+	    (entry_data_read(ent, rdkey.len, sfx, sizeof(sfx)) != 0) ||
+	    (sfx[0] != 0U)) {
+		return false;
+	}
+
+	return (entry_find(&base, &rdkey) != 0) || (!chunk_in_dir(&base, sfx));
+}
+
+static bool patch_has_base(const struct kvs_ent *ent)
+{
+	const struct read_cb rdkey = {
+		.ctx = (void *)ent,
+		.off = 0U,
+		.len = entry_get_klen(ent),
+		.read = read_cb_entry,
+	};
+	struct kvs_ent base = {
+		.kvs = ent->kvs,
+	};
+
+	return entry_find(&base, &rdkey) == 0;
+}
+
+struct blive_count_cb_arg {
+	uint32_t *live;
+	bool per_block;
+};
+
+/* count the live data of entries that are still needed */
+static int blive_count_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	struct blive_count_cb_arg *cnt = (struct blive_count_cb_arg *)cb_arg;
+	const uint32_t bsz = ent->kvs->cfg->bsz;
+
+	if ((entry_get_klen(ent) == 0U) || (entry_get_vlen(ent) == 0U)) {
+		return 0;
+	}
+
+	if (((ent->type == KVS_TYPE_CHUNK) || (ent->type == KVS_TYPE_PATCH)) &&
+	    (chunk_dead(ent))) {
+		return 0;
+	}
+
+	/* patches of a entry that has been moved to the cold kvs */
+	if ((ent->type == KVS_TYPE_PATCH) && (!patch_has_base(ent))) {
+		return 0;
+	}
+
+	if (entry_dup(ent)) {
+		return 0;
+	}
+
+	cnt->live[cnt->per_block ? (ent->start / bsz) : 0U] +=
+		ent->next - ent->start;
+	return 0;
+}
+
+/* count the live data from start up to stop */
+static int blive_count(const struct kvs *kvs, uint32_t start, uint32_t stop,
+		       uint32_t *live, bool per_block)
+{
+	const struct read_cb rdkey = {
+		.ctx = (void *)NULL,
+		.off = 0U,
+		.len = 0U,
+		.read = read_cb_ptr,
+	};
+	struct blive_count_cb_arg cb_arg = {
+		.live = live,
+		.per_block = per_block,
+	};
+	const struct entry_cb cb = {
+		.cb = blive_count_cb,
+		.cb_arg = (void *)&cb_arg,
+	};
+	struct kvs_ent wlk = {
+		.kvs = (struct kvs *)kvs,
+		.next = start,
+	};
+	int rc;
+
+	rc = walk(&wlk, &rdkey, &cb, stop);
+	return rc == KVS_DONE ? 0 : rc;
+}
+
+/* get the live data in a block */
+static int blive_block(const struct kvs *kvs, uint32_t pos, uint32_t *live)
+{
+	const uint32_t bsz = kvs->cfg->bsz;
+	const uint32_t *blive = blive_get(kvs, pos);
+	const uint32_t start = KVS_ALIGNDOWN(pos, bsz);
+	uint32_t stop = start + bsz;
+
+	if (blive != NULL) {
+		*live = *blive;
+		return 0;
+	}
+
+	if (start == KVS_ALIGNDOWN(kvs->data->pos, bsz)) {
+		stop = kvs->data->pos;
+	}
+
+	*live = 0U;
+	return (start == stop) ? 0 : blive_count(kvs, start, stop, live, false);
+}
+
+/* check if the cold kvs is up to date with a entry */
+static bool cold_has(const struct kvs_ent *ent)
+{
+	struct kvs *cold = kvs_cold(ent->kvs);
+	const struct read_cb rdkey = {
+		.ctx = (void *)ent,
+		.off = 0U,
+		.len = entry_get_klen(ent),
+		.read = read_cb_entry,
+	};
+	struct kvs_ent cold_ent = {
+		.kvs = cold,
+	};
+
+	if ((cold == NULL) || (ent->type == KVS_TYPE_CHUNK) ||
+	    (ent->type == KVS_TYPE_CDIR)) {
+		return false;
+	}
+
+	if (entry_get(&cold_ent, &rdkey) != 0) {
+		return (entry_get_vlen(ent) == 0U);
+	}
+
+	struct value_rd vr = {
+		.ent = ent,
+	}, cold_vr = {
+		.ent = &cold_ent,
+	};
+	const struct read_cb val_rd = {
+		.ctx = (void *)&vr,
+		.off = entry_get_klen(ent),
+		.len = entry_get_vlen(ent),
+		.read = read_cb_value,
+	};
+	const struct read_cb cold_rd = {
+		.ctx = (void *)&cold_vr,
+		.off = entry_get_klen((&cold_ent)),
+		.len = entry_get_vlen((&cold_ent)),
+		.read = read_cb_value,
+	};
+
+	return !differ(&val_rd, &cold_rd);
+}
+
+static int cold_move(const struct kvs_ent *ent);
+
+/* check if a entry is not needed because the segment has the same value (or
+ * has no entry for a deleted key)
+ */
+static bool seg_has(const struct kvs_ent *ent)
+{
+	const struct read_cb rdkey = {
+		.ctx = (void *)ent,
+		.off = 0U,
+		.len = entry_get_klen(ent),
+		.read = read_cb_entry,
+	};
+	struct kvs_ent seg_ent;
+
+	if ((kvs_seg(ent->kvs) == NULL) || (ent->type == KVS_TYPE_CHUNK) ||
+	    (ent->type == KVS_TYPE_CDIR)) {
+		return false;
+	}
+
+	if (seg_find(&seg_ent, ent->kvs, &rdkey) != 0) {
+		return (entry_get_vlen(ent) == 0U);
+	}
+
+	struct value_rd vr = {
+		.ent = ent,
+	}, seg_vr = {
+		.ent = &seg_ent,
+	};
+	const struct read_cb val_rd = {
+		.ctx = (void *)&vr,
+		.off = entry_get_klen(ent),
+		.len = entry_get_vlen(ent),
+		.read = read_cb_value,
+	};
+	const struct read_cb seg_rd = {
+		.ctx = (void *)&seg_vr,
+		.off = entry_get_klen((&seg_ent)),
+		.len = entry_get_vlen((&seg_ent)),
+		.read = read_cb_value,
+	};
+
+	return !differ(&val_rd, &seg_rd);
+}
+
+/* check if the next block advance would reuse a block pinned by a snapshot */
+static bool snap_pinned(const struct kvs *kvs)
+{
+	const uint32_t seq = kvs->data->seq + 2U;
+
+	for (const struct kvs_snapshot *snap = kvs->data->snaps; snap != NULL;
+	     snap = snap->next) {
+		if ((int32_t)(snap->pin - seq) <= 0) {
+			return true;
+		}
+
+	}
+
+	return false;
+}
+
+int copy_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	struct kvs_ent cp_ent = {
+		.kvs = ent->kvs,
+	};
+	int rc = 0;
+
+	if (entry_get_klen(ent) == 0U) {
+		return 0;
+	}
+
+	rc = cold_move(ent);
+	if ((rc == 0) || (seg_has(ent))) {
+		blive_release_patches(ent);
+		return 0;
+	}
+
+	/* delete entries are kept while the segment has the key */
+	if ((rc == -KVS_ENOENT) && (entry_get_vlen(ent) == 0U) &&
+	    (kvs_seg(ent->kvs) == NULL)) {
+		return 0;
+	}
+
+	/* the patches are folded into the copy, the patches of chunks that do
+	 * not belong to the last written value have been released already.
+	 */
+	if ((ent->type != KVS_TYPE_CHUNK) || (chunk_live(ent, NULL))) {
+		blive_release_patches(ent);
+	} else if (!chunk_live(ent, (const struct chunk_key *)cb_arg)) {
+		return 0;
+	}
+
+	/* ent is not released: the compacted blocks are cleared afterwards */
+	rc = 0;
+	for (uint32_t i = 0U; i < ent->kvs->cfg->bspr; i++) {
+		rc = entry_copy(&cp_ent, ent, NULL);
+		if (rc == 0) {
+			kvs_stat_add(ent->kvs, copies, 1U);
+			break;
+		}
+
+		if (snap_pinned(ent->kvs)) {
+			return -KVS_EAGAIN;
+		}
+
+		wblock_advance(ent->kvs);
+	}
+
+	return rc;
+}
+
+/* compact the kvs up to stop, the chunks of wr (a chunked value that is being
+ * written) are kept.
+ */
+static int compact(const struct kvs *kvs, uint32_t stop,
+		   const struct chunk_key *wr)
+{
+	const struct read_cb rdkey = {
+		.ctx = (void *)NULL,
+		.off = 0U,
+		.len = 0U,
+		.read = read_cb_ptr,
+	};
+	const struct entry_cb compact_cb = {
+		.cb = copy_cb,
+		.cb_arg = (void *)wr,
+	};
+		struct kvs_ent wlk = {
+		.kvs = (struct kvs *)kvs,
+		.next = block_advance_n(kvs, kvs->data->bend, kvs->cfg->bspr),
+	};
+	const uint32_t start = wlk.next;
+	int rc;
+
+	if (snap_pinned(kvs)) {
+		return -KVS_EAGAIN;
+	}
+
+	kvs_stat_add(kvs, compactions, 1U);
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_RECLAIM,
+			(stop + kvs->cfg->bsz * kvs->cfg->bcnt - start) %
+			(kvs->cfg->bsz * kvs->cfg->bcnt));
+	wblock_advance(kvs);
+	rc = walk_unique(&wlk, &rdkey, &compact_cb, stop);
+	if ((rc == 0) || (rc == KVS_DONE)) {
+		blive_clear(kvs, start, stop);
+		rc = 0;
+	}
+
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_RECLAIM, rc);
+	return rc;
+}
+
+int kvs_entry_read(const struct kvs_ent *ent, uint32_t off, void *data,
+		   size_t len)
+{
+	if ((ent == NULL) || (ent->kvs == NULL) || (!ent->kvs->data->ready)) {
+		return -KVS_EINVAL;
+	}
+
+	uint32_t seq;
+	int rc;
+
+	KVS_TRACE_ENTER(ent->kvs, KVS_TRACE_ENTRY_READ, len);
+	seq = kvs_seq_begin(ent->kvs);
+	rc = entry_data_get(ent, off, data, len);
+	/* chunks are older than their directory, they are reused first */
+	if ((!kvs_seq_end(ent->kvs, seq)) &&
+	    ((ent->type == KVS_TYPE_CDIR) || (ent->kvs->data->inplace) ||
+	     (!entry_seq_ok(ent)))) {
+		rc = -KVS_EAGAIN;
+	}
+
+	KVS_TRACE_EXIT(ent->kvs, KVS_TRACE_ENTRY_READ, rc);
+	return rc;
+}
+
+/* get the dictionary key that a stored key starts with (NULL when the key
+ * has no reference)
+ */
+static const char *entry_key_dict(const struct kvs_ent *ent)
+{
+	const struct kvs_keydict *dict = ent->kvs->data->keydict;
+	uint8_t ref[KVS_KEYREFSIZE];
+
+	if ((dict == NULL) || (entry_get_klen(ent) < KVS_KEYREFSIZE) ||
+	    (entry_data_read(ent, 0U, ref, sizeof(ref)) != 0) ||
+	    (ref[0] != KVS_KEYREF) || (ref[1] >= dict->cnt)) {
+		return NULL;
+	}
+
+	return dict->key[ref[1]];
+}
+
+int kvs_entry_key(const struct kvs_ent *ent, char *key, size_t len)
+{
+	if ((ent == NULL) || (ent->kvs == NULL) || (!ent->kvs->data->ready) ||
+	    ((key == NULL) && (len != 0U))) {
+		return -KVS_EINVAL;
+	}
+
+	const char *dkey = entry_key_dict(ent);
+	const size_t dlen = (dkey == NULL) ? 0U : strlen(dkey);
+	const uint32_t skip = (dkey == NULL) ? 0U : KVS_KEYREFSIZE;
+	const size_t klen = entry_get_klen(ent) - skip;
+	int rc = 0;
+
+	if (dlen != 0U) {
+		memcpy(key, dkey, KVS_MIN(dlen, len));
+	}
+
+	if (len > dlen) {
+		rc = kvs_entry_read(ent, skip, key + dlen,
+				    KVS_MIN(len - dlen, klen));
+	}
+
+	if (rc != 0) {
+		return rc;
+	}
+
+	return (int)(dlen + klen);
+}
+
+int kvs_entry_id(const struct kvs_ent *ent, uint16_t *id)
+{
+	if ((ent == NULL) || (ent->kvs == NULL) || (!ent->kvs->data->ready) ||
+	    (id == NULL)) {
+		return -KVS_EINVAL;
+	}
+
+	uint8_t key[KVS_KEYIDSIZE];
+	int rc;
+
+	if (entry_get_klen(ent) != KVS_KEYIDSIZE) {
+		return -KVS_ENOENT;
+	}
+
+	rc = kvs_entry_read(ent, 0U, key, sizeof(key));
+	if (rc != 0) {
+		return rc;
+	}
+
+	if ((key[0] != KVS_KEYREF) || (key[1] != KVS_KEYID)) {
+		return -KVS_ENOENT;
+	}
+
+	*id = get_le16(&key[2]);
+	return 0;
+}
+
+/* get a entry (and read its value when rdval is true) without lock, this is
+ * redone when a block advance happens meanwhile and done under the lock when
+ * that keeps happening.
+ */
+static int entry_get_nolock(struct kvs_ent *ent, const struct kvs *kvs,
+			    const struct read_cb *rdkey, bool rdval,
+			    void *value, size_t len)
+{
+	bool locked = false;
+	uint32_t seq;
+	int rc;
+
+	for (uint32_t i = 0U; ; i++) {
+		if (i == KVS_SEQRETRIES) {
+			rc = kvs_dev_lock(kvs);
+			if (rc != 0) {
+				return rc;
+			}
+
+			locked = true;
+		}
+
+		seq = kvs_seq_begin(kvs);
+		ent->kvs = (struct kvs *)kvs;
+		rc = entry_lookup(ent, rdkey);
+		if (rc == 0) {
+			entry_set_seq(ent);
+		}
+
+		if ((rc == 0) && rdval) {
+			rc = entry_data_get(ent, entry_get_klen(ent), value,
+					    len);
+		}
+
+		if (locked || kvs_seq_end(kvs, seq)) {
+			break;
+		}
+
+		kvs_stat_add(kvs, retries, 1U);
+	}
+
+	if (locked) {
+		(void)kvs_dev_unlock(kvs);
+	}
+
+	return rc;
+}
+
+int kvs_entry_get(struct kvs_ent *ent, const struct kvs *kvs, const char *key)
+{
+	if ((kvs == NULL) || (!kvs->data->ready) || (key == NULL)) {
+		return -KVS_EINVAL;
+	}
+
+	struct key_enc enc;
+	struct read_cb krd_cb;
+	int rc;
+
+	key_encode(kvs, key, strlen(key), &enc, &krd_cb);
+	/* the entry of a buffered value is only known after a flush */
+	rc = kvs_flush(kvs);
+	if (rc != 0) {
+		return rc;
+	}
+
+	kvs_stat_add(kvs, lookups, 1U);
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_ENTRY_GET, krd_cb.len);
+	rc = entry_get_nolock(ent, kvs, &krd_cb, false, NULL, 0U);
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_ENTRY_GET, rc);
+	return rc;
+}
+
+uint32_t kvs_defaults_hash(const char *key, size_t klen, uint32_t seed)
+{
+	uint32_t hash = KVS_FNV_OFFSET;
+
+	while (klen-- != 0U) {
+		hash ^= (uint8_t)*key++;
+		hash *= KVS_FNV_PRIME;
+	}
+
+	/* mix in the seed, every seed gives a different spread of the keys */
+	hash ^= seed * KVS_FNV_PRIME;
+	hash ^= hash >> 16;
+	hash *= 0x7feb352dU;
+	hash ^= hash >> 15;
+	hash *= 0x846ca68bU;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+static const struct kvs_default *defaults_get(const struct kvs_defaults *defs,
+					      const char *key, size_t klen)
+{
+	const struct kvs_default *def;
+	uint32_t seed;
+
+	if ((defs == NULL) || (defs->cnt == 0U) || (defs->dcnt == 0U)) {
+		return NULL;
+	}
+
+	seed = defs->disp[kvs_defaults_hash(key, klen, 0U) % defs->dcnt];
+	def = &defs->ent[kvs_defaults_hash(key, klen, seed) % defs->cnt];
+	if ((strncmp(def->key, key, klen) != 0) || (def->key[klen] != '\0')) {
+		return NULL;
+	}
+
+	return def;
+}
+
+/* read the default value for a key without value */
+static int defaults_read(const struct kvs *kvs, const char *key, size_t klen,
+			 void *value, size_t len)
+{
+	const struct kvs_default *def;
+
+	def = defaults_get(kvs->data->defaults, key, klen);
+	if (def == NULL) {
+		return -KVS_ENOENT;
+	}
+
+	memcpy(value, def->value, KVS_MIN(len, def->len));
+	return 0;
+}
+
+static bool wbuf_read(const struct kvs *kvs, const struct read_cb *rdkey,
+		      void *value, size_t len, int *rc);
+
+int kvs_read(const struct kvs *kvs, const char *key, void *value, size_t len)
+{
+	if ((kvs == NULL) || (!kvs->data->ready) || (key == NULL)) {
+		return -KVS_EINVAL;
+	}
+
+	const size_t klen = strlen(key);
+	struct key_enc enc;
+	struct read_cb krd_cb;
+	struct kvs_ent ent;
+	int rc;
+
+	key_encode(kvs, key, klen, &enc, &krd_cb);
+	kvs_stat_add(kvs, lookups, 1U);
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_READ, len);
+	if (!wbuf_read(kvs, &krd_cb, value, len, &rc)) {
+		rc = entry_get_nolock(&ent, kvs, &krd_cb, true, value, len);
+	}
+
+	if (rc == -KVS_ENOENT) {
+		rc = defaults_read(kvs, key, klen, value, len);
+	}
+
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_READ, rc);
+	return rc;
+}
+
+int kvs_read_id(const struct kvs *kvs, uint16_t id, void *value, size_t len)
+{
+	if ((kvs == NULL) || (!kvs->data->ready)) {
+		return -KVS_EINVAL;
+	}
+
+	uint8_t key[KVS_KEYIDSIZE];
+	struct read_cb krd_cb;
+	struct kvs_ent ent;
+	int rc;
+
+	key_id(id, key, &krd_cb);
+	kvs_stat_add(kvs, lookups, 1U);
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_READ, len);
+	if (!wbuf_read(kvs, &krd_cb, value, len, &rc)) {
+		rc = entry_get_nolock(&ent, kvs, &krd_cb, true, value, len);
+	}
+
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_READ, rc);
+	return rc;
+}
+
+/* states of a read request while the keys are searched */
+enum read_many_state {
+	READ_MANY_SEARCH = 1,	/* no entry found yet */
+	READ_MANY_BLOCK,	/* entry found in the block that is walked */
+	READ_MANY_FOUND,	/* last entry found */
+};
+
+struct read_many_cb_arg {
+	struct kvs_read_req *req;
+	size_t cnt;
+};
+
+/* get the read callback of the stored key of a request */
+static void read_many_key(const struct kvs_read_req *req, struct key_enc *enc,
+			  struct read_cb *rdkey)
+{
+	enc->key = req->key;
+	enc->dlen = req->kdlen;
+	enc->ref[0] = KVS_KEYREF;
+	enc->ref[1] = req->kid;
+	key_rdcb(enc, req->klen, rdkey);
+}
+
+static int read_many_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	const struct read_many_cb_arg *arg =
+		(const struct read_many_cb_arg *)cb_arg;
+	const uint32_t klen = entry_get_klen(ent);
+	const struct read_cb readkey = {
+		.ctx = (void *)ent,
+		.off = 0U,
+		.len = klen,
+		.read = read_cb_entry,
+	};
+
+	for (size_t i = 0U; i < arg->cnt; i++) {
+		struct kvs_read_req *req = &arg->req[i];
+		struct key_enc enc;
+		struct read_cb rdkey;
+
+		if (req->rc == READ_MANY_FOUND) {
+			continue;
+		}
+
+		read_many_key(req, &enc, &rdkey);
+		if ((rdkey.len != klen) || (differ(&readkey, &rdkey))) {
+			continue;
+		}
+
+		/* as in entry_get_cb(), ent.pcnt counts the patches in the
+		 * block after the last entry.
+		 */
+		if (ent->type == KVS_TYPE_PATCH) {
+			req->ent.pcnt++;
+			continue;
+		}
+
+		memcpy(&req->ent, ent, sizeof(struct kvs_ent));
+		req->ent.pcnt = 0U;
+		req->rc = READ_MANY_BLOCK;
+	}
+
+	return 0;
+}
+
+/* find the last entries for the requests that are searched (like
+ * entry_find()), returns the number of requests that are still searched.
+ */
+static size_t read_many_find(const struct kvs *kvs, struct kvs_read_req *req,
+			     size_t cnt, size_t left)
+{
+	const struct kvs_cfg *cfg = kvs->cfg;
+	const size_t bsz = cfg->bsz;
+	const uint32_t bcnt = cfg->bcnt - cfg->bspr;
+	const struct read_cb rdkey = {
+		.ctx = (void *)NULL,
+		.off = 0U,
+		.len = 0U,
+		.read = read_cb_ptr,
+	};
+	struct read_many_cb_arg cb_arg = {
+		.req = req,
+		.cnt = cnt,
+	};
+	struct entry_cb cb = {
+		.cb = read_many_cb,
+		.cb_arg = (void *)&cb_arg,
+	};
+	struct kvs_ent wlk = {
+		.kvs = (struct kvs *)kvs,
+	};
+	uint32_t stop = kvs->data->pos;
+	uint32_t start = kvs->data->bend - bsz;
+
+	for (uint32_t i = 0; (i < bcnt) && (left != 0U); i++) {
+		wlk.next = start;
+		(void)walk(&wlk, &rdkey, &cb, stop);
+		for (size_t j = 0U; j < cnt; j++) {
+			switch (req[j].rc) {
+			case READ_MANY_SEARCH:
+				req[j].pcnt += req[j].ent.pcnt;
+				req[j].ent.pcnt = 0U;
+				break;
+			case READ_MANY_BLOCK:
+				req[j].ent.pcnt += req[j].pcnt;
+				req[j].rc = READ_MANY_FOUND;
+				left--;
+				break;
+			default:
+				break;
+			}
+
+		}
+
+		stop = (start == 0U) ? (cfg->bcnt * cfg->bsz) : start;
+		start = stop - bsz;
+	}
+
+	return left;
+}
+
+/* get the values of the requests, keys without entry are retrieved from the
+ * segment or the cold kvs.
+ */
+static void read_many_get(const struct kvs *kvs, struct kvs_read_req *req,
+			  size_t cnt)
+{
+	struct kvs *cold = kvs_cold(kvs);
+	size_t left = cnt;
+
+	for (size_t i = 0U; i < cnt; i++) {
+		req[i].rc = READ_MANY_SEARCH;
+		req[i].ent.pcnt = 0U;
+		req[i].pcnt = 0U;
+	}
+
+	left = read_many_find(kvs, req, cnt, left);
+	for (size_t i = 0U; (i < cnt) && (left != 0U); i++) {
+		struct key_enc enc;
+		struct read_cb rdkey;
+
+		read_many_key(&req[i], &enc, &rdkey);
+		if ((req[i].rc == READ_MANY_SEARCH) &&
+		    (seg_find(&req[i].ent, kvs, &rdkey) == 0)) {
+			req[i].rc = READ_MANY_FOUND;
+			left--;
+		}
+
+	}
+
+	if ((left != 0U) && (cold != NULL)) {
+		(void)read_many_find(cold, req, cnt, left);
+	}
+
+	for (size_t i = 0U; i < cnt; i++) {
+		struct kvs_read_req *rq = &req[i];
+
+		if ((rq->rc != READ_MANY_FOUND) ||
+		    (entry_get_vlen((&rq->ent)) == 0U)) {
+			rq->rc = -KVS_ENOENT;
+			continue;
+		}
+
+		rq->rc = entry_data_get(&rq->ent, entry_get_klen((&rq->ent)),
+					rq->value, rq->len);
+	}
+
+}
+
+int kvs_read_many(const struct kvs *kvs, struct kvs_read_req *req, size_t cnt)
+{
+	if ((kvs == NULL) || (!kvs->data->ready) ||
+	    ((req == NULL) && (cnt != 0U))) {
+		return -KVS_EINVAL;
+	}
+
+	bool locked = false;
+	uint32_t seq;
+	int rc = 0;
+
+	for (size_t i = 0U; i < cnt; i++) {
+		if (req[i].key == NULL) {
+			return -KVS_EINVAL;
+		}
+
+		struct key_enc enc;
+
+		req[i].klen = strlen(req[i].key);
+		key_find(kvs, req[i].key, req[i].klen, &enc);
+		req[i].kdlen = enc.dlen;
+		req[i].kid = enc.ref[1];
+	}
+
+	kvs_stat_add(kvs, lookups, cnt);
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_READ_MANY, cnt);
+	/* redone when a block advance happens meanwhile (see
+	 * entry_get_nolock())
+	 */
+	for (uint32_t i = 0U; ; i++) {
+		if (i == KVS_SEQRETRIES) {
+			rc = kvs_dev_lock(kvs);
+			if (rc != 0) {
+				goto end;
+			}
+
+			locked = true;
+		}
+
+		seq = kvs_seq_begin(kvs);
+		read_many_get(kvs, req, cnt);
+		if (locked || kvs_seq_end(kvs, seq)) {
+			break;
+		}
+
+		kvs_stat_add(kvs, retries, 1U);
+	}
+
+	if (locked) {
+		(void)kvs_dev_unlock(kvs);
+	}
+
+	for (size_t i = 0U; i < cnt; i++) {
+		struct key_enc enc;
+		struct read_cb rdkey;
+		int wrc;
+
+		read_many_key(&req[i], &enc, &rdkey);
+		if (wbuf_read(kvs, &rdkey, req[i].value, req[i].len, &wrc)) {
+			req[i].rc = wrc;
+		}
+
+		if (req[i].rc == -KVS_ENOENT) {
+			req[i].rc = defaults_read(kvs, req[i].key, req[i].klen,
+						  req[i].value, req[i].len);
+		}
+
+	}
+
+end:
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_READ_MANY, rc);
+	return rc;
+}
+
+const struct kvs_default *kvs_defaults_get(const struct kvs_defaults *defaults,
+					   const char *key)
+{
+	if (key == NULL) {
+		return NULL;
+	}
+
+	return defaults_get(defaults, key, strlen(key));
+}
+
+struct entry_add_arg {
+	struct read_cb key;
+	uint32_t off;
+	const void *value;
+	size_t len;
+	uint32_t csz;
+	uint8_t gen;
+	const struct chunk_key *wr;	/* chunked value being written */
+};
+
+/* add a entry, garbage collect when there is no space (kvs is locked) */
+static int entry_add_locked(const struct kvs *kvs,
+			    int (*add)(struct kvs_ent *ent,
+				       const struct entry_add_arg *arg),
+			    const struct entry_add_arg *arg)
+{
+	struct kvs_ent ent = {
+		.kvs = (struct kvs *)kvs,
+	};
+	uint32_t cnt = kvs->cfg->bcnt;
+	int rc;
+
+	while (cnt != 0U) {
+		rc = add(&ent, arg);
+		if ((rc == 0) || (rc == -KVS_ENOENT)) {
+			return rc;
+		}
+
+		uint32_t stop = block_advance_n(kvs, kvs->data->bend, 
+						kvs->cfg->bspr + 1);
+		rc = compact(kvs, stop, arg->wr);
+		if (rc == -KVS_EAGAIN) {
+			return rc;
+		}
+
+		cnt--;
+	}
+
+	return -KVS_ENOSPC;
+}
+
+static int entry_add_retry(const struct kvs *kvs,
+			   int (*add)(struct kvs_ent *ent,
+				      const struct entry_add_arg *arg),
+			   const struct entry_add_arg *arg)
+{
+	int rc;
+
+	rc = kvs_dev_lock(kvs);
+	if (rc) {
+		return rc;
+	}
+
+	rc = entry_add_locked(kvs, add, arg);
+	(void)kvs_dev_unlock(kvs);
+	return rc;
+}
+
+/* get the space used by the meta entry at the start of each block */
+static uint32_t meta_space(const struct kvs *kvs)
+{
+	return entry_space(kvs, 0U, KVS_WRAPCNTSIZE + kvs->data->csz);
+}
+
+/* get the chunk size for a value, two chunks fit in a block */
+static uint32_t chunk_size(const struct kvs *kvs, uint32_t key_len)
+{
+	const uint32_t half = KVS_ALIGNDOWN((kvs->cfg->bsz - meta_space(kvs)) /
+					    2U, kvs->cfg->psz);
+	const uint32_t ovh = KVS_HDRSIZE + key_len + KVS_CHUNKSFXSIZE +
+			     KVS_KVCRCSIZE;
+
+	if (half <= ovh) {
+		return 0U;
+	}
+
+	return KVS_MIN(half - ovh, KVS_HDRVALMASK);
+}
+
+/* check if a value fits in a entry (values that do not fit are chunked) */
+static bool value_fits(const struct kvs *kvs, uint32_t klen, size_t len)
+{
+	return (len <= KVS_HDRVALMASK) &&
+	       ((entry_space(kvs, klen, len) + meta_space(kvs)) <=
+		kvs->cfg->bsz);
+}
+
+static int entry_write_cb(struct kvs_ent *ent, const struct entry_add_arg *arg)
+{
+	struct kvs_ent old = {
+		.kvs = ent->kvs,
+	};
+
+	return entry_add(ent, &arg->key, arg->value, arg->len,
+			 blive_find(&old, &arg->key));
+}
+
+/* update the value of a entry in place, the new entry is first written as a
+ * shadow at the write position: when the update is interrupted the shadow is
+ * the last entry for the key, afterwards it is removed by the sync (that
+ * marks the end of the entries at the write position).
+ */
+static int entry_update(struct kvs_ent *ent, const struct entry_add_arg *arg)
+{
+	const struct kvs *kvs = ent->kvs;
+	struct kvs_data *data = kvs->data;
+	const uint32_t pos = data->pos;
+	const uint32_t klen = entry_get_klen(ent);
+	const struct read_cb vrd_cb = {
+		.ctx = (void *)arg->value,
+		.off = 0U,
+		.len = arg->len,
+		.read = read_cb_ptr,
+	};
+	struct kvs_ent shadow = {
+		.kvs = ent->kvs,
+	};
+	uint32_t crc = KVS_KVCRCINIT;
+	int rc;
+
+	/* a block starts with a meta entry */
+	if ((pos & (kvs->cfg->bsz - 1U)) == 0U) {
+		return -KVS_ENOSPC;
+	}
+
+	/* the shadow is a complete entry (its end is marked before the header
+	 * is written) that holds the value if the update is interrupted.
+	 */
+	rc = entry_write_kv(&shadow, KVS_TYPE_PLAIN, &arg->key, &vrd_cb);
+	if (rc != 0) {
+		return rc;
+	}
+
+	for (uint32_t off = 0U; off < klen; off += KVS_BUFSIZE) {
+		uint8_t buf[KVS_BUFSIZE];
+		const uint32_t rdlen = KVS_MIN(klen - off, KVS_BUFSIZE);
+
+		rc = entry_data_read(ent, off, buf, rdlen);
+		if (rc != 0) {
+			goto end;
+		}
+
+		crc = crc32(crc, buf, rdlen);
+	}
+
+	/* readers without lock redo a read that overlaps the update */
+	(void)__atomic_add_fetch(&data->seq, 1U, __ATOMIC_SEQ_CST);
+	rc = entry_write_data(ent, KVS_HDRSIZE + klen, &vrd_cb, &crc);
+	if (rc == 0) {
+		rc = entry_write_crc(ent, KVS_HDRSIZE + klen + arg->len, crc);
+	}
+
+	if (rc == 0) {
+		rc = kvs_dev_sync(kvs);
+	}
+
+	(void)__atomic_add_fetch(&data->seq, 1U, __ATOMIC_SEQ_CST);
+	if (rc != 0) {
+		goto end;
+	}
+
+	data->pos = pos;
+	kvs_stat_add(kvs, inplace, 1U);
+	return kvs_dev_sync(kvs);
+end:
+	/* the shadow replaces the entry */
+	blive_add(&shadow);
+	blive_sub(ent);
+	return rc;
+}
+
+/* update values of the same length in place, other values are added */
+static int entry_update_cb(struct kvs_ent *ent,
+			   const struct entry_add_arg *arg)
+{
+	struct kvs_ent old = {
+		.kvs = ent->kvs,
+	};
+	const struct kvs_ent *found = NULL;
+	int rc;
+
+	if ((arg->len == 0U) || (ent->kvs->data->snaps != NULL)) {
+		return entry_write_cb(ent, arg);
+	}
+
+	/* the entry found here is also the one that the new entry replaces */
+	if (entry_find(&old, &arg->key) == 0) {
+		found = &old;
+	}
+
+	if ((found != NULL) && (old.type == KVS_TYPE_PLAIN) &&
+	    (old.pcnt == 0U) && (entry_get_vlen(&old) == arg->len)) {
+		rc = entry_update(&old, arg);
+		if (rc != -KVS_ENOSPC) {
+			return rc;
+		}
+
+	}
+
+	return entry_add(ent, &arg->key, arg->value, arg->len, found);
+}
+
+static int entry_copy_cb(struct kvs_ent *ent, const struct entry_add_arg *arg)
+{
+	struct kvs_ent old = {
+		.kvs = ent->kvs,
+	};
+
+	return entry_copy(ent, (const struct kvs_ent *)arg->value,
+			  blive_find(&old, &arg->key));
+}
+
+/* move a entry to the cold kvs, chunked values are not moved */
+static int cold_move(const struct kvs_ent *ent)
+{
+	struct kvs *cold = kvs_cold(ent->kvs);
+	const struct entry_add_arg arg = {
+		.key = {
+			.ctx = (void *)ent,
+			.off = 0U,
+			.len = entry_get_klen(ent),
+			.read = read_cb_entry,
+		},
+		.value = (entry_get_vlen(ent) == 0U) ? NULL : (void *)ent,
+		.len = 0U,
+	};
+
+	if ((cold == NULL) || (ent->type == KVS_TYPE_CHUNK) ||
+	    (ent->type == KVS_TYPE_CDIR)) {
+		return -KVS_ENOENT;
+	}
+
+	if (cold_has(ent)) {
+		return 0;
+	}
+
+	kvs_stat_add(ent->kvs, moves, 1U);
+	if (arg.value == NULL) {
+		return entry_add_retry(cold, entry_write_cb, &arg);
+	}
+
+	return entry_add_retry(cold, entry_copy_cb, &arg);
+}
+
+static int entry_write_chunk_cb(struct kvs_ent *ent,
+				const struct entry_add_arg *arg)
+{
+	const struct read_cb vrd_cb = {
+		.ctx = arg->value,
+		.off = 0U,
+		.len = arg->len,
+		.read = read_cb_ptr,
+	};
+
+	/* chunks of a new generation do not replace a live chunk */
+	return entry_append(ent, KVS_TYPE_CHUNK, &arg->key, &vrd_cb, NULL);
+}
+
+static int entry_write_cdir_cb(struct kvs_ent *ent,
+			       const struct entry_add_arg *arg)
+{
+	uint8_t buf[KVS_CDIRSIZE];
+	const struct read_cb vrd_cb = {
+		.ctx = (void *)buf,
+		.off = 0U,
+		.len = sizeof(buf),
+		.read = read_cb_ptr,
+	};
+	struct kvs_ent old = {
+		.kvs = ent->kvs,
+	};
+
+	put_le32(buf, arg->len);
+	put_le16(&buf[4], arg->csz);
+	buf[6] = arg->gen;
+	return entry_append(ent, KVS_TYPE_CDIR, &arg->key, &vrd_cb,
+			    blive_find(&old, &arg->key));
+}
+
+/* write the chunks of a value followed by the chunk directory */
+static int entry_write_chunks(const struct kvs *kvs,
+			      const struct entry_add_arg *arg)
+{
+	const uint8_t *value = (const uint8_t *)arg->value;
+	const uint32_t csz = chunk_size(kvs, arg->key.len);
+	struct chunk_key ck = {
+		.key = arg->key,
+	};
+	struct entry_add_arg carg = *arg;
+	uint32_t off;
+	int rc;
+
+	/* chunks of a replaced value can have the same generation, only the
+	 * chunks written from here on belong to the value.
+	 */
+	ck.wrapcnt = kvs->data->wrapcnt;
+	ck.pos = kvs->data->pos;
+	carg.wr = &ck;
+	if ((csz == 0U) ||
+	    ((arg->key.len + KVS_CHUNKSFXSIZE) > KVS_HDRKEYMASK) ||
+	    (((arg->len - 1U) / csz) > KVS_HDRVALMASK)) {
+		return -KVS_EINVAL;
+	}
+
+	for (off = 0U; off < arg->len; off += csz) {
+		chunk_key_init(&ck, &carg.key, arg->gen, off / csz);
+		carg.value = value + off;
+		carg.len = KVS_MIN(csz, arg->len - off);
+		rc = entry_add_retry(kvs, entry_write_chunk_cb, &carg);
+		if (rc != 0) {
+			goto end;
+		}
+
+	}
+
+	carg.key = arg->key;
+	carg.len = arg->len;
+	carg.csz = csz;
+	rc = entry_add_retry(kvs, entry_write_cdir_cb, &carg);
+end:
+	/* the chunks that have been written are not used */
+	if ((rc != 0) && (kvs_dev_lock(kvs) == 0)) {
+		blive_release_chunks(kvs, &arg->key, arg->gen,
+				     (KVS_MIN(off, arg->len) + csz - 1U) / csz);
+		(void)kvs_dev_unlock(kvs);
+	}
+
+	return rc;
+}
+
+/* write a value to memory */
+static int value_store(const struct kvs *kvs, const struct read_cb *rdkey,
+		       const void *value, size_t len)
+{
+	struct kvs_ent wlk;
+	struct kvs_ent *ent = &wlk;
+	uint8_t gen = 0U;
+
+	kvs_stat_add(kvs, lookups, 1U);
+	if (entry_get_nolock(ent, kvs, rdkey, false, NULL, 0U) == 0) {
+		if (ent->type == KVS_TYPE_CDIR) {
+			uint32_t vlen, csz;
+
+			(void)entry_get_cdir(ent, &vlen, &csz, &gen);
+			gen++;
+		}
+
+		if (entry_get_vlen(ent) == len) {
+			if (len == 0U) {
+				return 0;
+			}
+			const struct read_cb val_rd = {
+				.ctx = (void *)value,
+				.len = len,
+				.off = 0U,
+				.read = read_cb_ptr,
+			};
+			struct value_rd vr = {
+				.ent = ent,
+			};
+			const struct read_cb entval_rd = {
+				.ctx = (void *)&vr,
+				.off = entry_get_klen(ent),
+				.len = entry_get_vlen(ent),
+				.read = read_cb_value,
+			};
+
+			if (!differ(&val_rd, &entval_rd)) {
+		 		return 0;
+			}
+
+		}
+
+	}
+
+	const struct entry_add_arg arg = {
+		.key = *rdkey,
+		.off = 0U,
+		.value = value,
+		.len = len,
+		.gen = gen,
+	};
+
+	/* values that do not fit in a block are stored in chunks */
+	if (!value_fits(kvs, rdkey->len, len)) {
+		return entry_write_chunks(kvs, &arg);
+	}
+
+	if (kvs->data->inplace) {
+		return entry_add_retry(kvs, entry_update_cb, &arg);
+	}
+
+	return entry_add_retry(kvs, entry_write_cb, &arg);
+}
+
+/* states of a write buffer record while the flush compares it with the
+ * value in memory
+ */
+enum wbuf_state {
+	WBUF_SEARCH = 0,	/* no entry found yet */
+	WBUF_BLOCK_SAME,	/* same value in the block that is walked */
+	WBUF_BLOCK_DIFF,	/* other value in the block that is walked */
+	WBUF_SAME,		/* last entry has the same value */
+	WBUF_DIFF,		/* last entry has a other value */
+};
+
+/* get the length of the write buffer record at rec */
+static uint32_t wbuf_rlen(const uint8_t *rec)
+{
+	return KVS_WBUFHDRSIZE + rec[0] + get_le16(&rec[1]);
+}
+
+/* find the record of a (stored) key in the write buffer */
+static uint32_t wbuf_find(const struct kvs_wbuf *wbuf,
+			  const struct read_cb *rdkey)
+{
+	uint32_t off = 0U;
+
+	while (off < wbuf->used) {
+		const uint8_t *rec = &wbuf->buf[off];
+		const struct read_cb reckey = {
+			.ctx = (void *)&rec[KVS_WBUFHDRSIZE],
+			.off = 0U,
+			.len = rec[0],
+			.read = read_cb_ptr,
+		};
+
+		if (!differ(&reckey, rdkey)) {
+			return off;
+		}
+
+		off += wbuf_rlen(rec);
+	}
+
+	return UINT32_MAX;
+}
+
+/* remove the record at off from the write buffer */
+static void wbuf_remove(struct kvs_wbuf *wbuf, uint32_t off)
+{
+	const uint8_t *rec = &wbuf->buf[off];
+	const uint32_t rlen = wbuf_rlen(rec);
+
+	memmove(&wbuf->buf[off], &wbuf->buf[off + rlen],
+		wbuf->used - off - rlen);
+	wbuf->used -= rlen;
+}
+
+/* check if a entry holds the value of a write buffer record, a entry that is
+ * patched is considered to differ.
+ */
+static bool wbuf_same(struct kvs_ent *ent, const uint8_t *rec)
+{
+	const uint32_t vlen = get_le16(&rec[1]);
+	const struct read_cb val_rd = {
+		.ctx = (void *)&rec[KVS_WBUFHDRSIZE + rec[0]],
+		.off = 0U,
+		.len = vlen,
+		.read = read_cb_ptr,
+	};
+	struct value_rd vr = {
+		.ent = ent,
+	};
+	const struct read_cb entval_rd = {
+		.ctx = (void *)&vr,
+		.off = entry_get_klen(ent),
+		.len = entry_get_vlen(ent),
+		.read = read_cb_value,
+	};
+
+	if ((ent->type == KVS_TYPE_PATCH) || (ent->type == KVS_TYPE_CDIR) ||
+	    (entry_get_vlen(ent) != vlen)) {
+		return false;
+	}
+
+	return (vlen == 0U) || (!differ(&val_rd, &entval_rd));
+}
+
+static int wbuf_scan_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	struct kvs_wbuf *wbuf = (struct kvs_wbuf *)cb_arg;
+	const uint32_t klen = entry_get_klen(ent);
+	const struct read_cb readkey = {
+		.ctx = (void *)ent,
+		.off = 0U,
+		.len = klen,
+		.read = read_cb_entry,
+	};
+
+	uint32_t off = 0U;
+
+	while (off < wbuf->used) {
+		uint8_t *rec = &wbuf->buf[off];
+		const struct read_cb rdkey = {
+			.ctx = (void *)&rec[KVS_WBUFHDRSIZE],
+			.off = 0U,
+			.len = klen,
+			.read = read_cb_ptr,
+		};
+
+		off += wbuf_rlen(rec);
+		if ((rec[3] >= WBUF_SAME) || (rec[0] != klen) ||
+		    (differ(&readkey, &rdkey))) {
+			continue;
+		}
+
+		/* the entries of a block are walked from old to new, a later
+		 * entry (or patch) replaces the state.
+		 */
+		struct kvs_ent cur = *ent;
+
+		cur.pcnt = 0U;
+		rec[3] = wbuf_same(&cur, rec) ? WBUF_BLOCK_SAME :
+						WBUF_BLOCK_DIFF;
+	}
+
+	return 0;
+}
+
+/* compare the records that are searched with the last entry of their key
+ * (like read_many_find()) in one walk of the kvs from the newest to the
+ * oldest block, returns the number of records that are still searched.
+ */
+static size_t wbuf_scan(const struct kvs *kvs, struct kvs_wbuf *wbuf,
+			size_t left)
+{
+	const struct kvs_cfg *cfg = kvs->cfg;
+	const size_t bsz = cfg->bsz;
+	const uint32_t bcnt = cfg->bcnt - cfg->bspr;
+	const struct read_cb rdkey = {
+		.ctx = (void *)NULL,
+		.off = 0U,
+		.len = 0U,
+		.read = read_cb_ptr,
+	};
+	struct entry_cb cb = {
+		.cb = wbuf_scan_cb,
+		.cb_arg = (void *)wbuf,
+	};
+	struct kvs_ent wlk = {
+		.kvs = (struct kvs *)kvs,
+	};
+	uint32_t stop = kvs->data->pos;
+	uint32_t start = kvs->data->bend - bsz;
+
+	for (uint32_t i = 0; (i < bcnt) && (left != 0U); i++) {
+		wlk.next = start;
+		(void)walk(&wlk, &rdkey, &cb, stop);
+		for (uint32_t off = 0U; off < wbuf->used;) {
+			uint8_t *rec = &wbuf->buf[off];
+
+			off += wbuf_rlen(rec);
+			if ((rec[3] == WBUF_BLOCK_SAME) ||
+			    (rec[3] == WBUF_BLOCK_DIFF)) {
+				rec[3] += (WBUF_SAME - WBUF_BLOCK_SAME);
+				left--;
+			}
+
+		}
+
+		stop = (start == 0U) ? (cfg->bcnt * cfg->bsz) : start;
+		start = stop - bsz;
+	}
+
+	return left;
+}
+
+/* find the records that hold the value that is in memory, keys without entry
+ * are retrieved from the segment or the cold kvs. A delete of a key without
+ * value is not needed.
+ */
+static void wbuf_compare(const struct kvs *kvs, struct kvs_wbuf *wbuf)
+{
+	struct kvs *cold = kvs_cold(kvs);
+	size_t left = 0U;
+
+	for (uint32_t off = 0U; off < wbuf->used;) {
+		uint8_t *rec = &wbuf->buf[off];
+
+		off += wbuf_rlen(rec);
+		rec[3] = WBUF_SEARCH;
+		left++;
+	}
+
+	kvs_stat_add(kvs, lookups, 1U);
+	left = wbuf_scan(kvs, wbuf, left);
+	for (uint32_t off = 0U; (off < wbuf->used) && (left != 0U);) {
+		uint8_t *rec = &wbuf->buf[off];
+		const struct read_cb rdkey = {
+			.ctx = (void *)&rec[KVS_WBUFHDRSIZE],
+			.off = 0U,
+			.len = rec[0],
+			.read = read_cb_ptr,
+		};
+		struct kvs_ent ent;
+
+		off += wbuf_rlen(rec);
+		if ((rec[3] == WBUF_SEARCH) &&
+		    (seg_find(&ent, kvs, &rdkey) == 0)) {
+			rec[3] = wbuf_same(&ent, rec) ? WBUF_SAME : WBUF_DIFF;
+			left--;
+		}
+
+	}
+
+	if ((left != 0U) && (cold != NULL)) {
+		(void)wbuf_scan(cold, wbuf, left);
+	}
+
+	for (uint32_t off = 0U; off < wbuf->used;) {
+		uint8_t *rec = &wbuf->buf[off];
+
+		off += wbuf_rlen(rec);
+		if (rec[3] == WBUF_SEARCH) {
+			rec[3] = (get_le16(&rec[1]) == 0U) ? WBUF_SAME :
+							     WBUF_DIFF;
+		}
+
+	}
+
+}
+
+/* write the records in the write buffer to memory (kvs is locked), the
+ * records that are not written stay in the buffer. The records are compared
+ * with the values in memory in one walk, the entries are appended without
+ * sync and synced once at the end.
+ */
+static int wbuf_flush(const struct kvs *kvs)
+{
+	struct kvs_wbuf *wbuf = kvs->data->wbuf;
+	bool written = false;
+	int rc = 0;
+
+	if ((wbuf == NULL) || (wbuf->used == 0U)) {
+		return 0;
+	}
+
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_FLUSH, wbuf->used);
+	wbuf_compare(kvs, wbuf);
+	wbuf->flushing = true;
+	while (wbuf->used != 0U) {
+		const uint8_t *rec = wbuf->buf;
+		const uint32_t vlen = get_le16(&rec[1]);
+		const struct entry_add_arg arg = {
+			.key = {
+				.ctx = (void *)&rec[KVS_WBUFHDRSIZE],
+				.off = 0U,
+				.len = rec[0],
+				.read = read_cb_ptr,
+			},
+			.off = 0U,
+			.value = (vlen == 0U) ? NULL :
+				 &rec[KVS_WBUFHDRSIZE + rec[0]],
+			.len = vlen,
+		};
+
+		if (rec[3] == WBUF_DIFF) {
+			rc = entry_add_locked(kvs, kvs->data->inplace ?
+					      entry_update_cb : entry_write_cb,
+					      &arg);
+			if (rc != 0) {
+				break;
+			}
+
+			written = true;
+		}
+
+		wbuf_remove(wbuf, 0U);
+	}
+
+	wbuf->flushing = false;
+	if (written) {
+		int src = kvs_dev_sync(kvs);
+
+		rc = (rc == 0) ? src : rc;
+	}
+
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_FLUSH, rc);
+	return rc;
+}
+
+/* check if the oldest record in the write buffer has waited interval */
+static bool wbuf_expired(const struct kvs_wbuf *wbuf)
+{
+	return (wbuf->used != 0U) && (wbuf->now != NULL) &&
+	       ((wbuf->now() - wbuf->start) >= wbuf->interval);
+}
+
+/* write a value to the write buffer, it replaces a buffered value of the key.
+ * Values that do not fit in the buffer are written to memory.
+ */
+static int wbuf_write(const struct kvs *kvs, const struct read_cb *rdkey,
+		      const void *value, size_t len)
+{
+	const size_t klen = rdkey->len;
+	const uint32_t rlen = KVS_WBUFHDRSIZE + klen + len;
+	struct kvs_wbuf *wbuf;
+	uint32_t off;
+	uint8_t *rec;
+	bool empty;
+	int rc;
+
+	rc = kvs_dev_lock(kvs);
+	if (rc != 0) {
+		return rc;
+	}
+
+	/* the buffer can be detached by kvs_wbuf_attach() before the lock */
+	wbuf = kvs->data->wbuf;
+	if (wbuf == NULL) {
+		(void)kvs_dev_unlock(kvs);
+		return value_store(kvs, rdkey, value, len);
+	}
+
+	/* a replaced value keeps the time of the oldest buffered write */
+	empty = (wbuf->used == 0U);
+	off = wbuf_find(wbuf, rdkey);
+	if (off != UINT32_MAX) {
+		kvs_stat_add(kvs, coalesced, 1U);
+		wbuf_remove(wbuf, off);
+	}
+
+	if ((klen > KVS_HDRKEYMASK) || (rlen > wbuf->size) ||
+	    (!value_fits(kvs, klen, len))) {
+		(void)kvs_dev_unlock(kvs);
+		return value_store(kvs, rdkey, value, len);
+	}
+
+	if ((wbuf->size - wbuf->used) < rlen) {
+		rc = wbuf_flush(kvs);
+		if (rc != 0) {
+			goto end;
+		}
+
+		empty = true;
+	}
+
+	if (empty && (wbuf->now != NULL)) {
+		wbuf->start = wbuf->now();
+	}
+
+	rec = &wbuf->buf[wbuf->used];
+	rec[0] = (uint8_t)klen;
+	put_le16(&rec[1], len);
+	rec[3] = WBUF_SEARCH;
+	(void)rdkey->read(rdkey->ctx, rdkey->off, &rec[KVS_WBUFHDRSIZE], klen);
+	if (len != 0U) {
+		memcpy(&rec[KVS_WBUFHDRSIZE + klen], value, len);
+	}
+
+	wbuf->used += rlen;
+	if (wbuf_expired(wbuf)) {
+		rc = wbuf_flush(kvs);
+	}
+
+end:
+	(void)kvs_dev_unlock(kvs);
+	return rc;
+}
+
+/* read a value from the write buffer, returns false when the key has no
+ * value in the buffer. A buffered delete gives -KVS_ENOENT.
+ */
+static bool wbuf_read(const struct kvs *kvs, const struct read_cb *rdkey,
+		      void *value, size_t len, int *rc)
+{
+	struct kvs_wbuf *wbuf = kvs->data->wbuf;
+	const uint8_t *rec;
+	uint32_t off;
+
+	/* a empty buffer holds no value, the read does not need the lock */
+	if ((wbuf == NULL) || (wbuf->used == 0U)) {
+		return false;
+	}
+
+	*rc = kvs_dev_lock(kvs);
+	if (*rc != 0) {
+		return true;
+	}
+
+	wbuf = kvs->data->wbuf;
+	off = (wbuf == NULL) ? UINT32_MAX : wbuf_find(wbuf, rdkey);
+	if (off != UINT32_MAX) {
+		rec = &wbuf->buf[off];
+		if (get_le16(&rec[1]) == 0U) {
+			*rc = -KVS_ENOENT;
+		} else {
+			memcpy(value, &rec[KVS_WBUFHDRSIZE + rec[0]],
+			       KVS_MIN(len, get_le16(&rec[1])));
+		}
+
+	}
+
+	(void)kvs_dev_unlock(kvs);
+	return (off != UINT32_MAX);
+}
+
+int kvs_flush(const struct kvs *kvs)
+{
+	if ((kvs == NULL) || (!kvs->data->ready)) {
+		return -KVS_EINVAL;
+	}
+
+	int rc;
+
+	if (kvs->data->wbuf == NULL) {
+		return 0;
+	}
+
+	rc = kvs_dev_lock(kvs);
+	if (rc != 0) {
+		return rc;
+	}
+
+	rc = wbuf_flush(kvs);
+	(void)kvs_dev_unlock(kvs);
+	return rc;
+}
+
+int kvs_wbuf_attach(const struct kvs *kvs, struct kvs_wbuf *wbuf,
+		    struct kvs_wbuf **prev)
+{
+	if ((kvs == NULL) || (!kvs->data->ready) || (prev == NULL)) {
+		return -KVS_EINVAL;
+	}
+
+	int rc;
+
+	rc = kvs_dev_lock(kvs);
+	if (rc != 0) {
+		return rc;
+	}
+
+	rc = wbuf_flush(kvs);
+	if (rc == 0) {
+		*prev = kvs->data->wbuf;
+		kvs->data->wbuf = wbuf;
+	}
+
+	(void)kvs_dev_unlock(kvs);
+	return rc;
+}
+
+static int value_write_key(const struct kvs *kvs, const struct read_cb *rdkey,
+			   const void *value, size_t len)
+{
+	kvs_stat_add(kvs, writes, 1U);
+	kvs_stat_add(kvs, wr_bytes, len);
+	if (kvs->data->wbuf != NULL) {
+		return wbuf_write(kvs, rdkey, value, len);
+	}
+
+	return value_store(kvs, rdkey, value, len);
+}
+
+static int value_write(const struct kvs *kvs, const char *key,
+		       const void *value, size_t len)
+{
+	if ((kvs == NULL) || (!kvs->data->ready) || (key == NULL)) {
+		return -KVS_EINVAL;
+	}
+
+	struct key_enc enc;
+	struct read_cb rdkey;
+
+	key_encode(kvs, key, strlen(key), &enc, &rdkey);
+	return value_write_key(kvs, &rdkey, value, len);
+}
+
+int kvs_write(const struct kvs *kvs, const char *key, const void *value,
+	      size_t len)
+{
+	int rc;
+
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_WRITE, len);
+	rc = value_write(kvs, key, value, len);
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_WRITE, rc);
+	return rc;
+}
+
+static int read_cb_patch(const void *ctx, uint32_t off, void *data, size_t len)
+{
+	const struct entry_add_arg *arg = (const struct entry_add_arg *)ctx;
+	const uint8_t *value = (const uint8_t *)arg->value;
+	uint8_t *data8 = (uint8_t *)data;
+	uint8_t buf[KVS_PATCHOFFSIZE];
+
+	put_le16(buf, arg->off);
+	while ((len != 0U) && (off < KVS_PATCHOFFSIZE)) {
+		*data8++ = buf[off++];
+		len--;
+	}
+
+	memcpy(data8, value + off - KVS_PATCHOFFSIZE, len);
+	return 0;
+}
+
+struct entry_fold {
+	const struct kvs_ent *ent;
+	const struct entry_add_arg *arg;
+};
+
+/* read the value of a entry with the new data of arg applied */
+static int read_cb_fold(const void *ctx, uint32_t off, void *data, size_t len)
+{
+	const struct entry_fold *fold = (const struct entry_fold *)ctx;
+	const struct entry_add_arg *arg = fold->arg;
+	const uint8_t *value = (const uint8_t *)arg->value;
+	const uint32_t start = KVS_MAX(off, arg->off);
+	const uint32_t end = KVS_MIN(off + len, arg->off + arg->len);
+	int rc;
+
+	rc = entry_data_get(fold->ent, entry_get_klen(fold->ent) + off, data,
+			    len);
+	if ((rc == 0) && (start < end)) {
+		memcpy((uint8_t *)data + start - off, value + start - arg->off,
+		       end - start);
+	}
+
+	return rc;
+}
+
+/* add a patch for a existing entry or fold it when there are too many */
+static int entry_write_at_cb(struct kvs_ent *ent,
+			     const struct entry_add_arg *arg)
+{
+	struct kvs_ent cur = {
+		.kvs = ent->kvs,
+	};
+	const struct entry_fold fold = {
+		.ent = &cur,
+		.arg = arg,
+	};
+	struct read_cb vrd_cb = {
+		.ctx = (void *)arg,
+		.off = 0U,
+		.len = KVS_PATCHOFFSIZE + arg->len,
+		.read = read_cb_patch,
+	};
+	uint8_t type;
+	int rc;
+
+	/* the entry can be moved by compaction, get it on each attempt */
+	rc = entry_lookup(&cur, &arg->key);
+	if (rc != 0) {
+		return rc;
+	}
+
+	/* packed entries are not patched: a folded entry could be larger,
+	 * entries in the cold kvs are folded into a new entry.
+	 */
+	type = cur.type;
+	if ((type != KVS_TYPE_PACKED) && (cur.kvs == ent->kvs) &&
+	    ((cur.pcnt + 1U) < KVS_PATCHMAX) &&
+	    (vrd_cb.len < entry_get_vlen((&cur)))) {
+		return entry_append(ent, KVS_TYPE_PATCH, &arg->key, &vrd_cb,
+				    NULL);
+	}
+
+	if (type == KVS_TYPE_PACKED) {
+		type = KVS_TYPE_PLAIN;
+	}
+
+	vrd_cb.ctx = (void *)&fold;
+	vrd_cb.len = entry_get_vlen((&cur));
+	vrd_cb.read = read_cb_fold;
+	return entry_append(ent, type, &arg->key, &vrd_cb, &cur);
+}
+
+/* write part of a chunked value, each modified chunk is patched */
+static int entry_write_at_chunks(const struct kvs_ent *ent,
+				 const struct entry_add_arg *arg)
+{
+	const uint8_t *value = (const uint8_t *)arg->value;
+	struct chunk_key ck = {
+		.key = arg->key,
+	};
+	struct entry_add_arg carg = *arg;
+	uint32_t off = arg->off;
+	size_t len = arg->len;
+	uint32_t vlen, csz;
+	uint8_t gen;
+	int rc;
+
+	rc = entry_get_cdir(ent, &vlen, &csz, &gen);
+	if (rc != 0) {
+		return rc;
+	}
+
+	while (len != 0U) {
+		chunk_key_init(&ck, &carg.key, gen, off / csz);
+		carg.off = off % csz;
+		carg.value = value;
+		carg.len = KVS_MIN(len, csz - carg.off);
+		rc = entry_add_retry(ent->kvs, entry_write_at_cb, &carg);
+		if (rc != 0) {
+			return rc;
+		}
+
+		value += carg.len;
+		off += carg.len;
+		len -= carg.len;
+	}
+
+	return 0;
+}
+
+static int value_write_at(const struct kvs *kvs, const char *key, uint32_t off,
+			  const void *value, size_t len)
+{
+	if ((kvs == NULL) || (!kvs->data->ready) || (key == NULL) ||
+	    ((value == NULL) && (len != 0U))) {
+		return -KVS_EINVAL;
+	}
+
+	struct kvs_ent wlk;
+	struct kvs_ent *ent = &wlk;
+	int rc;
+
+	kvs_stat_add(kvs, writes, 1U);
+	kvs_stat_add(kvs, wr_bytes, len);
+	rc = kvs_entry_get(ent, kvs, key);
+	if (rc != 0) {
+		return rc;
+	}
+
+	if ((off > entry_get_vlen(ent)) || (len > (entry_get_vlen(ent) - off))) {
+		return -KVS_EINVAL;
+	}
+
+	/* the entry needs to fit in a block when the patches are folded */
+	if ((ent->type != KVS_TYPE_CDIR) &&
+	    ((entry_space(kvs, entry_get_klen(ent), entry_get_vlen(ent)) +
+	      meta_space(kvs)) > kvs->cfg->bsz)) {
+		return -KVS_ENOSPC;
+	}
+
+	const struct read_cb val_rd = {
+		.ctx = (void *)value,
+		.len = len,
+		.off = 0U,
+		.read = read_cb_ptr,
+	};
+	struct value_rd vr = {
+		.ent = ent,
+	};
+	const struct read_cb entval_rd = {
+		.ctx = (void *)&vr,
+		.off = entry_get_klen(ent) + off,
+		.len = len,
+		.read = read_cb_value,
+	};
+
+	if (!differ(&val_rd, &entval_rd)) {
+		return 0;
+	}
+
+	struct key_enc enc;
+	struct entry_add_arg arg = {
+		.off = off,
+		.value = value,
+		.len = len,
+	};
+
+	key_encode(kvs, key, strlen(key), &enc, &arg.key);
+	if (ent->type == KVS_TYPE_CDIR) {
+		return entry_write_at_chunks(ent, &arg);
+	}
+
+	return entry_add_retry(kvs, entry_write_at_cb, &arg);
+}
+
+int kvs_write_at(const struct kvs *kvs, const char *key, uint32_t off,
+		 const void *value, size_t len)
+{
+	int rc;
+
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_WRITE_AT, len);
+	rc = value_write_at(kvs, key, off, value, len);
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_WRITE_AT, rc);
+	return rc;
+}
+
+int kvs_delete(const struct kvs *kvs, const char *key)
+{
+	return kvs_write(kvs, key, NULL, 0);
+}
+
+int kvs_write_id(const struct kvs *kvs, uint16_t id, const void *value,
+		 size_t len)
+{
+	if ((kvs == NULL) || (!kvs->data->ready)) {
+		return -KVS_EINVAL;
+	}
+
+	uint8_t key[KVS_KEYIDSIZE];
+	struct read_cb rdkey;
+	int rc;
+
+	key_id(id, key, &rdkey);
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_WRITE, len);
+	rc = value_write_key(kvs, &rdkey, value, len);
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_WRITE, rc);
+	return rc;
+}
+
+int kvs_delete_id(const struct kvs *kvs, uint16_t id)
+{
+	return kvs_write_id(kvs, id, NULL, 0);
+}
+
+/* skip entries that are not reported to the user */
+static int skip_internal_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	const struct entry_cb *cb = (const struct entry_cb *)cb_arg;
+
+	if ((ent->type == KVS_TYPE_PATCH) || (ent->type == KVS_TYPE_CHUNK)) {
+		return 0;
+	}
+
+	return cb->cb(ent, cb->cb_arg);
+}
+
+struct prefix_cb_arg {
+	const char *key;
+	size_t len;
+	int (*cb)(struct kvs_ent *ent, void *cb_arg);
+	void *cb_arg;
+};
+
+/* skip entries whose key does not start with the prefix */
+static int prefix_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	const struct prefix_cb_arg *arg = (const struct prefix_cb_arg *)cb_arg;
+	const char *dkey = entry_key_dict(ent);
+	const size_t dlen = (dkey == NULL) ? 0U : strlen(dkey);
+	const uint32_t skip = (dkey == NULL) ? 0U : KVS_KEYREFSIZE;
+	const size_t cmplen = KVS_MIN(dlen, arg->len);
+	const struct read_cb readkey = {
+		.ctx = (void *)ent,
+		.off = skip,
+		.len = arg->len - cmplen,
+		.read = read_cb_entry,
+	};
+	const struct read_cb rdkey = {
+		.ctx = (void *)arg->key,
+		.off = cmplen,
+		.len = arg->len - cmplen,
+		.read = read_cb_ptr,
+	};
+
+	if (((dlen + entry_get_klen(ent) - skip) < arg->len) ||
+	    ((cmplen != 0U) && (memcmp(dkey, arg->key, cmplen) != 0)) ||
+	    (differ(&readkey, &rdkey))) {
+		return 0;
+	}
+
+	return arg->cb(ent, arg->cb_arg);
+}
+
+struct hot_missing_cb_arg {
+	const struct kvs *hot;
+	const struct entry_cb *cb;
+};
+
+/* skip entries of the cold kvs that have a entry in the hot kvs */
+static int hot_missing_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	const struct hot_missing_cb_arg *arg =
+		(const struct hot_missing_cb_arg *)cb_arg;
+	const struct read_cb rdkey = {
+		.ctx = (void *)ent,
+		.off = 0U,
+		.len = entry_get_klen(ent),
+		.read = read_cb_entry,
+	};
+	struct kvs_ent hot_ent = {
+		.kvs = (struct kvs *)arg->hot,
+	};
+
+	if (entry_find(&hot_ent, &rdkey) == 0) {
+		return 0;
+	}
+
+	return arg->cb->cb(ent, arg->cb->cb_arg);
+}
+
+static int walk_unique_nolock(const struct kvs *kvs, const char *key,
+			      int (*cb)(struct kvs_ent *ent, void *cb_arg),
+			      void *cb_arg)
+{
+	const struct prefix_cb_arg prefix_arg = {
+		.key = key,
+		.len = strlen(key),
+		.cb = cb,
+		.cb_arg = cb_arg,
+	};
+	struct entry_cb unique_cb = {
+		.cb = cb,
+		.cb_arg = cb_arg,
+	};
+	struct key_enc enc;
+	struct read_cb rdkey;
+
+	/* the stored keys are compared with the prefix one by one */
+	if (!key_encode_prefix(kvs, key, prefix_arg.len, &enc, &rdkey)) {
+		rdkey.len = 0U;
+		unique_cb.cb = prefix_cb;
+		unique_cb.cb_arg = (void *)&prefix_arg;
+	}
+
+	const struct entry_cb walk_cb = {
+		.cb = skip_internal_cb,
+		.cb_arg = (void *)&unique_cb,
+	};
+	struct kvs_ent wlk = {
+		.kvs = (struct kvs *)kvs,
+	};
+	struct kvs *cold;
+	int rc = 0;
+
+	wlk.next = block_advance_n(kvs, kvs->data->bend, kvs->cfg->bspr);
+
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_WALK_UNIQUE, rdkey.len);
+	if (kvs_seg(kvs) != NULL) {
+		const struct hot_missing_cb_arg seg_arg = {
+			.hot = kvs,
+			.cb = &unique_cb,
+		};
+		const struct entry_cb seg_cb = {
+			.cb = hot_missing_cb,
+			.cb_arg = (void *)&seg_arg,
+		};
+
+		rc = seg_walk(kvs, &rdkey, &seg_cb);
+	}
+
+	cold = kvs_cold(kvs);
+	if (cold != NULL) {
+		const struct hot_missing_cb_arg cold_arg = {
+			.hot = kvs,
+			.cb = &unique_cb,
+		};
+		const struct entry_cb cold_cb = {
+			.cb = hot_missing_cb,
+			.cb_arg = (void *)&cold_arg,
+		};
+		const struct entry_cb cold_walk_cb = {
+			.cb = skip_internal_cb,
+			.cb_arg = (void *)&cold_cb,
+		};
+		struct kvs_ent cold_wlk = {
+			.kvs = cold,
+			.next = block_advance_n(cold, cold->data->bend,
+						cold->cfg->bspr),
+		};
+
+		rc = walk_unique(&cold_wlk, &rdkey, &cold_walk_cb,
+				 cold->data->pos);
+	}
+
+	if (rc == 0) {
+		rc = walk_unique(&wlk, &rdkey, &walk_cb, kvs->data->pos);
+	}
+
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_WALK_UNIQUE, rc);
+	return rc;
+}
+
+int kvs_walk_unique(const struct kvs *kvs, const char *key,
+		    int (*cb)(struct kvs_ent *ent, void *cb_arg), void *cb_arg)
+{
+	if ((kvs == NULL) || (!kvs->data->ready)) {
+		return -KVS_EINVAL;
+	}
+
+	int rc;
+
+	rc = kvs_flush(kvs);
+	if (rc != 0) {
+		return rc;
+	}
+
+	rc = kvs_dev_rdlock(kvs);
+	if (rc != 0) {
+		return rc;
+	}
+
+	rc = walk_unique_nolock(kvs, key, cb, cb_arg);
+	(void)kvs_dev_rdunlock(kvs);
+	return rc;
+}
+
+static int walk_nolock(const struct kvs *kvs, const char *key,
+		       int (*cb)(struct kvs_ent *ent, void *cb_arg),
+		       void *cb_arg)
+{
+	const struct prefix_cb_arg prefix_arg = {
+		.key = key,
+		.len = strlen(key),
+		.cb = cb,
+		.cb_arg = cb_arg,
+	};
+	struct entry_cb entry_cb = {
+		.cb = cb,
+		.cb_arg = cb_arg,
+	};
+	struct key_enc enc;
+	struct read_cb rdkey;
+
+	/* the stored keys are compared with the prefix one by one */
+	if (!key_encode_prefix(kvs, key, prefix_arg.len, &enc, &rdkey)) {
+		rdkey.len = 0U;
+		entry_cb.cb = prefix_cb;
+		entry_cb.cb_arg = (void *)&prefix_arg;
+	}
+
+	const struct entry_cb walk_cb = {
+		.cb = skip_internal_cb,
+		.cb_arg = (void *)&entry_cb,
+	};
+	struct kvs_ent wlk = {
+		.kvs = (struct kvs *)kvs,
+	};
+	struct kvs *cold;
+	int rc = 0;
+
+	wlk.next = block_advance_n(kvs, kvs->data->bend, kvs->cfg->bspr);
+
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_WALK, rdkey.len);
+	/* entries in the segment are older */
+	rc = seg_walk(kvs, &rdkey, &walk_cb);
+	cold = kvs_cold(kvs);
+	/* entries in the cold kvs are older */
+	if (cold != NULL) {
+		struct kvs_ent cold_wlk = {
+			.kvs = cold,
+			.next = block_advance_n(cold, cold->data->bend,
+						cold->cfg->bspr),
+		};
+
+		rc = walk(&cold_wlk, &rdkey, &walk_cb, cold->data->pos);
+	}
+
+	if (rc == 0) {
+		rc = walk(&wlk, &rdkey, &walk_cb, kvs->data->pos);
+	}
+
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_WALK, rc);
+	return rc;
+}
+
+int kvs_walk(const struct kvs *kvs, const char *key,
+	     int (*cb)(struct kvs_ent *ent, void *cb_arg), void *cb_arg)
+{
+	if ((kvs == NULL) || (!kvs->data->ready)) {
+		return -KVS_EINVAL;
+	}
+
+	int rc;
+
+	rc = kvs_flush(kvs);
+	if (rc != 0) {
+		return rc;
+	}
+
+	rc = kvs_dev_rdlock(kvs);
+	if (rc != 0) {
+		return rc;
+	}
+
+	rc = walk_nolock(kvs, key, cb, cb_arg);
+	(void)kvs_dev_rdunlock(kvs);
+	return rc;
+}
+
+int kvs_snapshot_take(struct kvs_snapshot *snap, const struct kvs *kvs)
+{
+	if ((snap == NULL) || (kvs == NULL) || (!kvs->data->ready)) {
+		return -KVS_EINVAL;
+	}
+
+	int rc;
+
+	rc = kvs_dev_lock(kvs);
+	if (rc != 0) {
+		return rc;
+	}
+
+	if (kvs_cold(kvs) != NULL) {
+		rc = -KVS_EINVAL;
+		goto end;
+	}
+
+	rc = wbuf_flush(kvs);
+	if (rc != 0) {
+		goto end;
+	}
+
+	memcpy(&snap->data, kvs->data, sizeof(struct kvs_data));
+	snap->data.blive = NULL;
+	snap->data.cold = NULL;
+	snap->data.snaps = NULL;
+	snap->data.wbuf = NULL;
+	snap->view.cfg = kvs->cfg;
+	snap->view.data = &snap->data;
+	snap->src = (struct kvs *)kvs;
+	/* the oldest block of the snapshot is reused by the block advance
+	 * after the spare blocks are used (each advance adds 2 to seq).
+	 */
+	snap->pin = kvs->data->seq + 2U * (kvs->cfg->bspr + 1U);
+	snap->next = kvs->data->snaps;
+	kvs->data->snaps = snap;
+end:
+	(void)kvs_dev_unlock(kvs);
+	return rc;
+}
+
+int kvs_snapshot_release(struct kvs_snapshot *snap)
+{
+	if ((snap == NULL) || (snap->src == NULL)) {
+		return -KVS_EINVAL;
+	}
+
+	struct kvs_snapshot **prev;
+	int rc;
+
+	rc = kvs_dev_lock(snap->src);
+	if (rc != 0) {
+		return rc;
+	}
+
+	prev = &snap->src->data->snaps;
+	while ((*prev != NULL) && (*prev != snap)) {
+		prev = &(*prev)->next;
+	}
+
+	if (*prev == snap) {
+		*prev = snap->next;
+	}
+
+	(void)kvs_dev_unlock(snap->src);
+	snap->src = NULL;
+	return 0;
+}
+
+int kvs_snapshot_entry_get(struct kvs_ent *ent,
+			   const struct kvs_snapshot *snap, const char *key)
 {
-	struct entry_dup_cb_arg *dup = (struct entry_dup_cb_arg *)cb_arg;
+	if ((snap == NULL) || (snap->src == NULL)) {
+		return -KVS_EINVAL;
+	}
 
-	if (entry_get_klen(ent) != entry_get_klen(dup->ent)) {
-		return 0;
+	return kvs_entry_get(ent, &snap->view, key);
+}
+
+int kvs_snapshot_read(const struct kvs_snapshot *snap, const char *key,
+		      void *value, size_t len)
+{
+	if ((snap == NULL) || (snap->src == NULL)) {
+		return -KVS_EINVAL;
 	}
 
-	dup->duplicate = true;
-	return KVS_DONE;
+	return kvs_read(&snap->view, key, value, len);
+}
+
+int kvs_snapshot_walk(const struct kvs_snapshot *snap, const char *key,
+		      int (*cb)(struct kvs_ent *ent, void *cb_arg),
+		      void *cb_arg)
+{
+	if ((snap == NULL) || (snap->src == NULL)) {
+		return -KVS_EINVAL;
+	}
 
+	return walk_nolock(&snap->view, key, cb, cb_arg);
 }
 
-static int unique_cb(struct kvs_ent *ent, void *cb_arg)
+int kvs_snapshot_walk_unique(const struct kvs_snapshot *snap, const char *key,
+			     int (*cb)(struct kvs_ent *ent, void *cb_arg),
+			     void *cb_arg)
 {
-	if (entry_get_klen(ent) == 0U) {
-		return 0;
+	if ((snap == NULL) || (snap->src == NULL)) {
+		return -KVS_EINVAL;
 	}
 
-	const struct kvs *kvs = ent->kvs;
-	const struct entry_cb *cb = (const struct entry_cb *)cb_arg;
-	const struct read_cb readkey = {
+	return walk_unique_nolock(&snap->view, key, cb, cb_arg);
+}
+
+/* get a entry for a segment build, pos is a position in the kvs or (with
+ * KVS_SEGOLD) in the segment that is in use
+ */
+static int seg_src(const struct kvs *kvs, uint32_t pos, struct kvs_ent *ent)
+{
+	ent->kvs = (struct kvs *)kvs;
+	if ((pos & KVS_SEGOLD) != 0U) {
+		ent->kvs = (struct kvs *)kvs->data->seg->kvs;
+	}
+
+	ent->start = pos & ~KVS_SEGOLD;
+	if (entry_get_info(ent) != 0) {
+		return -KVS_EIO;
+	}
+
+	/* the patches of a entry in the kvs are folded into the copy */
+	if (ent->kvs == kvs) {
+		(void)entry_dup(ent);
+	}
+
+	return 0;
+}
+
+/* add a entry to the (sorted) index of a segment build */
+static int seg_insert(const struct kvs *kvs, const struct kvs_ent *ent,
+		      uint32_t pos, uint32_t *cnt)
+{
+	struct kvs_seg *seg = kvs->data->seg;
+	const struct read_cb rdkey = {
 		.ctx = (void *)ent,
-		.off = 0,
+		.off = 0U,
 		.len = entry_get_klen(ent),
 		.read = read_cb_entry,
 	};
-	struct entry_dup_cb_arg dup_cb_arg = {
-		.ent = ent,
-		.duplicate = false,
+	struct kvs_ent cur;
+	uint32_t lo = 0U, hi = *cnt;
+	int cmp, rc;
+
+	if (*cnt == seg->idxcnt) {
+		return -KVS_ENOSPC;
+	}
+
+	while (lo < hi) {
+		const uint32_t mid = lo + (hi - lo) / 2U;
+
+		cur.start = seg->idx[mid] & ~KVS_SEGOLD;
+		cur.kvs = (struct kvs *)kvs;
+		if ((seg->idx[mid] & KVS_SEGOLD) != 0U) {
+			cur.kvs = (struct kvs *)seg->kvs;
+		}
+
+		rc = (entry_get_info(&cur) == 0) ? key_cmp(&cur, &rdkey, &cmp) :
+						  -KVS_EIO;
+		if (rc != 0) {
+			return rc;
+		}
+
+		if (cmp < 0) {
+			lo = mid + 1U;
+		} else {
+			hi = mid;
+		}
+
+	}
+
+	memmove(&seg->idx[lo + 1U], &seg->idx[lo],
+		(*cnt - lo) * sizeof(uint32_t));
+	seg->idx[lo] = pos;
+	(*cnt)++;
+	return 0;
+}
+
+struct seg_collect_cb_arg {
+	const struct kvs *kvs;
+	uint32_t cnt;
+};
+
+/* add the last entry of each key in the kvs (chunked values stay in the kvs) */
+static int seg_collect_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	struct seg_collect_cb_arg *arg = (struct seg_collect_cb_arg *)cb_arg;
+
+	if ((entry_get_vlen(ent) == 0U) || (ent->type == KVS_TYPE_CHUNK) ||
+	    (ent->type == KVS_TYPE_CDIR)) {
+		return 0;
+	}
+
+	return seg_insert(arg->kvs, ent, ent->start, &arg->cnt);
+}
+
+/* collect the entries of a segment build: the last entry of each key in the
+ * kvs and the entries of the segment that is in use without entry in the kvs
+ */
+static int seg_collect(const struct kvs *kvs, uint32_t *cnt)
+{
+	const struct kvs_seg *seg = kvs->data->seg;
+	const struct read_cb rdkey = {
+		.ctx = (void *)NULL,
+		.off = 0U,
+		.len = 0U,
+		.read = read_cb_ptr,
 	};
-	const struct entry_cb dup_entry_cb = {
-		.cb = entry_dup_cb,
-		.cb_arg = (void *)&dup_cb_arg,
+	struct seg_collect_cb_arg cb_arg = {
+		.kvs = kvs,
+		.cnt = 0U,
+	};
+	const struct entry_cb cb = {
+		.cb = seg_collect_cb,
+		.cb_arg = (void *)&cb_arg,
 	};
 	struct kvs_ent wlk = {
 		.kvs = (struct kvs *)kvs,
-		.next = ent->next,
+		.next = block_advance_n(kvs, kvs->data->bend, kvs->cfg->bspr),
 	};
+	int rc;
 
-	(void)walk(&wlk, &readkey, &dup_entry_cb, kvs->data->pos);
-	if (!dup_cb_arg.duplicate) {
-		return cb->cb(ent, cb->cb_arg);
+	rc = walk_unique(&wlk, &rdkey, &cb, kvs->data->pos);
+	for (uint32_t i = 0U; (rc == 0) && (i < seg->cnt); i++) {
+		struct kvs_ent ent, hot_ent = {
+			.kvs = (struct kvs *)kvs,
+		};
+		struct read_cb seg_key = {
+			.ctx = (void *)&ent,
+			.off = 0U,
+			.len = 0U,
+			.read = read_cb_entry,
+		};
+
+		rc = seg_get(seg, i, &ent);
+		if (rc != 0) {
+			break;
+		}
+
+		seg_key.len = entry_get_klen((&ent));
+		if (entry_find(&hot_ent, &seg_key) == 0) {
+			continue;
+		}
+
+		rc = seg_insert(kvs, &ent, ent.start | KVS_SEGOLD, &cb_arg.cnt);
+	}
+
+	*cnt = cb_arg.cnt;
+	return rc;
+}
+
+/* place the entries of a segment build after each other (a entry does not
+ * cross a block boundary) and write them when wr is true. The positions are
+ * added to crc and replace the index of the build when they are written.
+ */
+static int seg_place(const struct kvs *kvs, uint32_t cnt, uint32_t end,
+		     bool wr, uint32_t *crc)
+{
+	struct kvs_seg *seg = kvs->data->seg;
+	const struct kvs *skvs = seg->kvs;
+	struct kvs_data *sdata = skvs->data;
+	const uint32_t bsz = skvs->cfg->bsz;
+	int rc = 0;
+
+	for (uint32_t i = 0U; i < cnt; i++) {
+		struct kvs_ent ent, cp_ent = {
+			.kvs = (struct kvs *)skvs,
+		};
+		struct value_rd vr = {
+			.ent = &ent,
+		};
+		uint8_t buf[sizeof(uint32_t)];
+
+		rc = seg_src(kvs, seg->idx[i], &ent);
+		if (rc != 0) {
+			break;
+		}
+
+		const struct read_cb krd_cb = {
+			.ctx = (void *)&ent,
+			.off = 0U,
+			.len = entry_get_klen((&ent)),
+			.read = read_cb_entry,
+		};
+		struct read_cb vrd_cb = {
+			.ctx = (void *)&ent,
+			.off = entry_get_klen((&ent)),
+			.len = entry_get_slen((&ent)),
+			.read = read_cb_entry,
+		};
+
+		if (ent.pcnt != 0U) {
+			vrd_cb.ctx = (void *)&vr;
+			vrd_cb.len = entry_get_vlen((&ent));
+			vrd_cb.read = read_cb_value;
+		}
+
+		const uint32_t space = entry_space(skvs, krd_cb.len, vrd_cb.len);
+
+		if (space > (sdata->bend - sdata->pos)) {
+			sdata->pos = sdata->bend;
+			sdata->bend += bsz;
+		}
+
+		if ((space > bsz) || (sdata->bend > end)) {
+			rc = -KVS_ENOSPC;
+			break;
+		}
+
+		put_le32(buf, sdata->pos);
+		*crc = crc32(*crc, buf, sizeof(buf));
+		if (!wr) {
+			sdata->pos += space;
+			continue;
+		}
+
+		rc = entry_write_kv(&cp_ent, ent.type, &krd_cb, &vrd_cb);
+		if (rc != 0) {
+			break;
+		}
+
+		seg->idx[i] = cp_ent.start;
+	}
+
+	return rc;
+}
+
+/* write the segment header (at the start of the half) */
+static int seg_write_hdr(const struct kvs_seg *seg, uint32_t start,
+			 uint32_t gen, uint32_t cnt, uint32_t ioff,
+			 uint32_t icrc)
+{
+	const struct kvs *skvs = seg->kvs;
+	uint8_t hdr[KVS_SEGHDRSIZE];
+	const struct read_cb krd_cb = {
+		.ctx = (void *)NULL,
+		.off = 0U,
+		.len = 0U,
+		.read = read_cb_ptr,
+	};
+	const struct read_cb vrd_cb = {
+		.ctx = (void *)hdr,
+		.off = 0U,
+		.len = sizeof(hdr),
+		.read = read_cb_ptr,
+	};
+	struct kvs_ent ent = {
+		.kvs = (struct kvs *)skvs,
+	};
+
+	put_le32(&hdr[0], gen);
+	put_le32(&hdr[4], cnt);
+	put_le32(&hdr[8], ioff);
+	put_le32(&hdr[12], icrc);
+	skvs->data->pos = start;
+	skvs->data->bend = start + skvs->cfg->bsz;
+	return entry_write_kv(&ent, KVS_TYPE_PLAIN, &krd_cb, &vrd_cb);
+}
+
+/* get the position of the commit entry (after the index) */
+static uint32_t seg_commit_pos(const struct kvs *skvs, uint32_t cnt,
+			       uint32_t ioff)
+{
+	const uint32_t bsz = skvs->cfg->bsz;
+	const uint32_t space = entry_space(skvs, 0U, sizeof(uint32_t));
+	uint32_t pos;
+
+	pos = ioff + KVS_ALIGNUP(cnt * sizeof(uint32_t), skvs->cfg->psz);
+	if ((KVS_ALIGNDOWN(pos, bsz) + bsz - pos) < space) {
+		pos = KVS_ALIGNUP(pos, bsz);
+	}
+
+	return pos;
+}
+
+/* write the commit entry (the generation) of a segment build */
+static int seg_write_commit(const struct kvs_seg *seg, uint32_t pos,
+			    uint32_t gen)
+{
+	const struct kvs *skvs = seg->kvs;
+	uint8_t buf[sizeof(uint32_t)];
+	const struct read_cb krd_cb = {
+		.ctx = (void *)NULL,
+		.off = 0U,
+		.len = 0U,
+		.read = read_cb_ptr,
+	};
+	const struct read_cb vrd_cb = {
+		.ctx = (void *)buf,
+		.off = 0U,
+		.len = sizeof(buf),
+		.read = read_cb_ptr,
+	};
+	struct kvs_ent ent = {
+		.kvs = (struct kvs *)skvs,
+	};
+
+	put_le32(buf, gen);
+	skvs->data->pos = pos;
+	skvs->data->bend = KVS_ALIGNDOWN(pos, skvs->cfg->bsz) + skvs->cfg->bsz;
+	return entry_write_kv(&ent, KVS_TYPE_PLAIN, &krd_cb, &vrd_cb);
+}
+
+/* write the index of a segment build */
+static int seg_write_idx(const struct kvs_seg *seg, uint32_t cnt,
+			 uint32_t ioff)
+{
+	const struct kvs *skvs = seg->kvs;
+	const struct kvs_ent ent = {
+		.kvs = (struct kvs *)skvs,
+		.start = ioff,
+		.next = ioff + KVS_ALIGNUP(cnt * sizeof(uint32_t),
+					   skvs->cfg->psz),
+	};
+	int rc = 0;
+
+	for (uint32_t i = 0U; (rc == 0) && (i < cnt); i++) {
+		uint8_t buf[sizeof(uint32_t)];
+
+		put_le32(buf, seg->idx[i]);
+		rc = entry_write(&ent, i * sizeof(uint32_t), buf, sizeof(buf));
+	}
+
+	if (rc == 0) {
+		rc = entry_write_fill(&ent, cnt * sizeof(uint32_t));
+	}
+
+	return rc;
+}
+
+/* write a new segment with the values of the kvs and the segment in use to
+ * the other half of the segment memory and take it in use. The header at the
+ * start is written first, the segment is only valid when the crc of the index
+ * matches the header and the commit entry (written last) has the generation
+ * of the header. Each build uses a new generation, so a commit entry of an
+ * earlier build is never taken for the commit of a interrupted build.
+ */
+static int seg_build(const struct kvs *kvs)
+{
+	struct kvs_seg *seg = kvs->data->seg;
+	const struct kvs *skvs = seg->kvs;
+	struct kvs_data *sdata = skvs->data;
+	const uint32_t hsz = skvs->cfg->bsz * (skvs->cfg->bcnt / 2U);
+	const uint32_t start = (seg->half == 0U) ? hsz : 0U;
+	const uint32_t dstart = start + entry_space(skvs, 0U, KVS_SEGHDRSIZE);
+	uint32_t cnt, ioff, cpos, icrc = KVS_KVCRCINIT;
+	int rc;
+
+	if (kvs->data->snaps != NULL) {
+		return -KVS_EAGAIN;
+	}
+
+	rc = seg_collect(kvs, &cnt);
+	if (rc != 0) {
+		return rc;
+	}
+
+	/* entries of the segment are reused: readers without lock retry and
+	 * entries that have been retrieved before are not valid after this
+	 * build (see entry_set_seq()).
+	 */
+	(void)__atomic_add_fetch(&sdata->seq, 2U * skvs->cfg->bcnt,
+				 __ATOMIC_SEQ_CST);
+	sdata->pos = dstart;
+	sdata->bend = start + skvs->cfg->bsz;
+	rc = seg_place(kvs, cnt, start + hsz, false, &icrc);
+	if (rc != 0) {
+		return rc;
+	}
+
+	ioff = KVS_ALIGNUP(sdata->pos, KVS_MAX(skvs->cfg->psz,
+					       sizeof(uint32_t)));
+	cpos = seg_commit_pos(skvs, cnt, ioff);
+	if ((cpos + entry_space(skvs, 0U, sizeof(uint32_t))) > (start + hsz)) {
+		return -KVS_ENOSPC;
+	}
+
+	seg->gen++;
+	rc = seg_write_hdr(seg, start, seg->gen, cnt, ioff, icrc);
+	if (rc != 0) {
+		return rc;
+	}
+
+	icrc = KVS_KVCRCINIT;
+	rc = seg_place(kvs, cnt, start + hsz, true, &icrc);
+	if (rc != 0) {
+		return rc;
+	}
+
+	rc = seg_write_idx(seg, cnt, ioff);
+	if (rc != 0) {
+		return rc;
+	}
+
+	rc = seg_write_commit(seg, cpos, seg->gen);
+	if (rc != 0) {
+		return rc;
+	}
+
+	rc = kvs_dev_sync(skvs);
+	if (rc != 0) {
+		return rc;
 	}
 
+	(void)__atomic_add_fetch(&sdata->seq, 1U, __ATOMIC_SEQ_CST);
+	seg->cnt = cnt;
+	seg->ioff = ioff;
+	seg->half = (start == 0U) ? 0U : 1U;
+	(void)__atomic_add_fetch(&sdata->seq, 1U, __ATOMIC_SEQ_CST);
 	return 0;
 }
 
-static int walk_unique(struct kvs_ent *ent, const struct read_cb *rdkey,
-		       const struct entry_cb *cb, uint32_t stop)
+/* read the segment header of a half and check the index and commit entry */
+static int seg_read_hdr(const struct kvs_seg *seg, uint32_t half,
+			uint32_t *gen, uint32_t *cnt, uint32_t *ioff)
 {
-	const struct entry_cb walk_cb = {
-		.cb = unique_cb,
-		.cb_arg = (void *)cb,
+	const struct kvs *skvs = seg->kvs;
+	const uint32_t hsz = skvs->cfg->bsz * (skvs->cfg->bcnt / 2U);
+	struct kvs_ent ent = {
+		.kvs = (struct kvs *)skvs,
+		.start = half * hsz,
 	};
+	uint8_t hdr[KVS_SEGHDRSIZE];
+	uint8_t buf[KVS_BUFSIZE];
+	uint32_t icrc = KVS_KVCRCINIT;
+	uint32_t len, off;
+
+	if ((entry_get_info(&ent) != 0) || (entry_get_klen((&ent)) != 0U) ||
+	    (entry_get_slen((&ent)) != sizeof(hdr)) || (!entry_kvcrc_ok(&ent)) ||
+	    (entry_data_read(&ent, 0U, hdr, sizeof(hdr)) != 0)) {
+		return -KVS_ENOENT;
+	}
+
+	*gen = get_le32(&hdr[0]);
+	*cnt = get_le32(&hdr[4]);
+	*ioff = get_le32(&hdr[8]);
+	if ((*cnt > seg->idxcnt) || (*ioff < ent.next) ||
+	    ((*ioff + *cnt * sizeof(uint32_t)) > ((half + 1U) * hsz))) {
+		return -KVS_ENOENT;
+	}
+
+	len = *cnt * sizeof(uint32_t);
+	off = *ioff;
+	while (len != 0U) {
+		uint32_t rdlen = KVS_MIN(len, sizeof(buf));
+
+		if (kvs_dev_read(skvs, off, buf, rdlen) != 0) {
+			return -KVS_ENOENT;
+		}
+
+		icrc = crc32(icrc, buf, rdlen);
+		off += rdlen;
+		len -= rdlen;
+	}
+
+	if (icrc != get_le32(&hdr[12])) {
+		return -KVS_ENOENT;
+	}
+
+	ent.start = seg_commit_pos(skvs, *cnt, *ioff);
+	if ((entry_get_info(&ent) != 0) || (entry_get_klen((&ent)) != 0U) ||
+	    (entry_get_slen((&ent)) != sizeof(uint32_t)) ||
+	    (!entry_kvcrc_ok(&ent)) ||
+	    (entry_data_read(&ent, 0U, buf, sizeof(uint32_t)) != 0) ||
+	    (get_le32(buf) != *gen)) {
+		return -KVS_ENOENT;
+	}
 
-	return walk(ent, rdkey, &walk_cb, stop);
+	return 0;
 }
 
-int copy_cb(struct kvs_ent *ent, void *cb_arg)
+/* mount the segment: the valid half with the highest generation is used */
+static int seg_mount(struct kvs_seg *seg)
 {
-	int rc = 0;
+	const struct kvs *skvs = seg->kvs;
+	uint32_t gen, cnt, ioff;
+	bool found = false;
+	int rc;
 
-	if ((entry_get_klen(ent) == 0U) || (entry_get_vlen(ent) == 0U)) {
-		return 0;
+	if ((skvs == NULL) || (seg->idx == NULL) ||
+	    (skvs->cfg->bcnt < 2U) || ((skvs->cfg->bcnt & 1U) != 0U)) {
+		return -KVS_EINVAL;
 	}
 
-	for (int i = 0; i < ent->kvs->cfg->bspr; i++) {
-	 	rc = entry_copy(ent);
-	 	if (rc == 0) {
-	 		break;
-	 	}
-	 	wblock_advance(ent->kvs);
+	rc = kvs_dev_init(skvs);
+	if (rc != 0) {
+		return rc;
 	}
 
-	return rc;
-}
+	seg->cnt = 0U;
+	seg->ioff = 0U;
+	seg->gen = 0U;
+	seg->half = 1U;
+	for (uint32_t half = 0U; half < 2U; half++) {
+		if (seg_read_hdr(seg, half, &gen, &cnt, &ioff) != 0) {
+			continue;
+		}
 
-static int compact(const struct kvs *kvs, uint32_t stop)
-{
-	const struct read_cb rdkey = {
-		.ctx = (void *)NULL,
-		.off = 0U,
-		.len = 0U,
-		.read = read_cb_ptr,
-	};
-	const struct entry_cb compact_cb = {
-		.cb = copy_cb,
-	};
-		struct kvs_ent wlk = {
-		.kvs = (struct kvs *)kvs,
-		.next = block_advance_n(kvs, kvs->data->bend, kvs->cfg->bspr),
-	};
-	int rc;
+		if ((!found) || ((int32_t)(gen - seg->gen) > 0)) {
+			seg->cnt = cnt;
+			seg->ioff = ioff;
+			seg->gen = gen;
+			seg->half = half;
+			found = true;
+		}
 
-	wblock_advance(kvs);
-	rc = walk_unique(&wlk, &rdkey, &compact_cb, stop);
+	}
 
-	return rc == KVS_DONE ? 0 : rc;
+	skvs->data->ready = true;
+	return 0;
 }
 
-int kvs_entry_read(const struct kvs_ent *ent, uint32_t off, void *data,
-		   size_t len)
+static int seg_unmount(struct kvs_seg *seg)
 {
-	if ((ent == NULL) || (ent->kvs == NULL) || (!ent->kvs->data->ready)) {
-		return -KVS_EINVAL;
-	}
-
-	return entry_data_read(ent, off, data, len);
+	seg->kvs->data->ready = false;
+	return kvs_dev_release(seg->kvs);
 }
 
-int kvs_entry_get(struct kvs_ent *ent, const struct kvs *kvs, const char *key)
+/* reclaim the blocks of the kvs after a segment build: their entries are in
+ * the segment (garbage collection drops them) and each block is started
+ * again, so lookups no longer find the older copies in the kvs.
+ */
+static int seg_reclaim(const struct kvs *kvs)
 {
-	if ((kvs == NULL) || (!kvs->data->ready) || (key == NULL)) {
-		return -KVS_EINVAL;
-	}
+	const struct kvs_cfg *cfg = kvs->cfg;
+	int rc = 0;
 
-	const struct read_cb krd_cb = {
-		.ctx = (void *)key,
-		.off = 0U,
-		.len = strlen(key),
-		.read = read_cb_ptr,
-	};
+	for (uint32_t i = cfg->bspr; (rc == 0) && (i < cfg->bcnt); i++) {
+		rc = compact(kvs, block_advance_n(kvs, kvs->data->bend,
+						  cfg->bspr + 1), NULL);
+		if (rc == 0) {
+			rc = kvs_meta_write(kvs);
+		}
 
-	ent->kvs = (struct kvs *)kvs;
+		/* the sync ends the entries of the block (e.g. on eeprom) */
+		if (rc == 0) {
+			rc = kvs_dev_sync(kvs);
+		}
+
+	}
 
-	return entry_get(ent, &krd_cb);
+	return rc;
 }
 
-int kvs_read(const struct kvs *kvs, const char *key, void *value, size_t len)
+int kvs_compact(const struct kvs *kvs)
 {
-	struct kvs_ent wlk;
-	struct kvs_ent *ent = &wlk;
+	if ((kvs == NULL) || (!kvs->data->ready))  {
+		return -KVS_EINVAL;
+	}
+
 	int rc;
 
-	rc = kvs_entry_get(ent, kvs, key);
+	rc = kvs_dev_lock(kvs);
 	if (rc != 0) {
 		return rc;
 	}
 
-	return entry_data_read(ent, entry_get_klen(ent), value, len);
-}
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_COMPACT, 0U);
+	rc = wbuf_flush(kvs);
+	if ((rc == 0) && (kvs_seg(kvs) != NULL)) {
+		rc = seg_build(kvs);
+		if (rc == 0) {
+			rc = seg_reclaim(kvs);
+		}
 
-int kvs_write(const struct kvs *kvs, const char *key, const void *value,
-	      size_t len)
-{
-	if ((kvs == NULL) || (!kvs->data->ready) || (key == NULL)) {
-		return -KVS_EINVAL;
+	} else if (rc == 0) {
+		rc = compact(kvs, kvs->data->bend, NULL);
 	}
 
-	struct kvs_ent wlk;
-	struct kvs_ent *ent = &wlk;
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_COMPACT, rc);
+	(void)kvs_dev_unlock(kvs);
+	return rc;
+}
 
-	if (kvs_entry_get(ent, kvs, key) == 0) {
-		if (entry_get_vlen(ent) == len) {
-			if (len == 0U) {
-				return 0;
-			}
-			const struct read_cb val_rd = {
-				.ctx = (void *)value,
-				.len = len,
-				.off = 0U,
-				.read = read_cb_ptr,
-			};
-			const struct read_cb entval_rd = {
-				.ctx = (void *)ent,
-				.off = entry_get_klen(ent),
-				.len = entry_get_vlen(ent),
-				.read = read_cb_entry,
-			};
+/* get the live data in the block that is reclaimed next */
+static int gc_live(const struct kvs *kvs, uint32_t *live)
+{
+	const uint32_t end = kvs->cfg->bcnt * kvs->cfg->bsz;
+	uint32_t start;
 
-			if (!differ(&val_rd, &entval_rd)) {
-		 		return 0;
-			}
+	start = block_advance_n(kvs, kvs->data->bend, kvs->cfg->bspr);
+	return blive_block(kvs, (start < end) ? start : 0U, live);
+}
 
-		}
+/* check if reclaiming the next block is worth it */
+static bool gc_worth(const struct kvs *kvs, uint32_t live)
+{
+	const uint32_t bsz = kvs->cfg->bsz;
+	const uint32_t left = kvs->data->bend - kvs->data->pos;
+
+	switch (kvs->data->gc) {
+	case KVS_GC_GREEDY:
+		return live <= (bsz / 2);
+	case KVS_GC_COST_BENEFIT:
+		return (bsz - live) > (live + left);
+	default:
+		return true;
+	}
+}
 
+int kvs_gc(const struct kvs *kvs)
+{
+	if ((kvs == NULL) || (!kvs->data->ready))  {
+		return -KVS_EINVAL;
 	}
 
-	uint32_t cnt = kvs->cfg->bcnt;
+	uint32_t live;
 	int rc;
 
 	rc = kvs_dev_lock(kvs);
-	if (rc) {
+	if (rc != 0) {
 		return rc;
 	}
 
-	while (cnt != 0U) {
-		rc = entry_add(ent, key, value, len);
-		if (rc == 0) {
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_GC, 0U);
+	if ((kvs->data->wbuf != NULL) && (wbuf_expired(kvs->data->wbuf))) {
+		rc = wbuf_flush(kvs);
+		if (rc != 0) {
 			goto end;
 		}
 
-		uint32_t stop = block_advance_n(kvs, kvs->data->bend, 
-						kvs->cfg->bspr + 1);
-		rc = compact(kvs, stop);
-		cnt--;
 	}
 
-	rc = -KVS_ENOSPC;
+	rc = gc_live(kvs, &live);
+	if (rc != 0) {
+		goto end;
+	}
+
+	if (!gc_worth(kvs, live)) {
+		rc = -KVS_EAGAIN;
+		goto end;
+	}
+
+	rc = compact(kvs, block_advance_n(kvs, kvs->data->bend,
+					  kvs->cfg->bspr + 1), NULL);
 end:
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_GC, rc);
 	(void)kvs_dev_unlock(kvs);
 	return rc;
 }
 
-int kvs_delete(const struct kvs *kvs, const char *key)
+/* get the usage of the block at pos, the spare blocks after the write block
+ * contain no live data.
+ */
+static int fsstat_block(const struct kvs *kvs, uint32_t pos,
+			struct kvs_fsstat *stat)
 {
-	return kvs_write(kvs, key, NULL, 0);
-}
+	const struct kvs_data *data = kvs->data;
+	const uint32_t bsz = kvs->cfg->bsz;
+	const uint32_t bcnt = kvs->cfg->bcnt;
+	const uint32_t dist = (pos / bsz + bcnt - data->bend / bsz) % bcnt;
+	uint32_t live = 0U;
+	int rc = 0;
 
-int kvs_walk_unique(const struct kvs *kvs, const char *key,
-		    int (*cb)(struct kvs_ent *ent, void *cb_arg), void *cb_arg)
-{
-	if ((kvs == NULL) || (!kvs->data->ready)) {
-		return -KVS_EINVAL;
+	if (dist >= kvs->cfg->bspr) {
+		rc = blive_block(kvs, pos, &live);
 	}
 
-	const struct read_cb rdkey = {
-		.ctx = (void *)key,
-		.len = strlen(key),
-		.off = 0U,
-		.read = read_cb_ptr,
-	};
-	const struct entry_cb unique_cb = {
-		.cb = cb,
-		.cb_arg = cb_arg,
-	};
-	struct kvs_ent wlk = {
-		.kvs = (struct kvs *)kvs,
-		.next = block_advance_n(kvs, kvs->data->bend, kvs->cfg->bspr),
-	};
+	if (rc != 0) {
+		return rc;
+	}
+
+	stat->live += live;
+	if (KVS_ALIGNDOWN(pos, bsz) == (data->bend - bsz)) {
+		stat->free += data->bend - data->pos;
+		live += data->bend - data->pos;
+	}
 
-	return walk_unique(&wlk, &rdkey, &unique_cb, kvs->data->pos);
+	stat->dead += bsz - KVS_MIN(live, bsz);
+	return 0;
 }
 
-int kvs_walk(const struct kvs *kvs, const char *key,
-	     int (*cb)(struct kvs_ent *ent, void *cb_arg), void *cb_arg)
+int kvs_fsstat(const struct kvs *kvs, struct kvs_fsstat *stat)
 {
-	if ((kvs == NULL) || (!kvs->data->ready)) {
+	if ((kvs == NULL) || (!kvs->data->ready) || (stat == NULL)) {
 		return -KVS_EINVAL;
 	}
 
-	const struct read_cb rdkey = {
-		.ctx = (void *)key,
-		.len = strlen(key),
-		.off = 0U,
-		.read = read_cb_ptr,
-	};
-	const struct entry_cb entry_cb = {
-		.cb = cb,
-		.cb_arg = cb_arg,
-	};
-	struct kvs_ent wlk = {
-		.kvs = (struct kvs *)kvs,
-		.next = block_advance_n(kvs, kvs->data->bend, kvs->cfg->bspr),
-	};
+	int rc;
+
+	rc = kvs_dev_lock(kvs);
+	if (rc != 0) {
+		return rc;
+	}
+
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_FSSTAT, 0U);
+	memset(stat, 0, sizeof(struct kvs_fsstat));
+	for (uint32_t i = 0U; i < kvs->cfg->bcnt; i++) {
+		rc = fsstat_block(kvs, i * kvs->cfg->bsz, stat);
+		if (rc != 0) {
+			break;
+		}
+
+	}
 
-	return walk(&wlk, &rdkey, &entry_cb, kvs->data->pos);
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_FSSTAT, rc);
+	(void)kvs_dev_unlock(kvs);
+	return rc;
 }
 
-int kvs_compact(const struct kvs *kvs)
+int kvs_fsstat_block(const struct kvs *kvs, uint32_t block,
+		     struct kvs_fsstat *stat)
 {
-	if ((kvs == NULL) || (!kvs->data->ready))  {
+	if ((kvs == NULL) || (!kvs->data->ready) || (stat == NULL) ||
+	    (block >= kvs->cfg->bcnt)) {
 		return -KVS_EINVAL;
 	}
 
@@ -1070,7 +5499,8 @@ int kvs_compact(const struct kvs *kvs)
 		return rc;
 	}
 
-	rc = compact(kvs, kvs->data->bend);
+	memset(stat, 0, sizeof(struct kvs_fsstat));
+	rc = fsstat_block(kvs, block * kvs->cfg->bsz, stat);
 	(void)kvs_dev_unlock(kvs);
 	return rc;
 }
@@ -1081,6 +5511,15 @@ int recovery_check_cb(struct kvs_ent *ent, void *cb_arg)
 	const size_t bsz = ent->kvs->cfg->bsz;
 	bool *recovery_needed = (bool *)cb_arg;
 
+	if ((ent->type == KVS_TYPE_CHUNK) && (!chunk_live(ent, NULL))) {
+		return 0;
+	}
+
+	/* entries that have been moved to the cold kvs or the segment */
+	if ((cold_has(ent)) || (seg_has(ent))) {
+		return 0;
+	}
+
 	/* if an item was found that has no duplicate except in the current
 	 * sector garbage collection was interrupted and recovery is needed.
 	 */
@@ -1117,15 +5556,27 @@ int recover(const struct kvs *kvs)
 		goto end;
 	}
 
-	/* set back data->bend to the start of the sector */
+	kvs_stat_add(kvs, recoveries, 1U);
+	/* set back data->bend to the start of the sector and redo the
+	 * compaction of the block that was interrupted (the other blocks are
+	 * unchanged, compacting them would require all data to fit in a block)
+	 */
 	kvs->data->bend = KVS_ALIGNDOWN(kvs->data->pos, cfg->bsz);
+	/* the advance to block 0 increases the wrap counter again */
+	if (kvs->data->bend == 0U) {
+		kvs->data->wrapcnt--;
+	}
 
-	return compact(kvs, kvs->data->bend);
+	return compact(kvs, block_advance_n(kvs, kvs->data->bend, cfg->bspr + 1),
+		       NULL);
 end:
 	return 0;
 }
 
-static void kvs_set_data_bend(const struct kvs *kvs)
+/* find the block with the highest wrap counter, fails on memory of a older
+ * format (its blocks start with a plain entry)
+ */
+static int kvs_set_data_bend(const struct kvs *kvs)
 {
 	const struct kvs_cfg *cfg = kvs->cfg;
 	struct kvs_data *data = kvs->data;
@@ -1143,13 +5594,30 @@ static void kvs_set_data_bend(const struct kvs *kvs)
 			continue;
 		}
 
+		/* a meta entry that was interrupted has no valid wrapcnt (an
+		 * erased wrapcnt can pass the crc check when there is no cookie)
+		 */
+		if (!entry_kvcrc_ok(&ent)) {
+			continue;
+		}
+
+		if (ent.type != KVS_TYPE_META) {
+			return -KVS_EINVAL;
+		}
+
 		entry_get_wrapcnt(&ent, &wrapcnt);
+		if (wrapcnt == UINT32_MAX) {
+			continue;
+		}
+
 		if (wrapcnt >= data->wrapcnt) {
 			data->wrapcnt = wrapcnt;
 			data->pos = ent.start;
 			data->bend = ent.start + cfg->bsz;
 		}
 	}
+
+	return 0;
 }
 
 static void kvs_set_data_pos(const struct kvs *kvs)
@@ -1159,7 +5627,8 @@ static void kvs_set_data_pos(const struct kvs *kvs)
 		.kvs = (struct kvs *)kvs,
 	};
 
-	while (true) {
+	/* the next block can start with a interrupted meta entry */
+	while (data->pos < data->bend) {
 		ent.start = data->pos;
 		if (entry_get_info(&ent) != 0) {
 			break;
@@ -1203,6 +5672,53 @@ int kvs_mount(struct kvs *kvs)
 		return -KVS_EAGAIN;
 	}
 
+	/* in place updates overwrite single bytes and rely on the sync to mark
+	 * the end of the entries
+	 */
+	if ((kvs->data->inplace) &&
+	    ((kvs->cfg->psz != 1U) || (kvs->cfg->sync == NULL))) {
+		return -KVS_EINVAL;
+	}
+
+	/* a key reference holds a 1 byte dictionary index (or KVS_KEYID) */
+	if ((kvs->data->keydict != NULL) &&
+	    (kvs->data->keydict->cnt > KVS_KEYID)) {
+		return -KVS_EINVAL;
+	}
+
+	/* the cold kvs and segment store keys with the same dictionary */
+	if ((kvs->data->cold != NULL) &&
+	    (kvs->data->cold->data->keydict == NULL)) {
+		kvs->data->cold->data->keydict = kvs->data->keydict;
+	}
+
+	/* the segment is needed during recovery */
+	if (kvs->data->seg != NULL) {
+		if (kvs->data->cold != NULL) {
+			return -KVS_EINVAL;
+		}
+
+		if (kvs->data->seg->kvs->data->keydict == NULL) {
+			kvs->data->seg->kvs->data->keydict = kvs->data->keydict;
+		}
+
+		rc = seg_mount(kvs->data->seg);
+		if (rc != 0) {
+			return rc;
+		}
+
+	}
+
+	/* the cold kvs is needed during recovery */
+	if ((kvs->data->cold != NULL) && (kvs->data->cold != kvs) &&
+	    (!kvs->data->cold->data->ready)) {
+		rc = kvs_mount(kvs->data->cold);
+		if (rc != 0) {
+			return rc;
+		}
+
+	}
+
 	rc = kvs_dev_init(kvs);
 	if (rc != 0) {
 		return rc;
@@ -1213,7 +5729,17 @@ int kvs_mount(struct kvs *kvs)
 		return rc;
 	}
 
-	kvs_set_data_bend(kvs);
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_MOUNT, 0U);
+	kvs->data->snaps = NULL;
+	if (kvs->data->wbuf != NULL) {
+		kvs->data->wbuf->used = 0U;
+	}
+
+	rc = kvs_set_data_bend(kvs);
+	if (rc != 0) {
+		goto end;
+	}
+
 	kvs_set_data_pos(kvs);
 
 	rc = recover(kvs);
@@ -1221,9 +5747,22 @@ int kvs_mount(struct kvs *kvs)
 		goto end;
 	}
 
+	if (kvs->data->blive != NULL) {
+		memset(kvs->data->blive, 0, kvs->cfg->bcnt * sizeof(uint32_t));
+		rc = blive_count(kvs, block_advance_n(kvs, kvs->data->bend,
+						      kvs->cfg->bspr),
+				 kvs->data->pos, kvs->data->blive, true);
+		if (rc != 0) {
+			goto end;
+		}
+
+	}
+
 	kvs->data->ready = true;
 end:
-	return kvs_dev_unlock(kvs);
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_MOUNT, rc);
+	(void)kvs_dev_unlock(kvs);
+	return rc;
 }
 
 int kvs_unmount(struct kvs *kvs)
@@ -1232,7 +5771,7 @@ int kvs_unmount(struct kvs *kvs)
 		return -KVS_EINVAL;
 	}
 
-	int rc;
+	int rc, frc = 0;
 	
 	rc = kvs_dev_init(kvs);
 	if (rc != 0) {
@@ -1244,9 +5783,25 @@ int kvs_unmount(struct kvs *kvs)
 		return rc;
 	}
 
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_UNMOUNT, 0U);
+	/* buffered values that can not be written are lost */
+	if (kvs->data->ready) {
+		frc = wbuf_flush(kvs);
+	}
+
 	kvs->data->ready = false;
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_UNMOUNT, frc);
 	(void)kvs_dev_unlock(kvs);
-	return kvs_dev_release(kvs);
+	rc = kvs_dev_release(kvs);
+	if ((rc == 0) && (kvs->data->seg != NULL)) {
+		rc = seg_unmount(kvs->data->seg);
+	}
+
+	if ((rc == 0) && (kvs->data->cold != NULL) && (kvs->data->cold != kvs)) {
+		rc = kvs_unmount(kvs->data->cold);
+	}
+
+	return (rc == 0) ? frc : rc;
 }
 
 int kvs_erase(struct kvs *kvs)
@@ -1275,6 +5830,7 @@ int kvs_erase(struct kvs *kvs)
 
 	uint8_t buf[kvs->cfg->psz];
 
+	KVS_TRACE_ENTER(kvs, KVS_TRACE_ERASE, kvs->cfg->bsz * kvs->cfg->bcnt);
 	memset(buf, fillchar, sizeof(buf));
 	while (off < (kvs->cfg->bsz * kvs->cfg->bcnt)) {
 		rc = kvs_dev_prog(kvs, off, buf, sizeof(buf));
@@ -1284,7 +5840,16 @@ int kvs_erase(struct kvs *kvs)
 		off += sizeof(buf);
 	}
 
+	KVS_TRACE_EXIT(kvs, KVS_TRACE_ERASE, rc);
 	(void)kvs_dev_unlock(kvs);
 	(void)kvs_dev_release(kvs);
+	if ((rc == 0) && (kvs->data->seg != NULL)) {
+		rc = kvs_erase((struct kvs *)kvs->data->seg->kvs);
+	}
+
+	if ((rc == 0) && (kvs->data->cold != NULL) && (kvs->data->cold != kvs)) {
+		rc = kvs_erase(kvs->data->cold);
+	}
+
 	return rc;
 }
\ No newline at end of file
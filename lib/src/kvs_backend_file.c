@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2023 Laczen
+ *
+ * KVS file backend definition (POSIX)
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "kvs/kvs_backend_file.h"
+
+static bool kvs_be_file_inside(const struct kvs_be_file *be, uint32_t off,
+			       size_t len)
+{
+	return (be->fd >= 0) && (off <= be->size) && (len <= (be->size - off));
+}
+
+int kvs_be_file_read(const void *ctx, uint32_t off, void *data, size_t len)
+{
+	const struct kvs_be_file *be = (const struct kvs_be_file *)ctx;
+	uint8_t *data8 = (uint8_t *)data;
+
+	if (!kvs_be_file_inside(be, off, len)) {
+		return -KVS_EIO;
+	}
+
+	while (len != 0U) {
+		ssize_t rdlen = pread(be->fd, data8, len, (off_t)off);
+
+		if (rdlen <= 0) {
+			return -KVS_EIO;
+		}
+
+		data8 += rdlen;
+		off += (uint32_t)rdlen;
+		len -= (size_t)rdlen;
+	}
+
+	return 0;
+}
+
+int kvs_be_file_prog(const void *ctx, uint32_t off, const void *data,
+		     size_t len)
+{
+	const struct kvs_be_file *be = (const struct kvs_be_file *)ctx;
+	const uint8_t *data8 = (const uint8_t *)data;
+
+	if (!kvs_be_file_inside(be, off, len)) {
+		return -KVS_EIO;
+	}
+
+	while (len != 0U) {
+		ssize_t wrlen = pwrite(be->fd, data8, len, (off_t)off);
+
+		if (wrlen <= 0) {
+			return -KVS_EIO;
+		}
+
+		data8 += wrlen;
+		off += (uint32_t)wrlen;
+		len -= (size_t)wrlen;
+	}
+
+	return 0;
+}
+
+int kvs_be_file_comp(const void *ctx, uint32_t off, const void *data,
+		     size_t len)
+{
+	const uint8_t *data8 = (const uint8_t *)data;
+	uint8_t buf[32];
+	int rc;
+
+	while (len != 0U) {
+		size_t rdlen = len < sizeof(buf) ? len : sizeof(buf);
+
+		rc = kvs_be_file_read(ctx, off, buf, rdlen);
+		if (rc != 0) {
+			return rc;
+		}
+
+		if (memcmp(buf, data8, rdlen) != 0) {
+			return -KVS_EIO;
+		}
+
+		data8 += rdlen;
+		off += (uint32_t)rdlen;
+		len -= rdlen;
+	}
+
+	return 0;
+}
+
+int kvs_be_file_sync(const void *ctx, uint32_t off)
+{
+	const struct kvs_be_file *be = (const struct kvs_be_file *)ctx;
+
+	(void)off;
+	if (be->fd < 0) {
+		return -KVS_EIO;
+	}
+
+	return fdatasync(be->fd) == 0 ? 0 : -KVS_EIO;
+}
+
+int kvs_be_file_init(const void *ctx)
+{
+	struct kvs_be_file *be = (struct kvs_be_file *)ctx;
+	struct stat st;
+
+	if (be->fd >= 0) {
+		return 0;
+	}
+
+	be->fd = open(be->path, O_RDWR | O_CREAT, 0644);
+	if (be->fd < 0) {
+		return -KVS_EIO;
+	}
+
+	if ((fstat(be->fd, &st) != 0) ||
+	    (((size_t)st.st_size < be->size) &&
+	     (ftruncate(be->fd, (off_t)be->size) != 0))) {
+		(void)close(be->fd);
+		be->fd = -1;
+		return -KVS_EIO;
+	}
+
+	return 0;
+}
+
+int kvs_be_file_release(const void *ctx)
+{
+	struct kvs_be_file *be = (struct kvs_be_file *)ctx;
+	int rc = 0;
+
+	if (be->fd >= 0) {
+		rc = close(be->fd) == 0 ? 0 : -KVS_EIO;
+		be->fd = -1;
+	}
+
+	return rc;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2023 Laczen
+ *
+ * KVS mmap backend definition (Linux/POSIX)
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "kvs/kvs_backend_mmap.h"
+
+static bool kvs_be_mmap_inside(const struct kvs_be_mmap *be, uint32_t off,
+			       size_t len)
+{
+	return (be->mem != NULL) && (off <= be->size) &&
+	       (len <= (be->size - off));
+}
+
+int kvs_be_mmap_read(const void *ctx, uint32_t off, void *data, size_t len)
+{
+	const struct kvs_be_mmap *be = (const struct kvs_be_mmap *)ctx;
+
+	if (!kvs_be_mmap_inside(be, off, len)) {
+		return -KVS_EIO;
+	}
+
+	memcpy(data, be->mem + off, len);
+	return 0;
+}
+
+int kvs_be_mmap_prog(const void *ctx, uint32_t off, const void *data,
+		     size_t len)
+{
+	struct kvs_be_mmap *be = (struct kvs_be_mmap *)ctx;
+
+	if (!kvs_be_mmap_inside(be, off, len)) {
+		return -KVS_EIO;
+	}
+
+	memcpy(be->mem + off, data, len);
+	if (be->dstart == be->dend) {
+		be->dstart = off;
+		be->dend = off;
+	}
+
+	if (off < be->dstart) {
+		be->dstart = off;
+	}
+
+	if ((off + len) > be->dend) {
+		be->dend = off + len;
+	}
+
+	return 0;
+}
+
+int kvs_be_mmap_comp(const void *ctx, uint32_t off, const void *data,
+		     size_t len)
+{
+	const struct kvs_be_mmap *be = (const struct kvs_be_mmap *)ctx;
+
+	if (!kvs_be_mmap_inside(be, off, len)) {
+		return -KVS_EIO;
+	}
+
+	return memcmp(be->mem + off, data, len) == 0 ? 0 : -KVS_EIO;
+}
+
+int kvs_be_mmap_sync(const void *ctx, uint32_t off)
+{
+	struct kvs_be_mmap *be = (struct kvs_be_mmap *)ctx;
+	const uint32_t psz = (uint32_t)sysconf(_SC_PAGESIZE);
+	uint32_t start;
+
+	(void)off;
+	if (be->mem == NULL) {
+		return -KVS_EIO;
+	}
+
+	if (be->dstart == be->dend) {
+		return 0;
+	}
+
+	/* msync needs a page aligned start */
+	start = be->dstart - (be->dstart % psz);
+	if (msync(be->mem + start, be->dend - start, MS_SYNC) != 0) {
+		return -KVS_EIO;
+	}
+
+	be->dstart = 0U;
+	be->dend = 0U;
+	return 0;
+}
+
+int kvs_be_mmap_init(const void *ctx)
+{
+	struct kvs_be_mmap *be = (struct kvs_be_mmap *)ctx;
+	struct stat st;
+	void *mem;
+
+	if (be->mem != NULL) {
+		return 0;
+	}
+
+	be->fd = open(be->path, O_RDWR | O_CREAT, 0644);
+	if (be->fd < 0) {
+		return -KVS_EIO;
+	}
+
+	if ((fstat(be->fd, &st) != 0) ||
+	    (((size_t)st.st_size < be->size) &&
+	     (ftruncate(be->fd, (off_t)be->size) != 0))) {
+		goto err;
+	}
+
+	mem = mmap(NULL, be->size, PROT_READ | PROT_WRITE, MAP_SHARED, be->fd,
+		   0);
+	if (mem == MAP_FAILED) {
+		goto err;
+	}
+
+	be->mem = (uint8_t *)mem;
+	be->dstart = 0U;
+	be->dend = 0U;
+	return 0;
+err:
+	(void)close(be->fd);
+	be->fd = -1;
+	return -KVS_EIO;
+}
+
+int kvs_be_mmap_release(const void *ctx)
+{
+	struct kvs_be_mmap *be = (struct kvs_be_mmap *)ctx;
+	int rc = 0;
+
+	if (be->mem != NULL) {
+		rc = kvs_be_mmap_sync(ctx, 0U);
+		if (munmap(be->mem, be->size) != 0) {
+			rc = -KVS_EIO;
+		}
+
+		be->mem = NULL;
+	}
+
+	if (be->fd >= 0) {
+		if (close(be->fd) != 0) {
+			rc = -KVS_EIO;
+		}
+
+		be->fd = -1;
+	}
+
+	return rc;
+}
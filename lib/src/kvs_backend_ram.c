@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2023 Laczen
+ *
+ * KVS RAM backend definition
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include "kvs/kvs_backend_ram.h"
+
+static bool kvs_be_ram_inside(const struct kvs_be_ram *be, uint32_t off,
+			      size_t len)
+{
+	return (off <= be->size) && (len <= (be->size - off));
+}
+
+int kvs_be_ram_read(const void *ctx, uint32_t off, void *data, size_t len)
+{
+	const struct kvs_be_ram *be = (const struct kvs_be_ram *)ctx;
+
+	if (!kvs_be_ram_inside(be, off, len)) {
+		return -KVS_EIO;
+	}
+
+	memcpy(data, be->mem + off, len);
+	return 0;
+}
+
+int kvs_be_ram_prog(const void *ctx, uint32_t off, const void *data,
+		    size_t len)
+{
+	const struct kvs_be_ram *be = (const struct kvs_be_ram *)ctx;
+
+	if (!kvs_be_ram_inside(be, off, len)) {
+		return -KVS_EIO;
+	}
+
+	/* the first write to a erase block wipes the erase block */
+	if ((be->esize != 0U) && ((off % be->esize) == 0U)) {
+		size_t esize = be->esize;
+
+		if (esize > (be->size - off)) {
+			esize = be->size - off;
+		}
+
+		KVS_TRACE_ENTER(NULL, KVS_TRACE_DEV_ERASE, esize);
+		memset(be->mem + off, KVS_FILLCHAR, esize);
+		KVS_TRACE_EXIT(NULL, KVS_TRACE_DEV_ERASE, 0);
+	}
+
+	memcpy(be->mem + off, data, len);
+	return 0;
+}
+
+int kvs_be_ram_comp(const void *ctx, uint32_t off, const void *data,
+		    size_t len)
+{
+	const struct kvs_be_ram *be = (const struct kvs_be_ram *)ctx;
+
+	if (!kvs_be_ram_inside(be, off, len)) {
+		return -KVS_EIO;
+	}
+
+	return memcmp(be->mem + off, data, len) == 0 ? 0 : -KVS_EIO;
+}
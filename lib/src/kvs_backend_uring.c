@@ -0,0 +1,482 @@
+/*
+ * Copyright (c) 2023 Laczen
+ *
+ * KVS io_uring backend definition (Linux)
+ *
+ * The ring is set up with the raw io_uring syscalls (no liburing needed).
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "kvs/kvs_backend_uring.h"
+
+struct kvs_be_uring_ring {
+	int fd;			/* file descriptor */
+	int rfd;		/* ring file descriptor */
+	void *sqmap;		/* submission ring mapping */
+	size_t sqmsz;		/* submission ring mapping size */
+	void *cqmap;		/* completion ring mapping (or sqmap) */
+	size_t cqmsz;		/* completion ring mapping size */
+	struct io_uring_sqe *sqes;
+	size_t sqesz;		/* sqes mapping size */
+	uint32_t *sqhead, *sqtail, *sqmask, *sqarray;
+	uint32_t *cqhead, *cqtail, *cqmask;
+	struct io_uring_cqe *cqes;
+	uint32_t entries;	/* submission queue entries */
+	uint32_t queued;	/* sqes not yet submitted */
+	uint32_t inflight;	/* submitted sqes not yet completed */
+	int err;		/* first error of a completed sqe */
+	uint32_t woff;		/* read ahead window offset */
+	uint32_t wlen;		/* read ahead window length (0: invalid) */
+	uint32_t sused;		/* used part of stage */
+	uint8_t win[KVS_BE_URING_WINDOW];
+	uint8_t stage[KVS_BE_URING_STAGE];
+};
+
+static bool kvs_be_uring_inside(const struct kvs_be_uring *be, uint32_t off,
+				size_t len)
+{
+	return (be->ring != NULL) && (off <= be->size) &&
+	       (len <= (be->size - off));
+}
+
+static int uring_enter(struct kvs_be_uring_ring *ring, uint32_t wait)
+{
+	int rc;
+
+	do {
+		rc = (int)syscall(__NR_io_uring_enter, ring->rfd, ring->queued,
+				  wait, wait != 0U ? IORING_ENTER_GETEVENTS : 0U,
+				  NULL, 0);
+	} while ((rc < 0) && (errno == EINTR));
+
+	if (rc < 0) {
+		return -KVS_EIO;
+	}
+
+	ring->inflight += (uint32_t)rc;
+	ring->queued -= (uint32_t)rc;
+	return 0;
+}
+
+static void uring_reap(struct kvs_be_uring_ring *ring)
+{
+	uint32_t head = *ring->cqhead;
+
+	while (head != __atomic_load_n(ring->cqtail, __ATOMIC_ACQUIRE)) {
+		const struct io_uring_cqe *cqe =
+			&ring->cqes[head & *ring->cqmask];
+
+		/* user_data holds the expected result (length or 0) */
+		if ((cqe->res < 0) || ((uint64_t)cqe->res != cqe->user_data)) {
+			if (ring->err == 0) {
+				ring->err = -KVS_EIO;
+			}
+		}
+
+		head++;
+		ring->inflight--;
+	}
+
+	__atomic_store_n(ring->cqhead, head, __ATOMIC_RELEASE);
+}
+
+/* submit all queued sqes and wait until all of them are completed */
+static int uring_drain(struct kvs_be_uring_ring *ring)
+{
+	int rc = 0;
+
+	while ((ring->queued != 0U) || (ring->inflight != 0U)) {
+		rc = uring_enter(ring, 1U);
+		if (rc != 0) {
+			break;
+		}
+
+		uring_reap(ring);
+	}
+
+	ring->sused = 0U;
+	rc = (rc != 0) ? rc : ring->err;
+	ring->err = 0;
+	return rc;
+}
+
+static struct io_uring_sqe *uring_sqe(struct kvs_be_uring_ring *ring)
+{
+	const uint32_t tail = *ring->sqtail;
+	struct io_uring_sqe *sqe;
+	uint32_t idx;
+
+	if ((tail - __atomic_load_n(ring->sqhead, __ATOMIC_ACQUIRE)) ==
+	    ring->entries) {
+		return NULL;
+	}
+
+	idx = tail & *ring->sqmask;
+	sqe = &ring->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sqarray[idx] = idx;
+	__atomic_store_n(ring->sqtail, tail + 1U, __ATOMIC_RELEASE);
+	ring->queued++;
+	return sqe;
+}
+
+static void uring_prep_rw(struct io_uring_sqe *sqe, uint8_t op, int fd,
+			  uint32_t off, const void *data, size_t len)
+{
+	sqe->opcode = op;
+	sqe->fd = fd;
+	sqe->off = off;
+	sqe->addr = (uint64_t)(uintptr_t)data;
+	sqe->len = (uint32_t)len;
+	sqe->user_data = (uint64_t)len;
+}
+
+/* read synchronously, pending progs are completed first */
+static int uring_read(struct kvs_be_uring_ring *ring, uint32_t off, void *data,
+		      size_t len)
+{
+	struct io_uring_sqe *sqe;
+	int rc;
+
+	rc = uring_drain(ring);
+	if (rc != 0) {
+		return rc;
+	}
+
+	sqe = uring_sqe(ring);
+	if (sqe == NULL) {
+		return -KVS_EIO;
+	}
+
+	uring_prep_rw(sqe, IORING_OP_READ, ring->fd, off, data, len);
+	return uring_drain(ring);
+}
+
+int kvs_be_uring_read(const void *ctx, uint32_t off, void *data, size_t len)
+{
+	const struct kvs_be_uring *be = (const struct kvs_be_uring *)ctx;
+	struct kvs_be_uring_ring *ring = be->ring;
+	uint8_t *data8 = (uint8_t *)data;
+	int rc;
+
+	if (!kvs_be_uring_inside(be, off, len)) {
+		return -KVS_EIO;
+	}
+
+	if (len > KVS_BE_URING_WINDOW) {
+		return uring_read(ring, off, data, len);
+	}
+
+	while (len != 0U) {
+		size_t rdlen;
+
+		if ((ring->wlen == 0U) || (off < ring->woff) ||
+		    (off >= (ring->woff + ring->wlen))) {
+			ring->wlen = 0U;
+			ring->woff = off - (off % KVS_BE_URING_WINDOW);
+			rdlen = be->size - ring->woff;
+			rdlen = rdlen < KVS_BE_URING_WINDOW ?
+				rdlen : KVS_BE_URING_WINDOW;
+			rc = uring_read(ring, ring->woff, ring->win, rdlen);
+			if (rc != 0) {
+				return rc;
+			}
+
+			ring->wlen = (uint32_t)rdlen;
+		}
+
+		rdlen = ring->woff + ring->wlen - off;
+		rdlen = len < rdlen ? len : rdlen;
+		memcpy(data8, &ring->win[off - ring->woff], rdlen);
+		data8 += rdlen;
+		off += (uint32_t)rdlen;
+		len -= rdlen;
+	}
+
+	return 0;
+}
+
+/* keep the read ahead window in line with a queued prog */
+static void uring_win_update(struct kvs_be_uring_ring *ring, uint32_t off,
+			     const uint8_t *data, size_t len)
+{
+	const uint32_t wend = ring->woff + ring->wlen;
+	uint32_t start, end;
+
+	if ((ring->wlen == 0U) || (off >= wend) ||
+	    ((off + len) <= ring->woff)) {
+		return;
+	}
+
+	start = off > ring->woff ? off : ring->woff;
+	end = (off + len) < wend ? (uint32_t)(off + len) : wend;
+	memcpy(&ring->win[start - ring->woff], &data[start - off], end - start);
+}
+
+int kvs_be_uring_prog(const void *ctx, uint32_t off, const void *data,
+		      size_t len)
+{
+	const struct kvs_be_uring *be = (const struct kvs_be_uring *)ctx;
+	struct kvs_be_uring_ring *ring = be->ring;
+	const uint8_t *data8 = (const uint8_t *)data;
+	int rc;
+
+	if (!kvs_be_uring_inside(be, off, len)) {
+		return -KVS_EIO;
+	}
+
+	uring_win_update(ring, off, data8, len);
+	while (len != 0U) {
+		size_t wrlen = len < KVS_BE_URING_STAGE ?
+			       len : KVS_BE_URING_STAGE;
+		struct io_uring_sqe *sqe;
+
+		if (((KVS_BE_URING_STAGE - ring->sused) < wrlen) ||
+		    ((ring->inflight + ring->queued) >= ring->entries)) {
+			rc = uring_drain(ring);
+			if (rc != 0) {
+				return rc;
+			}
+		}
+
+		sqe = uring_sqe(ring);
+		if (sqe == NULL) {
+			return -KVS_EIO;
+		}
+
+		memcpy(&ring->stage[ring->sused], data8, wrlen);
+		uring_prep_rw(sqe, IORING_OP_WRITE, ring->fd, off,
+			      &ring->stage[ring->sused], wrlen);
+		ring->sused += (uint32_t)wrlen;
+		data8 += wrlen;
+		off += (uint32_t)wrlen;
+		len -= wrlen;
+	}
+
+	rc = uring_enter(ring, 0U);
+	if (rc == 0) {
+		uring_reap(ring);
+	}
+
+	return rc;
+}
+
+/* compare with the file, not with the window that prog already updated */
+int kvs_be_uring_comp(const void *ctx, uint32_t off, const void *data,
+		      size_t len)
+{
+	const struct kvs_be_uring *be = (const struct kvs_be_uring *)ctx;
+	const uint8_t *data8 = (const uint8_t *)data;
+	uint8_t buf[256];
+	int rc;
+
+	if (!kvs_be_uring_inside(be, off, len)) {
+		return -KVS_EIO;
+	}
+
+	while (len != 0U) {
+		size_t rdlen = len < sizeof(buf) ? len : sizeof(buf);
+
+		rc = uring_read(be->ring, off, buf, rdlen);
+		if (rc != 0) {
+			return rc;
+		}
+
+		if (memcmp(buf, data8, rdlen) != 0) {
+			return -KVS_EIO;
+		}
+
+		data8 += rdlen;
+		off += (uint32_t)rdlen;
+		len -= rdlen;
+	}
+
+	return 0;
+}
+
+int kvs_be_uring_sync(const void *ctx, uint32_t off)
+{
+	const struct kvs_be_uring *be = (const struct kvs_be_uring *)ctx;
+	struct kvs_be_uring_ring *ring = be->ring;
+	struct io_uring_sqe *sqe;
+	int rc;
+
+	(void)off;
+	if (ring == NULL) {
+		return -KVS_EIO;
+	}
+
+	sqe = uring_sqe(ring);
+	if (sqe == NULL) {
+		rc = uring_drain(ring);
+		sqe = uring_sqe(ring);
+		if ((rc != 0) || (sqe == NULL)) {
+			return -KVS_EIO;
+		}
+	}
+
+	/* IOSQE_IO_DRAIN: start the fdatasync after all queued progs */
+	sqe->opcode = IORING_OP_FSYNC;
+	sqe->fd = ring->fd;
+	sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+	sqe->flags = IOSQE_IO_DRAIN;
+	return uring_drain(ring);
+}
+
+static void uring_unmap(struct kvs_be_uring_ring *ring)
+{
+	if (ring->sqes != NULL) {
+		(void)munmap(ring->sqes, ring->sqesz);
+	}
+
+	if ((ring->cqmap != NULL) && (ring->cqmap != ring->sqmap)) {
+		(void)munmap(ring->cqmap, ring->cqmsz);
+	}
+
+	if (ring->sqmap != NULL) {
+		(void)munmap(ring->sqmap, ring->sqmsz);
+	}
+
+	if (ring->rfd >= 0) {
+		(void)close(ring->rfd);
+	}
+}
+
+static void *uring_mmap(int rfd, size_t size, off_t off)
+{
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, rfd, off);
+
+	return map == MAP_FAILED ? NULL : map;
+}
+
+static int uring_setup(struct kvs_be_uring_ring *ring)
+{
+	struct io_uring_params p;
+	uint8_t *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	ring->rfd = (int)syscall(__NR_io_uring_setup, KVS_BE_URING_ENTRIES, &p);
+	if (ring->rfd < 0) {
+		return -KVS_EIO;
+	}
+
+	ring->entries = p.sq_entries;
+	ring->sqmsz = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+	ring->cqmsz = p.cq_off.cqes +
+		      p.cq_entries * sizeof(struct io_uring_cqe);
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) != 0U) {
+		if (ring->cqmsz > ring->sqmsz) {
+			ring->sqmsz = ring->cqmsz;
+		}
+
+		ring->cqmsz = ring->sqmsz;
+	}
+
+	ring->sqmap = uring_mmap(ring->rfd, ring->sqmsz, IORING_OFF_SQ_RING);
+	if (ring->sqmap == NULL) {
+		return -KVS_EIO;
+	}
+
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) != 0U) {
+		ring->cqmap = ring->sqmap;
+	} else {
+		ring->cqmap = uring_mmap(ring->rfd, ring->cqmsz,
+					 IORING_OFF_CQ_RING);
+		if (ring->cqmap == NULL) {
+			return -KVS_EIO;
+		}
+	}
+
+	ring->sqesz = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = uring_mmap(ring->rfd, ring->sqesz, IORING_OFF_SQES);
+	if (ring->sqes == NULL) {
+		return -KVS_EIO;
+	}
+
+	sq = (uint8_t *)ring->sqmap;
+	ring->sqhead = (uint32_t *)(sq + p.sq_off.head);
+	ring->sqtail = (uint32_t *)(sq + p.sq_off.tail);
+	ring->sqmask = (uint32_t *)(sq + p.sq_off.ring_mask);
+	ring->sqarray = (uint32_t *)(sq + p.sq_off.array);
+	cq = (uint8_t *)ring->cqmap;
+	ring->cqhead = (uint32_t *)(cq + p.cq_off.head);
+	ring->cqtail = (uint32_t *)(cq + p.cq_off.tail);
+	ring->cqmask = (uint32_t *)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+}
+
+int kvs_be_uring_init(const void *ctx)
+{
+	struct kvs_be_uring *be = (struct kvs_be_uring *)ctx;
+	struct kvs_be_uring_ring *ring;
+	struct stat st;
+
+	if (be->ring != NULL) {
+		return 0;
+	}
+
+	ring = calloc(1, sizeof(*ring));
+	if (ring == NULL) {
+		return -KVS_EIO;
+	}
+
+	ring->rfd = -1;
+	ring->fd = open(be->path, O_RDWR | O_CREAT, 0644);
+	if (ring->fd < 0) {
+		goto err;
+	}
+
+	if ((fstat(ring->fd, &st) != 0) ||
+	    (((size_t)st.st_size < be->size) &&
+	     (ftruncate(ring->fd, (off_t)be->size) != 0))) {
+		goto err;
+	}
+
+	if (uring_setup(ring) != 0) {
+		goto err;
+	}
+
+	be->ring = ring;
+	return 0;
+err:
+	uring_unmap(ring);
+	if (ring->fd >= 0) {
+		(void)close(ring->fd);
+	}
+
+	free(ring);
+	return -KVS_EIO;
+}
+
+int kvs_be_uring_release(const void *ctx)
+{
+	struct kvs_be_uring *be = (struct kvs_be_uring *)ctx;
+	struct kvs_be_uring_ring *ring = be->ring;
+	int rc;
+
+	if (ring == NULL) {
+		return 0;
+	}
+
+	rc = uring_drain(ring);
+	uring_unmap(ring);
+	if ((close(ring->fd) != 0) && (rc == 0)) {
+		rc = -KVS_EIO;
+	}
+
+	free(ring);
+	be->ring = NULL;
+	return rc;
+}
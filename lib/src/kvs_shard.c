@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2023 Laczen
+ *
+ * KVS sharding: keys are spread over several kvs using a hash of the key.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include "kvs/kvs_shard.h"
+
+#define KVS_SHARD_FNV_OFFSET 0x811c9dc5U
+#define KVS_SHARD_FNV_PRIME 0x01000193U
+
+/* FNV-1a, cheap and spreads similar keys (e.g. "a/1", "a/2") well */
+static uint32_t shard_hash(const char *key)
+{
+	uint32_t hash = KVS_SHARD_FNV_OFFSET;
+
+	while (*key != '\0') {
+		hash ^= (uint8_t)*key++;
+		hash *= KVS_SHARD_FNV_PRIME;
+	}
+
+	return hash;
+}
+
+struct kvs *kvs_shard_get(const struct kvs_shard *shard, const char *key)
+{
+	if ((shard == NULL) || (shard->cnt == 0U) || (key == NULL)) {
+		return NULL;
+	}
+
+	return shard->kvs[shard_hash(key) % shard->cnt];
+}
+
+int kvs_shard_mount(const struct kvs_shard *shard)
+{
+	if ((shard == NULL) || (shard->cnt == 0U)) {
+		return -KVS_EINVAL;
+	}
+
+	uint32_t i;
+	int rc = 0;
+
+	for (i = 0U; i < shard->cnt; i++) {
+		rc = kvs_mount(shard->kvs[i]);
+		if (rc != 0) {
+			break;
+		}
+	}
+
+	if (rc != 0) {
+		while (i-- != 0U) {
+			(void)kvs_unmount(shard->kvs[i]);
+		}
+	}
+
+	return rc;
+}
+
+int kvs_shard_unmount(const struct kvs_shard *shard)
+{
+	if ((shard == NULL) || (shard->cnt == 0U)) {
+		return -KVS_EINVAL;
+	}
+
+	int rc = 0;
+
+	for (uint32_t i = 0U; i < shard->cnt; i++) {
+		const int urc = kvs_unmount(shard->kvs[i]);
+
+		if (rc == 0) {
+			rc = urc;
+		}
+	}
+
+	return rc;
+}
+
+int kvs_shard_erase(const struct kvs_shard *shard)
+{
+	if ((shard == NULL) || (shard->cnt == 0U)) {
+		return -KVS_EINVAL;
+	}
+
+	int rc = 0;
+
+	for (uint32_t i = 0U; (rc == 0) && (i < shard->cnt); i++) {
+		rc = kvs_erase(shard->kvs[i]);
+	}
+
+	return rc;
+}
+
+int kvs_shard_compact(const struct kvs_shard *shard)
+{
+	if ((shard == NULL) || (shard->cnt == 0U)) {
+		return -KVS_EINVAL;
+	}
+
+	int rc = 0;
+
+	for (uint32_t i = 0U; (rc == 0) && (i < shard->cnt); i++) {
+		rc = kvs_compact(shard->kvs[i]);
+	}
+
+	return rc;
+}
+
+int kvs_shard_gc(const struct kvs_shard *shard)
+{
+	if ((shard == NULL) || (shard->cnt == 0U)) {
+		return -KVS_EINVAL;
+	}
+
+	int rc = -KVS_EAGAIN;
+
+	for (uint32_t i = 0U; i < shard->cnt; i++) {
+		const int grc = kvs_gc(shard->kvs[i]);
+
+		if ((grc != 0) && (grc != -KVS_EAGAIN)) {
+			return grc;
+		}
+
+		if (grc == 0) {
+			rc = 0;
+		}
+	}
+
+	return rc;
+}
+
+int kvs_shard_entry_get(struct kvs_ent *ent, const struct kvs_shard *shard,
+			const char *key)
+{
+	const struct kvs *kvs = kvs_shard_get(shard, key);
+
+	if (kvs == NULL) {
+		return -KVS_EINVAL;
+	}
+
+	return kvs_entry_get(ent, kvs, key);
+}
+
+int kvs_shard_read(const struct kvs_shard *shard, const char *key, void *value,
+		   size_t len)
+{
+	const struct kvs *kvs = kvs_shard_get(shard, key);
+
+	if (kvs == NULL) {
+		return -KVS_EINVAL;
+	}
+
+	return kvs_read(kvs, key, value, len);
+}
+
+int kvs_shard_write(const struct kvs_shard *shard, const char *key,
+		    const void *value, size_t len)
+{
+	const struct kvs *kvs = kvs_shard_get(shard, key);
+
+	if (kvs == NULL) {
+		return -KVS_EINVAL;
+	}
+
+	return kvs_write(kvs, key, value, len);
+}
+
+int kvs_shard_write_at(const struct kvs_shard *shard, const char *key,
+		       uint32_t off, const void *data, size_t len)
+{
+	const struct kvs *kvs = kvs_shard_get(shard, key);
+
+	if (kvs == NULL) {
+		return -KVS_EINVAL;
+	}
+
+	return kvs_write_at(kvs, key, off, data, len);
+}
+
+int kvs_shard_delete(const struct kvs_shard *shard, const char *key)
+{
+	return kvs_shard_write(shard, key, NULL, 0);
+}
+
+int kvs_shard_walk(const struct kvs_shard *shard, const char *key,
+		   int (*cb)(struct kvs_ent *ent, void *cb_arg), void *cb_arg)
+{
+	if ((shard == NULL) || (shard->cnt == 0U)) {
+		return -KVS_EINVAL;
+	}
+
+	int rc = 0;
+
+	for (uint32_t i = 0U; (rc == 0) && (i < shard->cnt); i++) {
+		rc = kvs_walk(shard->kvs[i], key, cb, cb_arg);
+	}
+
+	return rc;
+}
+
+int kvs_shard_walk_unique(const struct kvs_shard *shard, const char *key,
+			  int (*cb)(struct kvs_ent *ent, void *cb_arg),
+			  void *cb_arg)
+{
+	if ((shard == NULL) || (shard->cnt == 0U)) {
+		return -KVS_EINVAL;
+	}
+
+	int rc = 0;
+
+	/* a key is only stored in one shard, so per shard unique is unique */
+	for (uint32_t i = 0U; (rc == 0) && (i < shard->cnt); i++) {
+		rc = kvs_walk_unique(shard->kvs[i], key, cb, cb_arg);
+	}
+
+	return rc;
+}
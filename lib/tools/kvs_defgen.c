@@ -0,0 +1,494 @@
+/*
+ * Copyright (c) 2023 Laczen
+ *
+ * KVS defaults generator: compiles a list of default key/value pairs to a C
+ * source file with a constant, minimal perfect hashed table (struct
+ * kvs_defaults) that kvs_read() uses for keys without a value.
+ *
+ * usage: kvs_defgen [-n name] input output
+ *	-n: name of the generated struct kvs_defaults (default: kvs_defaults)
+ *
+ * Each line of the input holds a key and its value separated by whitespace,
+ * empty lines and lines starting with '#' are skipped. Values are given as:
+ *	"text"		the characters (C escapes \\ \" \n \t \xHH, no
+ *			terminating 0 is added)
+ *	hex:0a0b0c	the bytes in the given order
+ *	u8:N, u16:N, u32:N
+ *			a unsigned integer (little endian)
+ *
+ * The table is built with hash and displace: the keys are put in buckets by
+ * kvs_defaults_hash(key, 0) and for each bucket (largest first) a seed is
+ * searched that maps all its keys to free entries.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "kvs/kvs.h"
+
+#define DEFGEN_MAXKEY 255U
+#define DEFGEN_MAXVAL 4096U
+#define DEFGEN_MAXSEED 0xffffU
+#define DEFGEN_LAMBDA 4U
+
+struct defgen_ent {
+	char *key;
+	uint8_t *value;
+	uint32_t len;
+	uint32_t bucket;
+};
+
+struct defgen {
+	struct defgen_ent *ent;
+	uint32_t cnt;
+	uint32_t *slot;		/* entry in each table position (cnt) */
+	uint16_t *disp;		/* displacement of each bucket (dcnt) */
+	uint32_t dcnt;
+};
+
+static int defgen_error(const char *file, uint32_t line, const char *msg)
+{
+	fprintf(stderr, "%s:%u: %s\n", file, line, msg);
+	return -1;
+}
+
+static int defgen_hexval(int c)
+{
+	if (isdigit(c)) {
+		return c - '0';
+	}
+
+	c = tolower(c);
+	return ((c >= 'a') && (c <= 'f')) ? (c - 'a' + 10) : -1;
+}
+
+static int defgen_string(const char *str, uint8_t *value, uint32_t *len)
+{
+	uint32_t cnt = 0U;
+
+	if (*str++ != '"') {
+		return -1;
+	}
+
+	while ((*str != '"') && (*str != '\0')) {
+		char c = *str++;
+
+		if (c == '\\') {
+			c = *str++;
+			switch (c) {
+			case 'n':
+				c = '\n';
+				break;
+			case 't':
+				c = '\t';
+				break;
+			case 'x':
+				if ((defgen_hexval(str[0]) < 0) ||
+				    (defgen_hexval(str[1]) < 0)) {
+					return -1;
+				}
+
+				c = (char)(defgen_hexval(str[0]) * 16 +
+					   defgen_hexval(str[1]));
+				str += 2;
+				break;
+			case '\\':
+			case '"':
+				break;
+			default:
+				return -1;
+			}
+		}
+
+		if (cnt == DEFGEN_MAXVAL) {
+			return -1;
+		}
+
+		value[cnt++] = (uint8_t)c;
+	}
+
+	if ((*str != '"') || (str[1] != '\0')) {
+		return -1;
+	}
+
+	*len = cnt;
+	return 0;
+}
+
+static int defgen_hex(const char *str, uint8_t *value, uint32_t *len)
+{
+	uint32_t cnt = 0U;
+
+	while (*str != '\0') {
+		const int hi = defgen_hexval(str[0]);
+		const int lo = (hi < 0) ? -1 : defgen_hexval(str[1]);
+
+		if ((lo < 0) || (cnt == DEFGEN_MAXVAL)) {
+			return -1;
+		}
+
+		value[cnt++] = (uint8_t)(hi * 16 + lo);
+		str += 2;
+	}
+
+	*len = cnt;
+	return 0;
+}
+
+static int defgen_uint(const char *str, uint32_t size, uint8_t *value,
+		       uint32_t *len)
+{
+	unsigned long long val;
+	char *end;
+
+	val = strtoull(str, &end, 0);
+	if ((*str == '\0') || (*end != '\0') ||
+	    ((size < 8U) && (val >> (8U * size)) != 0U)) {
+		return -1;
+	}
+
+	for (uint32_t i = 0U; i < size; i++) {
+		value[i] = (uint8_t)(val >> (8U * i));
+	}
+
+	*len = size;
+	return 0;
+}
+
+static int defgen_value(const char *str, uint8_t *value, uint32_t *len)
+{
+	if (*str == '"') {
+		return defgen_string(str, value, len);
+	}
+
+	if (strncmp(str, "hex:", 4) == 0) {
+		return defgen_hex(str + 4, value, len);
+	}
+
+	if (strncmp(str, "u8:", 3) == 0) {
+		return defgen_uint(str + 3, 1U, value, len);
+	}
+
+	if (strncmp(str, "u16:", 4) == 0) {
+		return defgen_uint(str + 4, 2U, value, len);
+	}
+
+	if (strncmp(str, "u32:", 4) == 0) {
+		return defgen_uint(str + 4, 4U, value, len);
+	}
+
+	return -1;
+}
+
+static int defgen_read(struct defgen *gen, const char *file)
+{
+	FILE *fp = fopen(file, "r");
+	char line[2 * DEFGEN_MAXVAL + DEFGEN_MAXKEY + 16U];
+	uint8_t value[DEFGEN_MAXVAL];
+	uint32_t nr = 0U;
+	int rc = 0;
+
+	if (fp == NULL) {
+		perror(file);
+		return -1;
+	}
+
+	while ((rc == 0) && (fgets(line, sizeof(line), fp) != NULL)) {
+		struct defgen_ent *ent;
+		char *key = line, *val, *end;
+		uint32_t len;
+
+		nr++;
+		end = line + strlen(line);
+		while ((end != line) && isspace((unsigned char)end[-1])) {
+			*--end = '\0';
+		}
+
+		while (isspace((unsigned char)*key)) {
+			key++;
+		}
+
+		if ((*key == '\0') || (*key == '#')) {
+			continue;
+		}
+
+		val = key;
+		while ((*val != '\0') && (!isspace((unsigned char)*val))) {
+			val++;
+		}
+
+		if (*val != '\0') {
+			*val++ = '\0';
+		}
+
+		while (isspace((unsigned char)*val)) {
+			val++;
+		}
+
+		if (strlen(key) > DEFGEN_MAXKEY) {
+			rc = defgen_error(file, nr, "key too long");
+			break;
+		}
+
+		if ((defgen_value(val, value, &len) != 0) || (len == 0U)) {
+			rc = defgen_error(file, nr, "invalid value");
+			break;
+		}
+
+		for (uint32_t i = 0U; i < gen->cnt; i++) {
+			if (strcmp(gen->ent[i].key, key) == 0) {
+				rc = defgen_error(file, nr, "duplicate key");
+				break;
+			}
+		}
+
+		if (rc != 0) {
+			break;
+		}
+
+		ent = realloc(gen->ent, (gen->cnt + 1U) * sizeof(*ent));
+		if (ent == NULL) {
+			rc = -1;
+			break;
+		}
+
+		gen->ent = ent;
+		ent = &gen->ent[gen->cnt++];
+		ent->key = strdup(key);
+		ent->value = malloc(len);
+		ent->len = len;
+		if ((ent->key == NULL) || (ent->value == NULL)) {
+			rc = -1;
+			break;
+		}
+
+		memcpy(ent->value, value, len);
+	}
+
+	fclose(fp);
+	return rc;
+}
+
+/* search a seed for the keys of a bucket (ent) that puts them in free slots */
+static int defgen_place(struct defgen *gen, uint32_t b, const uint32_t *ent,
+			uint32_t n, uint32_t *pos)
+{
+	for (uint32_t seed = 0U; seed <= DEFGEN_MAXSEED; seed++) {
+		uint32_t i;
+
+		for (i = 0U; i < n; i++) {
+			const char *key = gen->ent[ent[i]].key;
+			uint32_t j;
+
+			pos[i] = kvs_defaults_hash(key, strlen(key), seed) %
+				 gen->cnt;
+			for (j = 0U; j < i; j++) {
+				if (pos[j] == pos[i]) {
+					break;
+				}
+			}
+
+			if ((j != i) || (gen->slot[pos[i]] != UINT32_MAX)) {
+				break;
+			}
+		}
+
+		if (i != n) {
+			continue;
+		}
+
+		for (i = 0U; i < n; i++) {
+			gen->slot[pos[i]] = ent[i];
+		}
+
+		gen->disp[b] = (uint16_t)seed;
+		return 0;
+	}
+
+	return -1;
+}
+
+static int defgen_bucket_cmp(const void *a, const void *b)
+{
+	const uint32_t *ba = (const uint32_t *)a;
+	const uint32_t *bb = (const uint32_t *)b;
+
+	/* [size, bucket], largest buckets first */
+	if (ba[0] != bb[0]) {
+		return (ba[0] < bb[0]) ? 1 : -1;
+	}
+
+	return (ba[1] > bb[1]) - (ba[1] < bb[1]);
+}
+
+static int defgen_build(struct defgen *gen, uint32_t dcnt)
+{
+	uint32_t (*bucket)[2] = calloc(dcnt, sizeof(*bucket));
+	uint32_t *pos = calloc(gen->cnt, sizeof(uint32_t));
+	uint32_t *ent = calloc(gen->cnt, sizeof(uint32_t));
+	int rc = -1;
+
+	gen->dcnt = dcnt;
+	gen->slot = realloc(gen->slot, gen->cnt * sizeof(uint32_t));
+	gen->disp = realloc(gen->disp, dcnt * sizeof(uint16_t));
+	if ((bucket == NULL) || (pos == NULL) || (ent == NULL) ||
+	    (gen->slot == NULL) || (gen->disp == NULL)) {
+		goto end;
+	}
+
+	memset(gen->slot, 0xff, gen->cnt * sizeof(uint32_t));
+	memset(gen->disp, 0, dcnt * sizeof(uint16_t));
+	for (uint32_t b = 0U; b < dcnt; b++) {
+		bucket[b][1] = b;
+	}
+
+	for (uint32_t i = 0U; i < gen->cnt; i++) {
+		struct defgen_ent *dent = &gen->ent[i];
+
+		dent->bucket = kvs_defaults_hash(dent->key, strlen(dent->key),
+						 0U) % dcnt;
+		bucket[dent->bucket][0]++;
+	}
+
+	qsort(bucket, dcnt, sizeof(*bucket), defgen_bucket_cmp);
+	for (uint32_t b = 0U; (b < dcnt) && (bucket[b][0] != 0U); b++) {
+		uint32_t n = 0U;
+
+		for (uint32_t i = 0U; i < gen->cnt; i++) {
+			if (gen->ent[i].bucket == bucket[b][1]) {
+				ent[n++] = i;
+			}
+		}
+
+		if (defgen_place(gen, bucket[b][1], ent, n, pos) != 0) {
+			goto end;
+		}
+	}
+
+	rc = 0;
+end:
+	free(bucket);
+	free(pos);
+	free(ent);
+	return rc;
+}
+
+static int defgen_write(const struct defgen *gen, const char *file,
+			const char *input, const char *name)
+{
+	FILE *fp = fopen(file, "w");
+
+	if (fp == NULL) {
+		perror(file);
+		return -1;
+	}
+
+	fprintf(fp, "/* generated by kvs_defgen from %s, do not edit */\n\n",
+		input);
+	fprintf(fp, "#include \"kvs/kvs.h\"\n\n");
+	for (uint32_t i = 0U; i < gen->cnt; i++) {
+		const struct defgen_ent *ent = &gen->ent[gen->slot[i]];
+
+		fprintf(fp, "static const uint8_t %s_v%u[] = {", name, i);
+		for (uint32_t j = 0U; j < ent->len; j++) {
+			fprintf(fp, "%s0x%02x", ((j % 12U) == 0U) ?
+				"\n\t" : " ", ent->value[j]);
+			if (j != (ent->len - 1U)) {
+				fputc(',', fp);
+			}
+		}
+
+		fprintf(fp, "\n};\n\n");
+	}
+
+	fprintf(fp, "static const struct kvs_default %s_ent[] = {\n", name);
+	for (uint32_t i = 0U; i < gen->cnt; i++) {
+		const struct defgen_ent *ent = &gen->ent[gen->slot[i]];
+
+		fprintf(fp, "\t{\n\t\t.key = \"");
+		for (const char *c = ent->key; *c != '\0'; c++) {
+			if ((*c == '"') || (*c == '\\')) {
+				fputc('\\', fp);
+			}
+
+			fputc(*c, fp);
+		}
+
+		fprintf(fp, "\",\n\t\t.value = %s_v%u,\n\t\t.len = %uU,\n\t},\n",
+			name, i, ent->len);
+	}
+
+	fprintf(fp, "};\n\nstatic const uint16_t %s_disp[] = {", name);
+	for (uint32_t i = 0U; i < gen->dcnt; i++) {
+		fprintf(fp, "%s%u%s", ((i % 8U) == 0U) ? "\n\t" : " ",
+			gen->disp[i], (i != (gen->dcnt - 1U)) ? "," : "");
+	}
+
+	fprintf(fp, "\n};\n\nconst struct kvs_defaults %s = {\n", name);
+	fprintf(fp, "\t.ent = %s_ent,\n\t.disp = %s_disp,\n", name, name);
+	fprintf(fp, "\t.cnt = %uU,\n\t.dcnt = %uU,\n};\n", gen->cnt,
+		gen->dcnt);
+	return (fclose(fp) == 0) ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	struct defgen gen = {0};
+	const char *name = "kvs_defaults";
+	uint32_t dcnt;
+	int opt, rc;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			name = optarg;
+			break;
+		default:
+			optind = argc;
+			break;
+		}
+	}
+
+	if ((argc - optind) != 2) {
+		fprintf(stderr, "usage: %s [-n name] input output\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	rc = defgen_read(&gen, argv[optind]);
+	if ((rc == 0) && (gen.cnt == 0U)) {
+		rc = defgen_error(argv[optind], 0U, "no defaults");
+	}
+
+	/* more buckets (smaller ones) when no seed is found */
+	dcnt = (gen.cnt + DEFGEN_LAMBDA - 1U) / DEFGEN_LAMBDA;
+	while (rc == 0) {
+		if (defgen_build(&gen, dcnt) == 0) {
+			break;
+		}
+
+		if (dcnt == gen.cnt) {
+			rc = defgen_error(argv[optind], 0U, "no perfect hash");
+			break;
+		}
+
+		dcnt = KVS_MIN(gen.cnt, dcnt + (dcnt + 3U) / 4U);
+	}
+
+	if (rc == 0) {
+		rc = defgen_write(&gen, argv[optind + 1], argv[optind], name);
+	}
+
+	for (uint32_t i = 0U; i < gen.cnt; i++) {
+		free(gen.ent[i].key);
+		free(gen.ent[i].value);
+	}
+
+	free(gen.ent);
+	free(gen.slot);
+	free(gen.disp);
+	return (rc == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -14,18 +14,33 @@
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(kvs_backend_eeprom);
 
+/* consecutive progs within a eeprom page are collected and written at once */
+struct kvs_be_eeprom_page {
+	uint8_t *buf;
+	uint32_t start;
+	uint32_t len;
+};
+
 struct kvs_be_eeprom {
 	const struct device *const dev;
 	const off_t off;
 	const size_t size;
+	const size_t pgsize;
+	struct kvs_be_eeprom_page *page;
 	struct k_sem *sem;
 };
 
+static int kvs_be_eeprom_comp(const void *ctx, uint32_t off, const void *data,
+			      size_t len);
+
 static int kvs_be_eeprom_read(const void *ctx, uint32_t off, void *data,
 			      size_t len)
 {
 	const struct kvs_be_eeprom *be = (const struct kvs_be_eeprom *)ctx;
+	const struct kvs_be_eeprom_page *page = be->page;
 	const uint32_t rdoff = be->off + off;
+	const uint32_t pgstart = page->start;
+	const uint32_t pgend = pgstart + page->len;
 	int rc;
 
 	if ((off + len) > be->size) {
@@ -35,17 +50,56 @@ static int kvs_be_eeprom_read(const void *ctx, uint32_t off, void *data,
 	}
 
 	rc = eeprom_read(be->dev, rdoff, data, len);
+	if (rc != 0) {
+		goto end;
+	}
+
+	/* data that is not yet written is taken from the page buffer */
+	if ((rdoff < pgend) && (pgstart < (rdoff + len))) {
+		const uint32_t cpstart = MAX(rdoff, pgstart);
+		const uint32_t cpend = MIN(rdoff + len, pgend);
+
+		memcpy((uint8_t *)data + (cpstart - rdoff),
+		       page->buf + (cpstart - pgstart), cpend - cpstart);
+	}
+
 end:
 	LOG_DBG("read %d bytes at %x [%d]", len, rdoff, rc);
 	return rc;
 }
 
+static int kvs_be_eeprom_flush(const struct kvs_be_eeprom *be)
+{
+	struct kvs_be_eeprom_page *page = be->page;
+	const uint32_t len = page->len;
+	int rc;
+
+	if (len == 0U) {
+		return 0;
+	}
+
+	page->len = 0U;
+	rc = eeprom_write(be->dev, page->start, page->buf, len);
+	if (rc != 0) {
+		goto end;
+	}
+
+	/* the comparison done after each prog only sees the page buffer */
+	rc = kvs_be_eeprom_comp(be, page->start - be->off, page->buf, len);
+end:
+	LOG_DBG("flush %d bytes at %x [%d]", len, page->start, rc);
+	return rc;
+}
+
 static int kvs_be_eeprom_prog(const void *ctx, uint32_t off, const void *data,
 			      size_t len)
 {
 	const struct kvs_be_eeprom *be = (const struct kvs_be_eeprom *)ctx;
-	const uint32_t wroff = be->off + off;
-	int rc;
+	struct kvs_be_eeprom_page *page = be->page;
+	const uint8_t *data8 = (const uint8_t *)data;
+	uint32_t wroff = be->off + off;
+	size_t wrrem = len;
+	int rc = 0;
 
 	if ((off + len) > be->size) {
 		LOG_ERR("prog out of bounds [%x - %d]", off, len);
@@ -53,9 +107,47 @@ static int kvs_be_eeprom_prog(const void *ctx, uint32_t off, const void *data,
 		goto end;
 	}
 
-	rc = eeprom_write(be->dev, wroff, data, len);
+	if (be->pgsize <= 1U) {
+		rc = eeprom_write(be->dev, wroff, data, len);
+		goto end;
+	}
+
+	while (wrrem != 0U) {
+		const uint32_t pgend = ROUND_DOWN(wroff, be->pgsize) +
+				       be->pgsize;
+		const uint32_t wrlen = MIN(wrrem, pgend - wroff);
+
+		/* a prog that does not continue the buffered data (e.g. a
+		 * entry header that is written after its data) is written
+		 * after it, this keeps the order of the writes.
+		 */
+		if ((page->len != 0U) && ((page->start + page->len) != wroff)) {
+			rc = kvs_be_eeprom_flush(be);
+			if (rc != 0) {
+				goto end;
+			}
+		}
+
+		if (page->len == 0U) {
+			page->start = wroff;
+		}
+
+		memcpy(page->buf + page->len, data8, wrlen);
+		page->len += wrlen;
+		if ((wroff + wrlen) == pgend) {
+			rc = kvs_be_eeprom_flush(be);
+			if (rc != 0) {
+				goto end;
+			}
+		}
+
+		wroff += wrlen;
+		data8 += wrlen;
+		wrrem -= wrlen;
+	}
+
 end:
-	LOG_DBG("prog %d bytes at %x [%d]", len, wroff, rc);
+	LOG_DBG("prog %d bytes at %x [%d]", len, be->off + off, rc);
 	return rc;
 }
 
@@ -71,7 +163,7 @@ static int kvs_be_eeprom_comp(const void *ctx, uint32_t off, const void *data,
 
 	while (cmplen != 0) {
 		uint32_t rdlen = MIN(cmplen, sizeof(buf));
-		
+
 		rc = kvs_be_eeprom_read(ctx, off, buf, rdlen);
 		if (rc != 0) {
 			goto end;
@@ -94,8 +186,9 @@ end:
 static int kvs_be_eeprom_sync(const void *ctx, uint32_t off)
 {
 	const struct kvs_be_eeprom *be = (const struct kvs_be_eeprom *)ctx;
-	const uint32_t wroff = be->off + off; 
-	const char end[4] = "\0\0\0\0";
+	const uint32_t wroff = be->off + off;
+	/* a empty header with a bad crc (a zero header is a valid entry) */
+	const char end[4] = "\0\0\0\xff";
 	int rc;
 
 	if (off > be->size) {
@@ -104,13 +197,17 @@ static int kvs_be_eeprom_sync(const void *ctx, uint32_t off)
 		goto end;
 	}
 
-	if ((off + sizeof(end)) > be->size) {
-		rc = 0;
-		goto end;
+	/* the end marker is written together with the buffered data */
+	if ((off + sizeof(end)) <= be->size) {
+		rc = kvs_be_eeprom_prog(ctx, off, end, sizeof(end));
+		if (rc != 0) {
+			goto end;
+		}
 	}
 
-	rc = eeprom_write(be->dev, wroff, end, 4);
+	rc = kvs_be_eeprom_flush(be);
 end:
+	LOG_DBG("sync at %x [%d]", wroff, rc);
 	return rc;
 }
 
@@ -128,23 +225,28 @@ static int kvs_be_eeprom_lock(const void *ctx)
 static int kvs_be_eeprom_unlock(const void *ctx)
 {
 	const struct kvs_be_eeprom *be = (const struct kvs_be_eeprom *)ctx;
-	
+
 	if (IS_ENABLED(CONFIG_MULTITHREADING)) {
 		k_sem_give(be->sem);
 	}
-	
+
 	return 0;
 }
 
 static int kvs_be_eeprom_init(const void *ctx)
 {
+	const struct kvs_be_eeprom *be = (const struct kvs_be_eeprom *)ctx;
+
+	be->page->len = 0U;
 	LOG_DBG("backend init [%d]", 0);
 	return 0;
 }
 
 static int kvs_be_eeprom_release(const void *ctx)
 {
-	return 0;
+	const struct kvs_be_eeprom *be = (const struct kvs_be_eeprom *)ctx;
+
+	return kvs_be_eeprom_flush(be);
 }
 
 #define KVS_DEV(inst) DEVICE_DT_GET(DT_PHANDLE(inst, eeprom))
@@ -155,6 +257,10 @@ static int kvs_be_eeprom_release(const void *ctx)
 	(DT_PROP(inst, size)), (KVS_MAXSIZE(inst)))
 #define KVS_BLSIZE(inst) (DT_PROP(inst, block_size))
 #define KVS_BCNT(inst) KVS_SIZE(inst)/KVS_BLSIZE(inst)
+#define KVS_INPLACE(inst) DT_PROP(inst, in_place_update)
+#define KVS_PGSIZE(inst) COND_CODE_1(DT_NODE_HAS_PROP(inst, page_size),	\
+	(DT_PROP(inst, page_size)),						\
+	(DT_PROP_OR(DT_PHANDLE(inst, eeprom), pagesize, 0)))
 
 #define KVS_CHECK_DEVSIZE(inst)							\
 	BUILD_ASSERT((KVS_DEVOFF(inst) + KVS_SIZE(inst)) <= KVS_DEVSIZE(inst),	\
@@ -171,20 +277,26 @@ static int kvs_be_eeprom_release(const void *ctx)
 	KVS_CHECK_BLSIZE(inst);							\
 	KVS_CHECK_SCNT(inst);							\
 	K_SEM_DEFINE(kvs_be_eeprom_sem_##inst, 1, 1);				\
+	uint8_t kvs_be_eeprom_pbuf_##inst[MAX(KVS_PGSIZE(inst), 1)];		\
+	struct kvs_be_eeprom_page kvs_be_eeprom_page_##inst = {			\
+		.buf = kvs_be_eeprom_pbuf_##inst,				\
+	};									\
 	const struct kvs_be_eeprom kvs_be_eeprom_##inst = {			\
 		.dev = KVS_DEV(inst),						\
 		.off = KVS_DEVOFF(inst),					\
 		.size = KVS_SIZE(inst),						\
+		.pgsize = KVS_PGSIZE(inst),					\
+		.page = &kvs_be_eeprom_page_##inst,				\
 		.sem = &kvs_be_eeprom_sem_##inst,				\
 	};									\
 	const char kvs_be_eeprom_cookie_##inst[] = "Zephyr-KVS";		\
-	DEFINE_KVS(								\
+	DEFINE_KVS_INPLACE(							\
 		inst, &kvs_be_eeprom_##inst, KVS_BLSIZE(inst), KVS_BCNT(inst),	\
 		1, NULL, 1, kvs_be_eeprom_read, kvs_be_eeprom_prog, 		\
 		kvs_be_eeprom_comp, kvs_be_eeprom_sync,	kvs_be_eeprom_init,	\
 		kvs_be_eeprom_release, kvs_be_eeprom_lock,			\
 		kvs_be_eeprom_unlock, (void *)&kvs_be_eeprom_cookie_##inst,	\
-		sizeof(kvs_be_eeprom_cookie_##inst) - 1				\
+		sizeof(kvs_be_eeprom_cookie_##inst) - 1, KVS_INPLACE(inst)	\
 	);
-	
+
 DT_FOREACH_STATUS_OKAY(zephyr_kvs_eeprom, KVS_EEPROM_DEFINE)
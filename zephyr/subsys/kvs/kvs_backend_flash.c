@@ -66,7 +66,10 @@ static int kvs_be_flash_prog(const void *ctx, uint32_t off, const void *data,
 
 		if (fp_info.start_offset == wroff) {
 			size_t esize = MAX(fp_info.size, be->blsize);
+
+			KVS_TRACE_ENTER(NULL, KVS_TRACE_DEV_ERASE, esize);
 			rc = flash_erase(be->dev, wroff, esize);
+			KVS_TRACE_EXIT(NULL, KVS_TRACE_DEV_ERASE, rc);
 			if (rc) {
 				LOG_ERR("failed to erase %d bytes at %x",
 					esize, wroff);
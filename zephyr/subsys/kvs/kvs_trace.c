@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2023 Laczen
+ *
+ * KVS trace hooks on the tracing subsystem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/tracing/tracing.h>
+#include <zephyr/subsys/kvs.h>
+
+#define KVS_TRACE_NAME(_op, _name) [_op] = {"kvs_" _name, "kvs_" _name "_exit"}
+
+static const char *const kvs_trace_names[KVS_TRACE_CNT][2] = {
+	KVS_TRACE_NAME(KVS_TRACE_MOUNT, "mount"),
+	KVS_TRACE_NAME(KVS_TRACE_UNMOUNT, "unmount"),
+	KVS_TRACE_NAME(KVS_TRACE_ERASE, "erase"),
+	KVS_TRACE_NAME(KVS_TRACE_ENTRY_GET, "entry_get"),
+	KVS_TRACE_NAME(KVS_TRACE_ENTRY_READ, "entry_read"),
+	KVS_TRACE_NAME(KVS_TRACE_READ, "read"),
+	KVS_TRACE_NAME(KVS_TRACE_READ_MANY, "read_many"),
+	KVS_TRACE_NAME(KVS_TRACE_WRITE, "write"),
+	KVS_TRACE_NAME(KVS_TRACE_WRITE_AT, "write_at"),
+	KVS_TRACE_NAME(KVS_TRACE_WALK, "walk"),
+	KVS_TRACE_NAME(KVS_TRACE_WALK_UNIQUE, "walk_unique"),
+	KVS_TRACE_NAME(KVS_TRACE_COMPACT, "compact"),
+	KVS_TRACE_NAME(KVS_TRACE_GC, "gc"),
+	KVS_TRACE_NAME(KVS_TRACE_FSSTAT, "fsstat"),
+	KVS_TRACE_NAME(KVS_TRACE_FLUSH, "flush"),
+	KVS_TRACE_NAME(KVS_TRACE_LOOKUP, "lookup"),
+	KVS_TRACE_NAME(KVS_TRACE_APPEND, "append"),
+	KVS_TRACE_NAME(KVS_TRACE_RECLAIM, "reclaim"),
+	KVS_TRACE_NAME(KVS_TRACE_DEV_READ, "dev_read"),
+	KVS_TRACE_NAME(KVS_TRACE_DEV_PROG, "dev_prog"),
+	KVS_TRACE_NAME(KVS_TRACE_DEV_COMP, "dev_comp"),
+	KVS_TRACE_NAME(KVS_TRACE_DEV_SYNC, "dev_sync"),
+	KVS_TRACE_NAME(KVS_TRACE_DEV_LOCK, "dev_lock"),
+	KVS_TRACE_NAME(KVS_TRACE_DEV_ERASE, "dev_erase"),
+};
+
+/* the events are timestamped by the tracing backend, arg0 identifies the kvs
+ * and arg1 is the size (enter) or the result (exit).
+ */
+void kvs_trace_enter(const struct kvs *kvs, enum kvs_trace_ops op, size_t size)
+{
+	sys_trace_named_event(kvs_trace_names[op][0], (uint32_t)(uintptr_t)kvs,
+			      (uint32_t)size);
+}
+
+void kvs_trace_exit(const struct kvs *kvs, enum kvs_trace_ops op, int rc)
+{
+	sys_trace_named_event(kvs_trace_names[op][1], (uint32_t)(uintptr_t)kvs,
+			      (uint32_t)rc);
+}
@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
 #include <zephyr/settings/settings.h>
 #include <zephyr/subsys/kvs.h>
 
@@ -16,9 +17,17 @@ static int settings_kvs_load(struct settings_store *cs,
 static int settings_kvs_save(struct settings_store *cs, const char *name,
 			     const char *value, size_t val_len);
 static void *settings_kvs_storage_get(struct settings_store *cs);
+#if CONFIG_SETTINGS_KVS_SAVE_BUFFER_SIZE > 0
+static int settings_kvs_save_start(struct settings_store *cs);
+static int settings_kvs_save_end(struct settings_store *cs);
+#endif
 
 static struct settings_store_itf settings_kvs_itf = {
 	.csi_load = settings_kvs_load,
+#if CONFIG_SETTINGS_KVS_SAVE_BUFFER_SIZE > 0
+	.csi_save_start = settings_kvs_save_start,
+	.csi_save_end = settings_kvs_save_end,
+#endif
 	.csi_save = settings_kvs_save,
 	.csi_storage_get = settings_kvs_storage_get
 };
@@ -26,6 +35,11 @@ static struct settings_store_itf settings_kvs_itf = {
 struct settings_kvs {
 	struct settings_store cf_store;
 	struct kvs *cf_kvs;
+#if CONFIG_SETTINGS_KVS_SAVE_BUFFER_SIZE > 0
+	struct kvs_wbuf *cf_wbuf;	/* write buffer outside a save */
+	struct kvs_wbuf cf_save_wbuf;	/* write buffer during a save */
+	uint8_t cf_save_mem[CONFIG_SETTINGS_KVS_SAVE_BUFFER_SIZE];
+#endif
 };
 
 static ssize_t settings_kvs_read_fn(void *item, void *data, size_t len)
@@ -61,17 +75,29 @@ int settings_kvs_dst(struct settings_kvs *cf)
 static int kvs_load_cb(struct kvs_ent *ent, void *cb_arg)
 {
         const struct settings_load_arg *arg = (struct settings_load_arg *)cb_arg;
-        char name[entry_get_klen(ent) + 1];
+        char name[SETTINGS_MAX_NAME_LEN + SETTINGS_EXTRA_LEN + 1];
+        uint16_t id;
         int rc;
 
-        rc = kvs_entry_read(ent, 0, name, entry_get_klen(ent));
-        if (rc != 0) {
+        /* Skip numeric keys, they are not settings */
+        if (kvs_entry_id(ent, &id) == 0) {
+                return 0;
+        }
+
+        /* The name is decoded when the kvs has a key dictionary */
+        rc = kvs_entry_key(ent, name, sizeof(name));
+        if (rc < 0) {
                 /* Continue when a read name read fails */
                 rc = 0;
                 goto end;
         }
 
-        name[entry_get_klen(ent)]= '\0';
+        /* Skip names that are too long for settings */
+        if ((size_t)rc >= sizeof(name)) {
+                return 0;
+        }
+
+        name[rc]= '\0';
         rc = settings_call_set_handler(name, entry_get_vlen(ent),
 			               settings_kvs_read_fn, (void *)ent, arg);
 end:
@@ -85,6 +111,21 @@ static int settings_kvs_load(struct settings_store *cs,
                                                cf_store);
 	const char *subtree = (arg->subtree == NULL) ? "" : arg->subtree;
 
+#ifdef CONFIG_SETTINGS_KVS_LEAF_LOAD
+	struct kvs_ent ent;
+
+	/* A subtree that names a setting is loaded by a lookup instead of a
+	 * walk of the kvs.
+	 */
+	if ((subtree[0] != '\0') &&
+	    (kvs_entry_get(&ent, cf->cf_kvs, subtree) == 0) &&
+	    (entry_get_vlen(&ent) != 0U)) {
+		return settings_call_set_handler(subtree, entry_get_vlen(&ent),
+						 settings_kvs_read_fn,
+						 (void *)&ent, arg);
+	}
+#endif
+
         return kvs_walk_unique(cf->cf_kvs, subtree, kvs_load_cb, (void *)arg);
 }
 
@@ -105,11 +146,57 @@ static int settings_kvs_save(struct settings_store *cs, const char *name,
         return kvs_write(cf->cf_kvs, name, (const void *)value, val_len);
 }
 
+#if CONFIG_SETTINGS_KVS_SAVE_BUFFER_SIZE > 0
+/* A settings_save() collects the items in a write buffer, they are compared
+ * with the stored values in one walk and written with one sync at the end.
+ */
+static int settings_kvs_save_start(struct settings_store *cs)
+{
+	struct settings_kvs *cf = CONTAINER_OF(cs, struct settings_kvs,
+                                               cf_store);
+	struct kvs_wbuf *prev;
+	int rc;
+
+	rc = kvs_wbuf_attach(cf->cf_kvs, &cf->cf_save_wbuf, &prev);
+	if (rc) {
+		return rc;
+	}
+
+	/* A save that failed to end has left its buffer attached */
+	if (prev != &cf->cf_save_wbuf) {
+		cf->cf_wbuf = prev;
+	}
+
+	return 0;
+}
+
+static int settings_kvs_save_end(struct settings_store *cs)
+{
+	struct settings_kvs *cf = CONTAINER_OF(cs, struct settings_kvs,
+                                               cf_store);
+	struct kvs_wbuf *save_wbuf;
+	int rc;
+
+	rc = kvs_wbuf_attach(cf->cf_kvs, cf->cf_wbuf, &save_wbuf);
+	if (rc) {
+		LOG_ERR("Failed to write settings [%d]", rc);
+	}
+
+	return rc;
+}
+#endif
+
 /* Initialize the kvs backend. */
 int settings_kvs_backend_init(struct settings_kvs *cf)
 {
         int rc;
 
+#if CONFIG_SETTINGS_KVS_SAVE_BUFFER_SIZE > 0
+	memset(&cf->cf_save_wbuf, 0, sizeof(cf->cf_save_wbuf));
+	cf->cf_save_wbuf.buf = cf->cf_save_mem;
+	cf->cf_save_wbuf.size = sizeof(cf->cf_save_mem);
+#endif
+
 	rc = kvs_mount(cf->cf_kvs);
 	if (rc) {
 		return rc;
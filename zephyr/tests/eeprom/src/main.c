@@ -167,7 +167,8 @@ ZTEST(kvs_tests, d_kvs_walk)
 	zassert_false(en_cnt != 1U, "wrong walk result value");
 	/*
 	 * write another entry "/wlk_tst", walk searching for "/wlk_tst" and
-	 * count appearances, this should now be two
+	 * count appearances, this should now be two (one when the value is
+	 * updated in place)
 	 */
 	cnt++;
 	rc = kvs_write(kvs, "/wlk_tst", &cnt, sizeof(cnt));
@@ -175,7 +176,8 @@ ZTEST(kvs_tests, d_kvs_walk)
 	en_cnt = 0U;
 	rc = kvs_walk(kvs, "/wlk_tst", kvs_walk_test_cb, (void *)&en_cnt);
 	zassert_false(rc != 0, "walk failed [%d]", rc);
-	zassert_false(en_cnt != 2U, "wrong walk result value");
+	zassert_false(en_cnt != (kvs->data->inplace ? 1U : 2U),
+		      "wrong walk result value");
 
 	/* walk_unique searching for "/wlk_tst" and get the value */
 	rc = kvs_walk_unique(kvs, "/wlk_tst", kvs_walk_unique_test_cb,
@@ -244,6 +246,16 @@ ZTEST(kvs_tests, e_kvs_compact)
 	zassert_true(rc == 0, "unmount failed [%d]", rc);
 }
 
+/* write "/cnt", the value length alternates: a rewrite of the same length is
+ * updated in place (in-place-update) and does not advance the write position
+ */
+static int kvs_write_cnt(struct kvs *kvs, uint32_t cnt)
+{
+	const uint32_t value[2] = {cnt, 0U};
+
+	return kvs_write(kvs, "/cnt", value, (1U + (cnt & 1U)) * sizeof(cnt));
+}
+
 ZTEST(kvs_tests, f_kvs_gc)
 {
 	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
@@ -264,7 +276,7 @@ ZTEST(kvs_tests, f_kvs_gc)
 
 	while (kvs->data->pos < gc_trigger) {
 		cnt++;
-		rc = kvs_write(kvs, "/cnt", &cnt, sizeof(cnt));
+		rc = kvs_write_cnt(kvs, cnt);
 		zassert_false(rc != 0, "write failed [%d]", rc);
 	}
 
@@ -288,7 +300,7 @@ ZTEST(kvs_tests, f_kvs_gc)
 		uint32_t wrapcnt = kvs->data->wrapcnt;
 
 		cnt++;
-		rc = kvs_write(kvs, "/cnt", &cnt, sizeof(cnt));
+		rc = kvs_write_cnt(kvs, cnt);
 		zassert_false(rc != 0, "write failed [%d]", rc);
 		if (wrapcnt != kvs->data->wrapcnt) {
 			pos += kvs->cfg->bsz * kvs->cfg->bcnt; 
@@ -328,12 +340,14 @@ ZTEST(kvs_tests, g_recovery)
 	rc = kvs_write(kvs, "/bas", &cnt, sizeof(cnt));
 	zassert_false(rc != 0, "write failed [%d]", rc);
 	bufsize = kvs->data->pos;
-	rc = kvs_write(kvs, "/cnt", &cnt, sizeof(cnt));
+	/* the size of the longer of the alternating values */
+	cnt = 1U;
+	rc = kvs_write_cnt(kvs, cnt);
 	cntwrtsize = kvs->data->pos - bufsize;
 
 	while ((kvs->data->pos + cntwrtsize) < gc_trigger) {
 		cnt++;
-		rc = kvs_write(kvs, "/cnt", &cnt, sizeof(cnt));
+		rc = kvs_write_cnt(kvs, cnt);
 		zassert_false(rc != 0, "write failed [%d]", rc);
 	}
 
@@ -362,3 +376,1096 @@ ZTEST(kvs_tests, g_recovery)
 	zassert_false(rdcnt != 0U, "bad /bas read value [%d] != [%d]", rdcnt,
 	              0U);
 }
+
+ZTEST(kvs_tests, h_kvs_compress)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	const char json[] = "{\"name\":\"sensor\",\"value\":12,\"unit\":\"C\"},";
+	uint8_t value[256], rdvalue[256];
+	struct kvs_ent ent;
+	uint32_t pos;
+	int rc;
+
+	for (int i = 0; i < sizeof(value); i++) {
+		value[i] = json[i % (sizeof(json) - 1)];
+	}
+
+	(void)kvs_unmount(kvs);
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	kvs->data->compress = true;
+	pos = kvs->data->pos;
+	rc = kvs_write(kvs, "/json", value, sizeof(value));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	zassert_true((kvs->data->pos - pos) < sizeof(value),
+		     "value not compressed");
+
+	rc = kvs_entry_get(&ent, kvs, "/json");
+	zassert_false(rc != 0, "entry get failed [%d]", rc);
+	zassert_true(entry_get_vlen((&ent)) == sizeof(value),
+		     "wrong value length");
+
+	rc = kvs_entry_read(&ent, entry_get_klen((&ent)) + 100, rdvalue, 50);
+	zassert_false(rc != 0, "entry read failed [%d]", rc);
+	zassert_mem_equal(rdvalue, &value[100], 50, "wrong entry read value");
+
+	for (int i = 0; i < kvs->cfg->bcnt; i++) {
+		rc = kvs_compact(kvs);
+		zassert_false(rc != 0, "compact failed [%d]", rc);
+	}
+
+	(void)kvs_unmount(kvs);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	memset(rdvalue, 0, sizeof(rdvalue));
+	rc = kvs_read(kvs, "/json", rdvalue, sizeof(rdvalue));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_mem_equal(rdvalue, value, sizeof(value), "wrong read value");
+
+	kvs->data->compress = false;
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+}
+
+ZTEST(kvs_tests, i_kvs_write_at)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	const uint8_t patch[] = {0xde, 0xad, 0xbe, 0xef};
+	uint8_t value[128], rdvalue[128];
+	uint32_t pos;
+	int rc;
+
+	for (int i = 0; i < sizeof(value); i++) {
+		value[i] = (uint8_t)i;
+	}
+
+	(void)kvs_unmount(kvs);
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	rc = kvs_write_at(kvs, "/patch", 0, patch, sizeof(patch));
+	zassert_true(rc == -KVS_ENOENT, "write at missing key succeeded");
+
+	rc = kvs_write(kvs, "/patch", value, sizeof(value));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+
+	rc = kvs_write_at(kvs, "/patch", sizeof(value) - 2, patch,
+			  sizeof(patch));
+	zassert_true(rc == -KVS_EINVAL, "write at beyond value succeeded");
+
+	for (int i = 0; i < (KVS_PATCHMAX - 1); i++) {
+		pos = kvs->data->pos;
+		rc = kvs_write_at(kvs, "/patch", 10 * i, patch, sizeof(patch));
+		zassert_false(rc != 0, "write at failed [%d]", rc);
+		zassert_true((kvs->data->pos - pos) < sizeof(value),
+			     "write at wrote complete value");
+		memcpy(&value[10 * i], patch, sizeof(patch));
+
+		rc = kvs_read(kvs, "/patch", rdvalue, sizeof(rdvalue));
+		zassert_false(rc != 0, "read failed [%d]", rc);
+		zassert_mem_equal(rdvalue, value, sizeof(value),
+				  "wrong read value");
+	}
+
+	/* the last patch folds all patches into a new entry */
+	rc = kvs_write_at(kvs, "/patch", 100, patch, sizeof(patch));
+	zassert_false(rc != 0, "write at failed [%d]", rc);
+	memcpy(&value[100], patch, sizeof(patch));
+
+	for (int i = 0; i < kvs->cfg->bcnt; i++) {
+		rc = kvs_compact(kvs);
+		zassert_false(rc != 0, "compact failed [%d]", rc);
+	}
+
+	(void)kvs_unmount(kvs);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	memset(rdvalue, 0, sizeof(rdvalue));
+	rc = kvs_read(kvs, "/patch", rdvalue, sizeof(rdvalue));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_mem_equal(rdvalue, value, sizeof(value), "wrong read value");
+
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+}
+
+static int count_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	uint32_t *cnt = (uint32_t *)cb_arg;
+
+	(*cnt)++;
+	return 0;
+}
+
+ZTEST(kvs_tests, j_kvs_chunked)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	static uint8_t value[DT_PROP(DT_NODELABEL(kvs_storage), block_size) * 3
+			     / 2];
+	const uint8_t patch[] = {0xde, 0xad, 0xbe, 0xef};
+	const uint32_t poff = sizeof(value) / 3 * 2;
+	uint8_t rdvalue[64];
+	struct kvs_ent ent;
+	uint32_t cnt, wrapcnt;
+	int rc;
+
+	for (int i = 0; i < sizeof(value); i++) {
+		value[i] = (uint8_t)(i * 7);
+	}
+
+	(void)kvs_unmount(kvs);
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	/* a chunked value and its old version need to fit */
+	if ((kvs->cfg->bcnt - kvs->cfg->bspr) < 4) {
+		(void)kvs_unmount(kvs);
+		ztest_test_skip();
+	}
+
+	rc = kvs_write(kvs, "/large", value, sizeof(value));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+
+	memcpy(&value[poff], patch, sizeof(patch));
+	rc = kvs_write_at(kvs, "/large", poff, patch, sizeof(patch));
+	zassert_false(rc != 0, "write at failed [%d]", rc);
+
+	/* move the chunks by garbage collection */
+	wrapcnt = kvs->data->wrapcnt;
+	for (uint32_t i = 0; kvs->data->wrapcnt < (wrapcnt + 2); i++) {
+		rc = kvs_write_cnt(kvs, i);
+		zassert_false(rc != 0, "write failed [%d]", rc);
+	}
+
+	(void)kvs_unmount(kvs);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	cnt = 0U;
+	rc = kvs_walk_unique(kvs, "/large", count_cb, &cnt);
+	zassert_false(rc != 0, "walk unique failed [%d]", rc);
+	zassert_true(cnt == 1U, "chunks reported by walk");
+
+	rc = kvs_entry_get(&ent, kvs, "/large");
+	zassert_false(rc != 0, "entry get failed [%d]", rc);
+	zassert_true(entry_get_vlen((&ent)) == sizeof(value),
+		     "wrong value length");
+
+	for (uint32_t off = 0; off < sizeof(value); off += sizeof(rdvalue)) {
+		const size_t len = MIN(sizeof(rdvalue), sizeof(value) - off);
+
+		rc = kvs_entry_read(&ent, entry_get_klen((&ent)) + off,
+				    rdvalue, len);
+		zassert_false(rc != 0, "entry read failed [%d]", rc);
+		zassert_mem_equal(rdvalue, &value[off], len,
+				  "wrong entry read value");
+	}
+
+	rc = kvs_delete(kvs, "/large");
+	zassert_false(rc != 0, "delete failed [%d]", rc);
+	rc = kvs_entry_get(&ent, kvs, "/large");
+	zassert_true(rc == -KVS_ENOENT, "deleted value found");
+
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+}
+
+static uint8_t cold_mem[4096];
+static uint8_t cold_pbuf[4];
+
+static int cold_read(const void *ctx, uint32_t off, void *data, size_t len)
+{
+	memcpy(data, &cold_mem[off], len);
+	return 0;
+}
+
+static int cold_prog(const void *ctx, uint32_t off, const void *data,
+		     size_t len)
+{
+	memcpy(&cold_mem[off], data, len);
+	return 0;
+}
+
+DEFINE_KVS(kvs_cold, NULL, 512, sizeof(cold_mem) / 512, 1, cold_pbuf,
+	   sizeof(cold_pbuf), cold_read, cold_prog, NULL, NULL, NULL, NULL, NULL,
+	   NULL, NULL, 0);
+
+ZTEST(kvs_tests, k_kvs_cold)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	struct kvs *cold = GET_KVS(kvs_cold);
+	uint32_t calib = 0xcafe, cnt, rd, wrapcnt;
+	struct kvs_ent ent;
+	int rc;
+
+	(void)kvs_unmount(kvs);
+	kvs->data->cold = cold;
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+	zassert_true(cold->data->ready, "cold kvs not mounted");
+
+	rc = kvs_write(kvs, "/calib", &calib, sizeof(calib));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	rc = kvs_write(kvs, "/gone", &calib, sizeof(calib));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+
+	/* garbage collection moves the surviving entries to the cold kvs */
+	wrapcnt = kvs->data->wrapcnt;
+	for (cnt = 0U; kvs->data->wrapcnt < (wrapcnt + 2); cnt++) {
+		rc = kvs_write_cnt(kvs, cnt);
+		zassert_false(rc != 0, "write failed [%d]", rc);
+	}
+
+	rc = kvs_entry_get(&ent, kvs, "/calib");
+	zassert_false(rc != 0, "entry get failed [%d]", rc);
+	zassert_true(ent.kvs == cold, "entry not moved to cold kvs");
+
+	rc = kvs_delete(kvs, "/gone");
+	zassert_false(rc != 0, "delete failed [%d]", rc);
+	wrapcnt = kvs->data->wrapcnt;
+	for (; kvs->data->wrapcnt < (wrapcnt + 2); cnt++) {
+		rc = kvs_write_cnt(kvs, cnt);
+		zassert_false(rc != 0, "write failed [%d]", rc);
+	}
+
+	(void)kvs_unmount(kvs);
+	zassert_false(cold->data->ready, "cold kvs not unmounted");
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	rc = kvs_read(kvs, "/calib", &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(rd == calib, "wrong read value");
+	rc = kvs_read(kvs, "/cnt", &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(rd == (cnt - 1), "wrong read value");
+	rc = kvs_read(kvs, "/gone", &rd, sizeof(rd));
+	zassert_true(rc == -KVS_ENOENT, "deleted entry found in cold kvs");
+
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+	kvs->data->cold = NULL;
+}
+
+ZTEST(kvs_tests, l_kvs_gc)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	const uint8_t policy[] = {KVS_GC_GREEDY, KVS_GC_COST_BENEFIT};
+	uint32_t value = 0x12345678, rd, bend;
+	int rc;
+
+	(void)kvs_unmount(kvs);
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	rc = kvs_write(kvs, "/gc", &value, sizeof(value));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+
+	kvs->data->gc = KVS_GC_ALWAYS;
+	bend = kvs->data->bend;
+	rc = kvs_gc(kvs);
+	zassert_false(rc != 0, "gc failed [%d]", rc);
+	zassert_false(kvs->data->bend == bend, "no block reclaimed");
+
+	for (int i = 0; i < ARRAY_SIZE(policy); i++) {
+		kvs->data->gc = policy[i];
+		for (uint32_t cnt = 0U; cnt < 16U; cnt++) {
+			rc = kvs_write(kvs, "/cnt", &cnt, sizeof(cnt));
+			zassert_false(rc != 0, "write failed [%d]", rc);
+		}
+
+		rc = kvs_gc(kvs);
+		zassert_true((rc == 0) || (rc == -KVS_EAGAIN), "gc failed [%d]",
+			     rc);
+	}
+
+	rc = kvs_unmount(kvs);
+	zassert_false(rc != 0, "unmount failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+	rc = kvs_read(kvs, "/gc", &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(rd == value, "wrong read value");
+
+	report_kvs(kvs);
+	kvs->data->gc = KVS_GC_ALWAYS;
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+}
+
+ZTEST(kvs_tests, m_kvs_fsstat)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	static uint32_t blive[128];
+	struct kvs_fsstat stat, scan;
+	uint8_t value[32] = {0};
+	int rc;
+
+	(void)kvs_unmount(kvs);
+	if (kvs->cfg->bcnt > ARRAY_SIZE(blive)) {
+		ztest_test_skip();
+	}
+
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	kvs->data->blive = blive;
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	rc = kvs_fsstat(kvs, &stat);
+	zassert_false(rc != 0, "fsstat failed [%d]", rc);
+	zassert_true(stat.live == 0U, "live data in empty kvs");
+	zassert_true(stat.free == (kvs->data->bend - kvs->data->pos),
+		     "wrong free space");
+	zassert_true((stat.live + stat.dead + stat.free) ==
+		     (kvs->cfg->bcnt * kvs->cfg->bsz), "wrong total size");
+
+	rc = kvs_write(kvs, "/fs", value, sizeof(value));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	rc = kvs_fsstat(kvs, &stat);
+	zassert_false(rc != 0, "fsstat failed [%d]", rc);
+	zassert_true(stat.live >= sizeof(value), "write not accounted");
+
+	value[0] = 1U;
+	rc = kvs_write(kvs, "/fs", value, sizeof(value));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	rc = kvs_write_at(kvs, "/fs", 4U, value, 4U);
+	zassert_false(rc != 0, "write_at failed [%d]", rc);
+	rc = kvs_write(kvs, "/fs2", value, sizeof(value));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+
+	rc = kvs_fsstat(kvs, &stat);
+	zassert_false(rc != 0, "fsstat failed [%d]", rc);
+	kvs->data->blive = NULL;
+	rc = kvs_fsstat(kvs, &scan);
+	kvs->data->blive = blive;
+	zassert_false(rc != 0, "fsstat failed [%d]", rc);
+	zassert_mem_equal(&stat, &scan, sizeof(stat), "counters differ");
+
+	rc = kvs_delete(kvs, "/fs");
+	zassert_false(rc != 0, "delete failed [%d]", rc);
+	rc = kvs_delete(kvs, "/fs2");
+	zassert_false(rc != 0, "delete failed [%d]", rc);
+	rc = kvs_unmount(kvs);
+	zassert_false(rc != 0, "unmount failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+	rc = kvs_fsstat(kvs, &stat);
+	zassert_false(rc != 0, "fsstat failed [%d]", rc);
+	zassert_true(stat.live == 0U, "deleted entries are live");
+
+	rc = kvs_fsstat_block(kvs, kvs->cfg->bcnt, &stat);
+	zassert_true(rc == -KVS_EINVAL, "fsstat of invalid block");
+
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+	kvs->data->blive = NULL;
+}
+
+ZTEST(kvs_tests, n_kvs_stats)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	struct kvs_stats stats = {0};
+	uint8_t value[32] = {0};
+	int rc;
+
+	(void)kvs_unmount(kvs);
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	kvs->data->stats = &stats;
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+	zassert_true(stats.reads != 0U, "mount reads not counted");
+
+	memset(&stats, 0, sizeof(stats));
+	rc = kvs_write(kvs, "/stat", value, sizeof(value));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	zassert_true((stats.writes == 1U) && (stats.wr_bytes == sizeof(value)),
+		     "write not counted");
+	zassert_true(stats.prog_bytes > sizeof(value), "progs not counted");
+
+	rc = kvs_read(kvs, "/stat", value, sizeof(value));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(stats.lookups == 2U, "lookups not counted");
+
+	kvs->data->gc = KVS_GC_ALWAYS;
+	rc = kvs_gc(kvs);
+	zassert_false(rc != 0, "gc failed [%d]", rc);
+	zassert_true(stats.compactions == 1U, "compaction not counted");
+
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+	kvs->data->stats = NULL;
+}
+
+ZTEST(kvs_tests, o_kvs_snapshot)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	struct kvs_snapshot snap;
+	uint32_t value = 1U, rd;
+	int rc;
+
+	(void)kvs_unmount(kvs);
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	rc = kvs_write(kvs, "/snap", &value, sizeof(value));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	rc = kvs_snapshot_take(&snap, kvs);
+	zassert_false(rc != 0, "snapshot take failed [%d]", rc);
+
+	value = 2U;
+	rc = kvs_write(kvs, "/snap", &value, sizeof(value));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	rc = kvs_write(kvs, "/new", &value, sizeof(value));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+
+	rc = kvs_snapshot_read(&snap, "/snap", &rd, sizeof(rd));
+	zassert_false(rc != 0, "snapshot read failed [%d]", rc);
+	zassert_true(rd == 1U, "wrong snapshot value");
+	rc = kvs_snapshot_read(&snap, "/new", &rd, sizeof(rd));
+	zassert_true(rc == -KVS_ENOENT, "entry after snapshot found");
+	rd = 0U;
+	rc = kvs_snapshot_walk_unique(&snap, "/snap", kvs_walk_unique_test_cb, &rd);
+	zassert_false(rc != 0, "snapshot walk failed [%d]", rc);
+	zassert_true(rd == 1U, "wrong snapshot walk value");
+	rc = kvs_read(kvs, "/snap", &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(rd == 2U, "wrong read value");
+
+	/* gc can use the spare blocks, then the snapshot blocks are pinned */
+	kvs->data->gc = KVS_GC_ALWAYS;
+	for (uint32_t i = 0U; i <= kvs->cfg->bspr; i++) {
+		rc = kvs_gc(kvs);
+		if (rc != 0) {
+			break;
+		}
+
+	}
+
+	zassert_true(rc == -KVS_EAGAIN, "gc reclaimed a pinned block");
+	rc = kvs_snapshot_read(&snap, "/snap", &rd, sizeof(rd));
+	zassert_false(rc != 0, "snapshot read failed [%d]", rc);
+	zassert_true(rd == 1U, "wrong snapshot value after gc");
+
+	rc = kvs_snapshot_release(&snap);
+	zassert_false(rc != 0, "snapshot release failed [%d]", rc);
+	rc = kvs_gc(kvs);
+	zassert_false(rc != 0, "gc failed after release [%d]", rc);
+	rc = kvs_read(kvs, "/snap", &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(rd == 2U, "wrong read value after gc");
+
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+}
+
+ZTEST(kvs_tests, p_kvs_read_many)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	struct kvs_stats stats = {0};
+	struct kvs_read_req req[18];
+	char key[ARRAY_SIZE(req)][4];
+	uint32_t value[ARRAY_SIZE(req)], rd;
+	uint32_t reads;
+	int rc;
+
+	(void)kvs_unmount(kvs);
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	for (uint32_t i = 0U; i < ARRAY_SIZE(req); i++) {
+		key[i][0] = '/';
+		key[i][1] = 'm';
+		key[i][2] = 'a' + i;
+		key[i][3] = '\0';
+		req[i].key = key[i];
+		req[i].value = &value[i];
+		req[i].len = sizeof(value[i]);
+		rd = i;
+		rc = kvs_write(kvs, key[i], &rd, sizeof(rd));
+		zassert_false(rc != 0, "write failed [%d]", rc);
+	}
+
+	rd = 0xFFU;
+	rc = kvs_write_at(kvs, key[1], 0U, &rd, 1U);
+	zassert_false(rc != 0, "write_at failed [%d]", rc);
+	rc = kvs_delete(kvs, key[2]);
+	zassert_false(rc != 0, "delete failed [%d]", rc);
+	req[3].key = "/none";
+
+	kvs->data->stats = &stats;
+	for (uint32_t i = 0U; i < ARRAY_SIZE(req); i++) {
+		(void)kvs_read(kvs, req[i].key, &rd, sizeof(rd));
+	}
+
+	reads = stats.reads;
+	memset(&stats, 0, sizeof(stats));
+	rc = kvs_read_many(kvs, req, ARRAY_SIZE(req));
+	zassert_false(rc != 0, "read_many failed [%d]", rc);
+	zassert_true(stats.reads < reads, "read_many not cheaper");
+	kvs->data->stats = NULL;
+
+	for (uint32_t i = 0U; i < ARRAY_SIZE(req); i++) {
+		if ((i == 2U) || (i == 3U)) {
+			zassert_true(req[i].rc == -KVS_ENOENT, "missing key found");
+			continue;
+		}
+
+		zassert_false(req[i].rc != 0, "read failed [%d]", req[i].rc);
+		zassert_true(value[i] == ((i == 1U) ? 0xFFU : i),
+			     "wrong read value");
+	}
+
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+}
+
+static uint8_t seg_mem[4096];
+static uint8_t seg_pbuf[4];
+static uint32_t seg_idx[32];
+
+static int seg_read(const void *ctx, uint32_t off, void *data, size_t len)
+{
+	memcpy(data, &seg_mem[off], len);
+	return 0;
+}
+
+static int seg_prog(const void *ctx, uint32_t off, const void *data,
+		    size_t len)
+{
+	memcpy(&seg_mem[off], data, len);
+	return 0;
+}
+
+DEFINE_KVS(kvs_seg, NULL, 512, sizeof(seg_mem) / 512, 0, seg_pbuf,
+	   sizeof(seg_pbuf), seg_read, seg_prog, NULL, NULL, NULL, NULL, NULL,
+	   NULL, NULL, 0);
+
+static int seg_count_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	uint32_t *cnt = (uint32_t *)cb_arg;
+
+	/* deleted keys are reported with value length 0 */
+	if (entry_get_vlen(ent) != 0U) {
+		(*cnt)++;
+	}
+
+	return 0;
+}
+
+static struct kvs_seg seg = {
+	.kvs = GET_KVS(kvs_seg),
+	.idx = seg_idx,
+	.idxcnt = ARRAY_SIZE(seg_idx),
+};
+
+ZTEST(kvs_tests, q_kvs_seg)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	char key[] = "/sa";
+	uint32_t cnt = 0U, rd;
+	struct kvs_ent ent;
+	int rc;
+
+	(void)kvs_unmount(kvs);
+	kvs->data->seg = &seg;
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+	zassert_true(seg.kvs->data->ready, "segment kvs not mounted");
+	zassert_true(seg.cnt == 0U, "segment not empty after erase");
+
+	for (uint32_t i = 0U; i < 16U; i++) {
+		key[2] = 'a' + (15U - i);
+		rc = kvs_write(kvs, key, &i, sizeof(i));
+		zassert_false(rc != 0, "write failed [%d]", rc);
+	}
+
+	rc = kvs_delete(kvs, "/sa");
+	zassert_false(rc != 0, "delete failed [%d]", rc);
+
+	/* compact builds the segment from the live entries */
+	rc = kvs_compact(kvs);
+	zassert_false(rc != 0, "compact failed [%d]", rc);
+	zassert_true(seg.cnt == 15U, "wrong segment entry count");
+	rc = kvs_entry_get(&ent, kvs, "/sb");
+	zassert_false(rc != 0, "entry get failed [%d]", rc);
+	zassert_true(ent.kvs == seg.kvs, "entry not in segment");
+
+	/* a newer entry in the kvs hides the segment entry */
+	rd = 0xcafe;
+	rc = kvs_write(kvs, "/sb", &rd, sizeof(rd));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	rc = kvs_delete(kvs, "/sc");
+	zassert_false(rc != 0, "delete failed [%d]", rc);
+	rc = kvs_read(kvs, "/sc", &rd, sizeof(rd));
+	zassert_true(rc == -KVS_ENOENT, "deleted entry found in segment");
+	rc = kvs_compact(kvs);
+	zassert_false(rc != 0, "compact failed [%d]", rc);
+	zassert_true(seg.cnt == 14U, "wrong segment entry count");
+
+	(void)kvs_unmount(kvs);
+	zassert_false(seg.kvs->data->ready, "segment kvs not unmounted");
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+	zassert_true(seg.cnt == 14U, "segment not found after mount");
+
+	rc = kvs_read(kvs, "/sb", &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(rd == 0xcafe, "wrong read value");
+	rc = kvs_read(kvs, "/sp", &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(rd == 0U, "wrong read value");
+	rc = kvs_read(kvs, "/sc", &rd, sizeof(rd));
+	zassert_true(rc == -KVS_ENOENT, "deleted entry found after mount");
+
+	rc = kvs_walk_unique(kvs, "/s", seg_count_cb, &cnt);
+	zassert_false(rc != 0, "walk failed [%d]", rc);
+	zassert_true(cnt == 14U, "wrong walk count");
+
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+	kvs->data->seg = NULL;
+}
+
+/* generated by kvs_defgen from: /def/a u32:1, /def/b "text", /def/c hex:0102 */
+static const uint8_t def_c[] = {0x01, 0x02};
+static const uint8_t def_a[] = {0x01, 0x00, 0x00, 0x00};
+static const uint8_t def_b[] = {0x74, 0x65, 0x78, 0x74};
+
+static const struct kvs_default def_ent[] = {
+	{.key = "/def/c", .value = def_c, .len = 2U},
+	{.key = "/def/a", .value = def_a, .len = 4U},
+	{.key = "/def/b", .value = def_b, .len = 4U},
+};
+
+static const uint16_t def_disp[] = {4};
+
+static const struct kvs_defaults defaults = {
+	.ent = def_ent,
+	.disp = def_disp,
+	.cnt = ARRAY_SIZE(def_ent),
+	.dcnt = ARRAY_SIZE(def_disp),
+};
+
+ZTEST(kvs_tests, r_kvs_defaults)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	struct kvs_stats stats = {0};
+	uint32_t rd, value = 0xcafe;
+	char text[4];
+	int rc;
+
+	(void)kvs_unmount(kvs);
+	kvs->data->defaults = &defaults;
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	/* defaults are read from the table, nothing is written */
+	kvs->data->stats = &stats;
+	rc = kvs_read(kvs, "/def/a", &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_mem_equal(&rd, def_a, sizeof(rd), "wrong default value");
+	rc = kvs_read(kvs, "/def/b", text, sizeof(text));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_mem_equal(text, "text", sizeof(text), "wrong default value");
+	rc = kvs_read(kvs, "/def/d", &rd, sizeof(rd));
+	zassert_true(rc == -KVS_ENOENT, "default found for unknown key");
+	zassert_true(stats.progs == 0U, "defaults written to kvs");
+	kvs->data->stats = NULL;
+
+	/* a written value overrides the default, a delete restores it */
+	rc = kvs_write(kvs, "/def/a", &value, sizeof(value));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	rc = kvs_read(kvs, "/def/a", &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(rd == value, "default not overridden");
+	rc = kvs_delete(kvs, "/def/a");
+	zassert_false(rc != 0, "delete failed [%d]", rc);
+	rc = kvs_read(kvs, "/def/a", &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_mem_equal(&rd, def_a, sizeof(rd), "default not restored");
+
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+	kvs->data->defaults = NULL;
+}
+
+static uint32_t wbuf_time;
+
+static uint32_t wbuf_now(void)
+{
+	return wbuf_time;
+}
+
+static uint8_t wbuf_mem[64];
+
+static struct kvs_wbuf wbuf = {
+	.buf = wbuf_mem,
+	.size = sizeof(wbuf_mem),
+	.interval = 100U,
+	.now = wbuf_now,
+};
+
+ZTEST(kvs_tests, s_kvs_wbuf)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	struct kvs_stats stats = {0};
+	uint32_t cnt, rd;
+	int rc;
+
+	(void)kvs_unmount(kvs);
+	kvs->data->wbuf = &wbuf;
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	/* rewrites of a key are absorbed by the write buffer */
+	wbuf_time = 0U;
+	kvs->data->stats = &stats;
+	for (cnt = 0U; cnt < 100U; cnt++) {
+		rc = kvs_write(kvs, "/odo", &cnt, sizeof(cnt));
+		zassert_false(rc != 0, "write failed [%d]", rc);
+		rc = kvs_read(kvs, "/odo", &rd, sizeof(rd));
+		zassert_false(rc != 0, "read failed [%d]", rc);
+		zassert_true(rd == cnt, "wrong read value");
+	}
+
+	zassert_true(stats.progs == 0U, "buffered value written");
+	zassert_true(stats.coalesced == (cnt - 1U), "writes not coalesced");
+
+	/* a write after the interval flushes the buffer */
+	wbuf_time = wbuf.interval;
+	rc = kvs_write(kvs, "/odo", &cnt, sizeof(cnt));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	zassert_true(wbuf.used == 0U, "buffer not flushed");
+	zassert_true(stats.progs != 0U, "buffered value not written");
+	kvs->data->stats = NULL;
+
+	/* a buffered delete hides the value, unmount flushes the buffer */
+	rc = kvs_delete(kvs, "/odo");
+	zassert_false(rc != 0, "delete failed [%d]", rc);
+	rc = kvs_read(kvs, "/odo", &rd, sizeof(rd));
+	zassert_true(rc == -KVS_ENOENT, "buffered delete not applied");
+	rc = kvs_write(kvs, "/last", &cnt, sizeof(cnt));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+	rc = kvs_read(kvs, "/odo", &rd, sizeof(rd));
+	zassert_true(rc == -KVS_ENOENT, "delete not flushed");
+	rc = kvs_read(kvs, "/last", &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(rd == cnt, "wrong read value");
+
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+	kvs->data->wbuf = NULL;
+}
+
+static uint8_t bulk_mem[128];
+
+static struct kvs_wbuf bulk_wbuf = {
+	.buf = bulk_mem,
+	.size = sizeof(bulk_mem),
+};
+
+ZTEST(kvs_tests, t_kvs_bulk)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	struct kvs_stats stats = {0};
+	char key[] = "/bulk/0";
+	uint32_t cnt, rd;
+	int rc;
+
+	(void)kvs_unmount(kvs);
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	for (uint32_t i = 0U; i < 8U; i++) {
+		key[6] = '0' + i;
+		rc = kvs_write(kvs, key, &i, sizeof(i));
+		zassert_false(rc != 0, "write failed [%d]", rc);
+	}
+
+	/* a batch that rewrites all keys only writes the changed value and
+	 * does not write a delete of a key without value.
+	 */
+	kvs->data->wbuf = &bulk_wbuf;
+	for (uint32_t i = 0U; i < 8U; i++) {
+		uint32_t value = (i == 3U) ? 33U : i;
+
+		key[6] = '0' + i;
+		rc = kvs_write(kvs, key, &value, sizeof(value));
+		zassert_false(rc != 0, "write failed [%d]", rc);
+	}
+
+	rc = kvs_delete(kvs, "/bulk/x");
+	zassert_false(rc != 0, "delete failed [%d]", rc);
+
+	kvs->data->stats = &stats;
+	rc = kvs_flush(kvs);
+	zassert_false(rc != 0, "flush failed [%d]", rc);
+	kvs->data->stats = NULL;
+	kvs->data->wbuf = NULL;
+	zassert_true(stats.lookups == 1U, "batch not compared in one walk");
+
+	/* the changed value is added (or updated in place) */
+	cnt = 0U;
+	rc = kvs_walk(kvs, "/bulk", count_cb, &cnt);
+	zassert_false(rc != 0, "walk failed [%d]", rc);
+	zassert_true(cnt == (kvs->data->inplace ? 8U : 9U),
+		     "unchanged values written");
+	rc = kvs_read(kvs, "/bulk/3", &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(rd == 33U, "wrong read value");
+
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+}
+
+static const char *const keydict_keys[] = {
+	"/settings/network/",
+	"/settings/network/ipv4/",
+};
+
+static const struct kvs_keydict keydict = {
+	.key = keydict_keys,
+	.cnt = ARRAY_SIZE(keydict_keys),
+};
+
+static int keydict_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	char key[32];
+	uint32_t *cnt = (uint32_t *)cb_arg;
+	int rc;
+
+	rc = kvs_entry_key(ent, key, sizeof(key));
+	zassert_true(rc > 0, "key read failed [%d]", rc);
+	zassert_true(strncmp(key, "/settings/net", 13) == 0, "wrong key");
+	(*cnt)++;
+	return 0;
+}
+
+ZTEST(kvs_tests, u_kvs_keydict)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	const char *key = "/settings/network/ipv4/addr";
+	struct kvs_ent ent;
+	char rdkey[32];
+	uint32_t cnt, rd;
+	int rc;
+
+	(void)kvs_unmount(kvs);
+	kvs->data->keydict = &keydict;
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	cnt = 4U;
+	rc = kvs_write(kvs, key, &cnt, sizeof(cnt));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	cnt = 6U;
+	rc = kvs_write(kvs, "/settings/network/mtu", &cnt, sizeof(cnt));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+
+	/* the longest dictionary key is replaced by a 2 byte reference */
+	rc = kvs_entry_get(&ent, kvs, key);
+	zassert_false(rc != 0, "entry get failed [%d]", rc);
+	zassert_true(entry_get_klen((&ent)) == 6U, "key not encoded");
+	rc = kvs_entry_key(&ent, rdkey, sizeof(rdkey));
+	zassert_true(rc == (int)strlen(key), "wrong key length [%d]", rc);
+	zassert_mem_equal(rdkey, key, rc, "wrong key");
+
+	/* prefixes that end inside a dictionary key are compared decoded */
+	cnt = 0U;
+	rc = kvs_walk_unique(kvs, "/settings/net", keydict_cb, &cnt);
+	zassert_false(rc != 0, "walk failed [%d]", rc);
+	zassert_true(cnt == 2U, "wrong walk count");
+	cnt = 0U;
+	rc = kvs_walk_unique(kvs, "/settings/network/ipv4/", keydict_cb, &cnt);
+	zassert_false(rc != 0, "walk failed [%d]", rc);
+	zassert_true(cnt == 1U, "wrong walk count");
+
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+	rc = kvs_read(kvs, key, &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(rd == 4U, "wrong read value");
+
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+	kvs->data->keydict = NULL;
+}
+
+static int id_cb(struct kvs_ent *ent, void *cb_arg)
+{
+	uint32_t *cnt = (uint32_t *)cb_arg;
+	uint16_t id;
+
+	if ((entry_get_vlen(ent) != 0U) && (kvs_entry_id(ent, &id) == 0)) {
+		zassert_true(id < 8U, "wrong id");
+		(*cnt)++;
+	}
+
+	return 0;
+}
+
+ZTEST(kvs_tests, v_kvs_id)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	uint32_t cnt, rd;
+	int rc;
+
+	(void)kvs_unmount(kvs);
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	/* numeric keys and string keys coexist */
+	for (uint16_t id = 0U; id < 8U; id++) {
+		cnt = id;
+		rc = kvs_write_id(kvs, id, &cnt, sizeof(cnt));
+		zassert_false(rc != 0, "write failed [%d]", rc);
+	}
+
+	cnt = 100U;
+	rc = kvs_write(kvs, "/id", &cnt, sizeof(cnt));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	rc = kvs_delete_id(kvs, 3U);
+	zassert_false(rc != 0, "delete failed [%d]", rc);
+	rc = kvs_read_id(kvs, 3U, &rd, sizeof(rd));
+	zassert_true(rc == -KVS_ENOENT, "deleted id found");
+	rc = kvs_read_id(kvs, 8U, &rd, sizeof(rd));
+	zassert_true(rc == -KVS_ENOENT, "missing id found");
+
+	cnt = 0U;
+	rc = kvs_walk_unique(kvs, "", id_cb, &cnt);
+	zassert_false(rc != 0, "walk failed [%d]", rc);
+	zassert_true(cnt == 7U, "wrong walk count");
+
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+	rc = kvs_read_id(kvs, 5U, &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(rd == 5U, "wrong read value");
+	rc = kvs_read(kvs, "/id", &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(rd == 100U, "wrong read value");
+
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+}
+
+ZTEST(kvs_tests, w_kvs_inplace)
+{
+	struct kvs *kvs = GET_KVS(DT_NODELABEL(kvs_storage));
+	struct kvs_stats stats = {0};
+	uint32_t cnt, rd, pos;
+	uint16_t cnt16;
+	int rc;
+
+	(void)kvs_unmount(kvs);
+	/* in place updates need memory that can be overwritten */
+	if (!DT_NODE_HAS_COMPAT(DT_NODELABEL(kvs_storage), zephyr_kvs_eeprom)) {
+		ztest_test_skip();
+	}
+
+	zassert_true(kvs->data->inplace, "in-place-update not set");
+	rc = kvs_erase(kvs);
+	zassert_false(rc != 0, "erase failed [%d]", rc);
+	kvs->data->stats = &stats;
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+
+	cnt = 0U;
+	rc = kvs_write(kvs, "/cnt", &cnt, sizeof(cnt));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	pos = kvs->data->pos;
+
+	/* a rewrite of the same length does not advance the write position */
+	cnt = 1U;
+	rc = kvs_write(kvs, "/cnt", &cnt, sizeof(cnt));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	zassert_true(kvs->data->pos == pos, "write position advanced");
+	for (cnt = 2U; cnt <= 100U; cnt++) {
+		rc = kvs_write(kvs, "/cnt", &cnt, sizeof(cnt));
+		zassert_false(rc != 0, "write failed [%d]", rc);
+	}
+
+	zassert_true(kvs->data->pos == pos, "update not in place");
+	zassert_true(stats.inplace == 100U, "in place updates not counted");
+	rc = kvs_read(kvs, "/cnt", &rd, sizeof(rd));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(rd == 100U, "wrong read value");
+
+	/* a value of a other length is added */
+	cnt16 = 200U;
+	rc = kvs_write(kvs, "/cnt", &cnt16, sizeof(cnt16));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	zassert_true(kvs->data->pos > pos, "value not added");
+	cnt16 = 300U;
+	rc = kvs_write(kvs, "/cnt", &cnt16, sizeof(cnt16));
+	zassert_false(rc != 0, "write failed [%d]", rc);
+	zassert_true(stats.inplace == 101U, "update not in place");
+
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+	rc = kvs_mount(kvs);
+	zassert_false(rc != 0, "mount failed [%d]", rc);
+	cnt16 = 0U;
+	rc = kvs_read(kvs, "/cnt", &cnt16, sizeof(cnt16));
+	zassert_false(rc != 0, "read failed [%d]", rc);
+	zassert_true(cnt16 == 300U, "wrong read value");
+
+	report_kvs(kvs);
+	rc = kvs_unmount(kvs);
+	zassert_true(rc == 0, "unmount failed [%d]", rc);
+	kvs->data->stats = NULL;
+}